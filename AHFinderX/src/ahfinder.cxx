@@ -9,10 +9,12 @@
 
 #include <cctk.h>
 #include <cctk_Arguments.h>
+#include <cctk_Parameter.h>
 #include <cctk_Parameters.h>
 
 #include <ssht/ssht.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
@@ -20,6 +22,7 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <utility>
 #include <vector>
 
 namespace AHFinder {
@@ -68,6 +71,12 @@ template <typename T> struct metric_t {
   geom_t geom;
   smat3<scalar_aij_t<T> > g, K;
   smat3<vec3<scalar_aij_t<T> > > dg;
+  // Second derivatives of the metric and first derivatives of the
+  // extrinsic curvature at each point (index geom.gind(i, j)). These
+  // are only set for the Newton solver, which moves the metric to
+  // nearby points (see displace_metric), and are empty otherwise.
+  std::vector<smat3<smat3<T> > > ddg;
+  std::vector<smat3<vec3<T> > > dK;
 
   metric_t() = delete;
   metric_t(const geom_t &geom)
@@ -185,9 +194,16 @@ metric_t<T> brill_lindquist_metric(const cGH *const cctkGH,
   return metric;
 }
 
+// Interpolate the metric to the points of several surfaces. All points
+// are handled in a single interpolation call, since each call is
+// collective and has a latency. With `with_derivs`, also interpolate
+// the second derivatives of the metric and the first derivatives of the
+// extrinsic curvature.
 template <typename T>
-metric_t<T> interpolate_metric(const cGH *const cctkGH,
-                               const coords_t<T> &coords) {
+std::vector<metric_t<T> >
+interpolate_metrics(const cGH *const cctkGH,
+                    const std::vector<const coords_t<T> *> &coordss,
+                    const bool with_derivs) {
   const int gxx_ind = CCTK_VarIndex("ADMBaseX::gxx");
   const int gxy_ind = CCTK_VarIndex("ADMBaseX::gxy");
   const int gxz_ind = CCTK_VarIndex("ADMBaseX::gxz");
@@ -201,56 +217,119 @@ metric_t<T> interpolate_metric(const cGH *const cctkGH,
   const int kyz_ind = CCTK_VarIndex("ADMBaseX::kyz");
   const int kzz_ind = CCTK_VarIndex("ADMBaseX::kzz");
 
-  constexpr int nvars = 6 * (1 + 3 + 1);
-  const array<CCTK_INT, nvars> varinds{
+  constexpr int nvars0 = 6 * (1 + 3 + 1);
+  std::vector<CCTK_INT> varinds{
       gxx_ind, gxy_ind, gxz_ind, gyy_ind, gyz_ind, gzz_ind, //
       gxx_ind, gxy_ind, gxz_ind, gyy_ind, gyz_ind, gzz_ind, //
       gxx_ind, gxy_ind, gxz_ind, gyy_ind, gyz_ind, gzz_ind, //
       gxx_ind, gxy_ind, gxz_ind, gyy_ind, gyz_ind, gzz_ind, //
       kxx_ind, kxy_ind, kxz_ind, kyy_ind, kyz_ind, kzz_ind, //
   };
-  const array<CCTK_INT, nvars> operations{
+  std::vector<CCTK_INT> operations{
       0, 0, 0, 0, 0, 0, //
       1, 1, 1, 1, 1, 1, //
       2, 2, 2, 2, 2, 2, //
       3, 3, 3, 3, 3, 3, //
       0, 0, 0, 0, 0, 0, //
   };
+  // The operation 10 d + e is the second derivative in directions d and
+  // e (1 <= d <= e <= 3)
+  if (with_derivs) {
+    for (const int ind :
+         {gxx_ind, gxy_ind, gxz_ind, gyy_ind, gyz_ind, gzz_ind})
+      for (int d = 1; d <= 3; ++d)
+        for (int e = d; e <= 3; ++e) {
+          varinds.push_back(ind);
+          operations.push_back(10 * d + e);
+        }
+    for (const int ind :
+         {kxx_ind, kxy_ind, kxz_ind, kyy_ind, kyz_ind, kzz_ind})
+      for (int d = 1; d <= 3; ++d) {
+        varinds.push_back(ind);
+        operations.push_back(d);
+      }
+  }
+  const int nvars = varinds.size();
+
+  // Gather the points of all surfaces
+  int npoints = 0;
+  for (const coords_t<T> *const coords : coordss)
+    npoints += coords->geom.npoints;
+  array<std::vector<T>, 3> xs;
+  for (int d = 0; d < 3; ++d) {
+    xs[d].reserve(npoints);
+    for (const coords_t<T> *const coords : coordss)
+      xs[d].insert(xs[d].end(), coords->x(d)().data(),
+                   coords->x(d)().data() + coords->geom.npoints);
+  }
 
-  const geom_t &geom = coords.geom;
-  metric_t<T> metric(geom);
-  array<T *, nvars> ptrs{
-      metric.g(0, 0)().data(),     metric.g(0, 1)().data(),
-      metric.g(0, 2)().data(),     metric.g(1, 1)().data(),
-      metric.g(1, 2)().data(),     metric.g(2, 2)().data(),
-      metric.dg(0, 0)(0)().data(), metric.dg(0, 1)(0)().data(),
-      metric.dg(0, 2)(0)().data(), metric.dg(1, 1)(0)().data(),
-      metric.dg(1, 2)(0)().data(), metric.dg(2, 2)(0)().data(),
-      metric.dg(0, 0)(1)().data(), metric.dg(0, 1)(1)().data(),
-      metric.dg(0, 2)(1)().data(), metric.dg(1, 1)(1)().data(),
-      metric.dg(1, 2)(1)().data(), metric.dg(2, 2)(1)().data(),
-      metric.dg(0, 0)(2)().data(), metric.dg(0, 1)(2)().data(),
-      metric.dg(0, 2)(2)().data(), metric.dg(1, 1)(2)().data(),
-      metric.dg(1, 2)(2)().data(), metric.dg(2, 2)(2)().data(),
-      metric.K(0, 0)().data(),     metric.K(0, 1)().data(),
-      metric.K(0, 2)().data(),     metric.K(1, 1)().data(),
-      metric.K(1, 2)().data(),     metric.K(2, 2)().data()};
-
-  Interpolate(cctkGH, geom.npoints, coords.x(0)().data(), coords.x(1)().data(),
-              coords.x(2)().data(), nvars, varinds.data(), operations.data(),
-              ptrs.data());
-
-  metric.g(1, 0)() = metric.g(0, 1)();
-  metric.g(2, 0)() = metric.g(0, 2)();
-  metric.g(2, 1)() = metric.g(1, 2)();
-  metric.dg(1, 0)() = metric.dg(0, 1)();
-  metric.dg(2, 0)() = metric.dg(0, 2)();
-  metric.dg(2, 1)() = metric.dg(1, 2)();
-  metric.K(1, 0)() = metric.K(0, 1)();
-  metric.K(2, 0)() = metric.K(0, 2)();
-  metric.K(2, 1)() = metric.K(1, 2)();
+  std::vector<std::vector<T> > results(nvars, std::vector<T>(npoints));
+  std::vector<T *> ptrs(nvars);
+  for (int v = 0; v < nvars; ++v)
+    ptrs[v] = results[v].data();
+
+  Interpolate(cctkGH, npoints, xs[0].data(), xs[1].data(), xs[2].data(),
+              nvars, varinds.data(), operations.data(), ptrs.data());
+
+  // Scatter the results
+  std::vector<metric_t<T> > metrics;
+  int offset = 0;
+  for (const coords_t<T> *const coords : coordss) {
+    const geom_t &geom = coords->geom;
+    metric_t<T> metric(geom);
+    const array<T *, nvars0> metric_ptrs{
+        metric.g(0, 0)().data(),     metric.g(0, 1)().data(),
+        metric.g(0, 2)().data(),     metric.g(1, 1)().data(),
+        metric.g(1, 2)().data(),     metric.g(2, 2)().data(),
+        metric.dg(0, 0)(0)().data(), metric.dg(0, 1)(0)().data(),
+        metric.dg(0, 2)(0)().data(), metric.dg(1, 1)(0)().data(),
+        metric.dg(1, 2)(0)().data(), metric.dg(2, 2)(0)().data(),
+        metric.dg(0, 0)(1)().data(), metric.dg(0, 1)(1)().data(),
+        metric.dg(0, 2)(1)().data(), metric.dg(1, 1)(1)().data(),
+        metric.dg(1, 2)(1)().data(), metric.dg(2, 2)(1)().data(),
+        metric.dg(0, 0)(2)().data(), metric.dg(0, 1)(2)().data(),
+        metric.dg(0, 2)(2)().data(), metric.dg(1, 1)(2)().data(),
+        metric.dg(1, 2)(2)().data(), metric.dg(2, 2)(2)().data(),
+        metric.K(0, 0)().data(),     metric.K(0, 1)().data(),
+        metric.K(0, 2)().data(),     metric.K(1, 1)().data(),
+        metric.K(1, 2)().data(),     metric.K(2, 2)().data()};
+    for (int v = 0; v < nvars0; ++v)
+      std::copy(results[v].begin() + offset,
+                results[v].begin() + offset + geom.npoints, metric_ptrs[v]);
+    if (with_derivs) {
+      metric.ddg.resize(geom.npoints);
+      metric.dK.resize(geom.npoints);
+      for (int n = 0; n < geom.npoints; ++n) {
+        int v = nvars0;
+        for (int a = 0; a < 3; ++a)
+          for (int b = a; b < 3; ++b)
+            for (int c = 0; c < 3; ++c)
+              for (int d = c; d < 3; ++d)
+                metric.ddg[n](a, b)(c, d) = results[v++][offset + n];
+        for (int a = 0; a < 3; ++a)
+          for (int b = a; b < 3; ++b)
+            for (int c = 0; c < 3; ++c)
+              metric.dK[n](a, b)(c) = results[v++][offset + n];
+        assert(v == nvars);
+      }
+    }
+    offset += geom.npoints;
+
+    metric.g(1, 0)() = metric.g(0, 1)();
+    metric.g(2, 0)() = metric.g(0, 2)();
+    metric.g(2, 1)() = metric.g(1, 2)();
+    metric.dg(1, 0)() = metric.dg(0, 1)();
+    metric.dg(2, 0)() = metric.dg(0, 2)();
+    metric.dg(2, 1)() = metric.dg(1, 2)();
+    metric.K(1, 0)() = metric.K(0, 1)();
+    metric.K(2, 0)() = metric.K(0, 2)();
+    metric.K(2, 1)() = metric.K(1, 2)();
+
+    metrics.push_back(std::move(metric));
+  }
+  assert(offset == npoints);
 
-  return metric;
+  return metrics;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -566,6 +645,14 @@ void update_position(vec3<T> &pos, scalar_alm_t<std::complex<T> > &hlm) {
     hlm()(1, m) = 0;
 }
 
+// Fast flow scaling of the mode l of rho Theta
+template <typename T> T fast_flow_lambda(const int l) {
+  DECLARE_CCTK_PARAMETERS;
+  const T A = fast_flow_A;
+  const T B = fast_flow_B;
+  return l == 0 ? A : A / (B + T(l * (l + 1)));
+}
+
 template <typename T>
 scalar_alm_t<std::complex<T> >
 step(const cGH *const cctkGH, const vec3<T> &pos, const T &radius,
@@ -580,15 +667,12 @@ step(const cGH *const cctkGH, const vec3<T> &pos, const T &radius,
   // const T A = alpha / (geom.lmax * (geom.lmax + 1)) + beta;
   // const T B = beta / alpha;
 
-  const T A = fast_flow_A;
-  const T B = fast_flow_B;
-
   scalar_alm_t<std::complex<T> > delta_hlm(geom);
   for (int l = 0; l <= geom.lmax; ++l) {
 #pragma omp simd
     for (int m = -l; m <= l; ++m) {
       // const T lambda = A / (1 + B * l * (l + 1));
-      const T lambda = l == 0 ? A : A / (B + T(l * (l + 1)));
+      const T lambda = fast_flow_lambda<T>(l);
       delta_hlm()(l, m) = -lambda * rhoThetalm()(l, m);
       // const auto L = geom.lmax;
       // const auto ll1 = l * (l + 1);
@@ -608,107 +692,668 @@ step(const cGH *const cctkGH, const vec3<T> &pos, const T &radius,
   return delta_hlm;
 }
 
+// The metric at slightly displaced points, from a first order Taylor
+// expansion of the metric, its derivatives, and the extrinsic curvature
+// at the original points. This needs the metric's `ddg` and `dK`.
+template <typename T>
+metric_t<T> displace_metric(const metric_t<T> &metric,
+                            const coords_t<T> &coords,
+                            const coords_t<T> &new_coords) {
+  const geom_t &geom = coords.geom;
+  assert(int(metric.ddg.size()) == geom.npoints);
+  assert(int(metric.dK.size()) == geom.npoints);
+  metric_t<T> new_metric = metric;
+  for (int i = 0; i < geom.ntheta; ++i) {
+#pragma omp simd
+    for (int j = 0; j < geom.nphi; ++j) {
+      const int n = geom.gind(i, j);
+      const vec3<T> dx([&](int c) {
+        return new_coords.x(c)()(i, j) - coords.x(c)()(i, j);
+      });
+      for (int a = 0; a < 3; ++a) {
+        for (int b = a; b < 3; ++b) {
+          new_metric.g(a, b)()(i, j) += sum3(
+              [&](int c) { return metric.dg(a, b)(c)()(i, j) * dx(c); });
+          for (int c = 0; c < 3; ++c)
+            new_metric.dg(a, b)(c)()(i, j) += sum3(
+                [&](int d) { return metric.ddg[n](a, b)(c, d) * dx(d); });
+          new_metric.K(a, b)()(i, j) +=
+              sum3([&](int c) { return metric.dK[n](a, b)(c) * dx(c); });
+        }
+      }
+    }
+  }
+  return new_metric;
+}
+
+// Newton step for rho Theta = 0, solving the linearized equation with
+// GMRES. The Jacobian is applied by finite differencing the expansion.
+// `metric_at` returns the metric on a perturbed surface; this is either
+// the analytic metric, or the metric at the current surface moved there
+// with displace_metric, so that no additional interpolation is needed.
+// The fast flow scaling is used as right preconditioner.
+template <typename T, typename F>
+scalar_alm_t<std::complex<T> >
+newton_step(const vec3<T> &pos, const scalar_alm_t<std::complex<T> > &hlm,
+            const F &metric_at, const Theta_t<T> &Theta,
+            const int max_krylov, const T krylov_tolerance,
+            const bool verbose) {
+  using std::abs, std::sqrt;
+  typedef std::vector<std::complex<T> > cvec;
+
+  const geom_t &geom = hlm.geom;
+  const int n = geom.ncoeffs;
+
+  // Coefficients of real functions form a real vector space
+  const auto dot = [&](const cvec &x, const cvec &y) {
+    T r = 0;
+    for (int i = 0; i < n; ++i)
+      r += real(conj(x[i]) * y[i]);
+    return r;
+  };
+  const auto norm = [&](const cvec &x) { return sqrt(dot(x, x)); };
+
+  const auto precondition = [&](const cvec &x) {
+    cvec y(n);
+    for (int l = 0; l <= geom.lmax; ++l)
+      for (int m = -l; m <= l; ++m)
+        y[geom.cind(l, m)] = fast_flow_lambda<T>(l) * x[geom.cind(l, m)];
+    return y;
+  };
+
+  const cvec &F0 = Theta.rhoThetalm().alm;
+  const T hnorm = norm(hlm().alm);
+  const auto jacobian = [&](const cvec &v) {
+    const T vnorm = norm(v);
+    cvec r(n);
+    if (vnorm == 0)
+      return r;
+    const T eps =
+        sqrt(std::numeric_limits<T>::epsilon()) * (1 + hnorm) / vnorm;
+    scalar_alm_t<std::complex<T> > hlm1(geom);
+    for (int i = 0; i < n; ++i)
+      hlm1().alm[i] = hlm().alm[i] + eps * v[i];
+    const auto coords1 = coords_from_shape(pos, evaluate(hlm1));
+    const auto metric1 = metric_at(coords1);
+    const auto Theta1 = expansion(metric1, pos, hlm1, Theta.which_Theta);
+    for (int i = 0; i < n; ++i)
+      r[i] = (Theta1.rhoThetalm().alm[i] - F0[i]) / eps;
+    return r;
+  };
+
+  // GMRES for J P y = -F0, with the step P y
+  const int kmax = max_krylov;
+  std::vector<cvec> V;
+  std::vector<std::vector<T> > H(kmax + 1, std::vector<T>(kmax, 0));
+  std::vector<T> cs(kmax), sn(kmax), g(kmax + 1, 0);
+
+  cvec r0(n);
+  for (int i = 0; i < n; ++i)
+    r0[i] = -F0[i];
+  const T beta = norm(r0);
+  scalar_alm_t<std::complex<T> > delta_hlm(geom);
+  if (beta == 0)
+    return delta_hlm;
+  for (auto &x : r0)
+    x /= beta;
+  V.push_back(std::move(r0));
+  g[0] = beta;
+
+  int k = 0;
+  while (k < kmax) {
+    cvec w = jacobian(precondition(V[k]));
+    for (int j = 0; j <= k; ++j) {
+      H[j][k] = dot(V[j], w);
+      for (int i = 0; i < n; ++i)
+        w[i] -= H[j][k] * V[j][i];
+    }
+    const T hnext = norm(w);
+
+    for (int j = 0; j < k; ++j) {
+      const T tmp = cs[j] * H[j][k] + sn[j] * H[j + 1][k];
+      H[j + 1][k] = -sn[j] * H[j][k] + cs[j] * H[j + 1][k];
+      H[j][k] = tmp;
+    }
+    const T den = std::hypot(H[k][k], hnext);
+    if (den == 0)
+      break;
+    cs[k] = H[k][k] / den;
+    sn[k] = hnext / den;
+    H[k][k] = den;
+    g[k + 1] = -sn[k] * g[k];
+    g[k] = cs[k] * g[k];
+    ++k;
+
+    if (hnext == 0 || abs(g[k]) <= krylov_tolerance * beta)
+      break;
+    for (auto &x : w)
+      x /= hnext;
+    V.push_back(std::move(w));
+  }
+  if (verbose)
+    CCTK_VINFO("    Newton: %d Krylov iterations, relative residual %g", k,
+               double(abs(g[k]) / beta));
+
+  std::vector<T> y(k);
+  for (int i = k - 1; i >= 0; --i) {
+    T r = g[i];
+    for (int j = i + 1; j < k; ++j)
+      r -= H[i][j] * y[j];
+    y[i] = r / H[i][i];
+  }
+  cvec x(n);
+  for (int j = 0; j < k; ++j)
+    for (int i = 0; i < n; ++i)
+      x[i] += y[j] * V[j][i];
+  delta_hlm().alm = precondition(x);
+
+  // Limit the step size to 10% of the current radius
+  const T rmin = minimum(evaluate(hlm));
+  const T dmax = maxabs(evaluate(delta_hlm)());
+  if (dmax > T(0.1) * rmin)
+    delta_hlm *= T(0.1) * rmin / dmax;
+
+  return delta_hlm;
+}
+
+// The state of the search for one horizon
+template <typename T> struct horizon_t {
+  int n; // horizon index
+  vec3<T> pos;
+  T radius;
+  scalar_alm_t<std::complex<T> > hlm;
+  bool converged;
+
+  // The previous iterate, to fall back to a fast flow step if a Newton
+  // step did not reduce the expansion
+  bool have_prev;
+  vec3<T> prev_pos;
+  scalar_alm_t<std::complex<T> > prev_hlm;
+  scalar_alm_t<std::complex<T> > prev_delta_hlm;
+  T prev_Theta_maxabs;
+
+  horizon_t(const int n, const vec3<T> &pos, const T &radius,
+            const scalar_alm_t<std::complex<T> > &hlm)
+      : n(n), pos(pos), radius(radius), hlm(hlm), converged(false),
+        have_prev(false), prev_pos(pos), prev_hlm(hlm),
+        prev_delta_hlm(hlm.geom), prev_Theta_maxabs(0) {}
+};
+
+// Search for several horizons at the same time. Each iteration needs
+// only one interpolation for all horizons that have not yet been
+// found. On return, `converged` is set for the horizons that were
+// found, and `pos`, `radius`, and `hlm` describe the last iterates.
 template <typename T>
-void solve(const cGH *const cctkGH, vec3<T> &pos, T &radius,
-           scalar_alm_t<std::complex<T> > hlm) {
+void solve(const cGH *const cctkGH, std::vector<horizon_t<T> > &horizons) {
   DECLARE_CCTK_ARGUMENTS;
   DECLARE_CCTK_PARAMETERS;
 
+  const bool use_newton = CCTK_EQUALS(solver, "Newton");
+
   int iter = 0;
   for (;;) {
     if (iter >= max_iters)
       break;
 
+    std::vector<horizon_t<T> *> active;
+    for (auto &horizon : horizons)
+      if (!horizon.converged)
+        active.push_back(&horizon);
+    if (active.empty())
+      break;
+
     ++iter;
     CCTK_VINFO("iter: %d", iter);
 
-    update_position(pos, hlm);
-    radius = average(hlm);
-
-    const auto hij = evaluate(hlm);
-    CCTK_VINFO("    pos=[%g,%g,%g]", pos(0), pos(1), pos(2));
-    CCTK_VINFO("    r_avg=%g   r_min=%g r_max=%g", average(hlm), minimum(hij),
-               maximum(hij));
-    if (0) {
-      const int lmax = hlm.geom.lmax;
-      for (int l = 0; l <= min(4, lmax); ++l) {
+    std::vector<coords_t<T> > coordss;
+    coordss.reserve(active.size());
+    for (horizon_t<T> *const horizon : active) {
+      vec3<T> &pos = horizon->pos;
+      scalar_alm_t<std::complex<T> > &hlm = horizon->hlm;
+
+      update_position(pos, hlm);
+      horizon->radius = average(hlm);
+
+      const auto hij = evaluate(hlm);
+      CCTK_VINFO("  horizon %d:", horizon->n);
+      CCTK_VINFO("    pos=[%g,%g,%g]", pos(0), pos(1), pos(2));
+      CCTK_VINFO("    r_avg=%g   r_min=%g r_max=%g", average(hlm),
+                 minimum(hij), maximum(hij));
+      if (0) {
+        const int lmax = hlm.geom.lmax;
+        for (int l = 0; l <= min(4, lmax); ++l) {
+          using std::abs, std::max, std::min;
+          T r = 0.0, rmin = 1.0 / 0.0, rmax = -1.0 / 0.0;
+          for (int m = -l; m <= +l; ++m) {
+            rmin = min(rmin, real(hlm()(l, m)));
+            rmin = min(rmin, imag(hlm()(l, m)));
+            rmax = max(rmax, real(hlm()(l, m)));
+            rmax = max(rmax, imag(hlm()(l, m)));
+            r = max(r, abs(hlm()(l, m)));
+          }
+          CCTK_VINFO("    |h%dm|=%g   %g   %g", l, r, rmin, rmax);
+        }
+      }
+
+      coordss.push_back(coords_from_shape(pos, hij));
+    }
+
+    std::vector<metric_t<T> > metrics;
+    if (use_Brill_Lindquist_metric) {
+      for (const auto &coords : coordss)
+        metrics.push_back(brill_lindquist_metric(cctkGH, coords));
+    } else {
+      std::vector<const coords_t<T> *> coords_ptrs;
+      for (const auto &coords : coordss)
+        coords_ptrs.push_back(&coords);
+      metrics = interpolate_metrics(cctkGH, coords_ptrs, use_newton);
+    }
+
+    for (int a = 0; a < int(active.size()); ++a) {
+      horizon_t<T> &horizon = *active.at(a);
+      vec3<T> &pos = horizon.pos;
+      scalar_alm_t<std::complex<T> > &hlm = horizon.hlm;
+      const auto &coords = coordss.at(a);
+      const auto &metric = metrics.at(a);
+
+      const auto Theta = expansion(metric, pos, hlm);
+      const auto &Thetalm = Theta.Thetalm;
+      const auto Thetaij = evaluate(Thetalm);
+      const T Theta_maxabs = maxabs(Thetaij());
+      CCTK_VINFO("  horizon %d:", horizon.n);
+      CCTK_VINFO("    Θ_avg=%g   Θ_maxabs=%g", average(Thetalm),
+                 Theta_maxabs);
+
+      if (use_newton && horizon.have_prev &&
+          Theta_maxabs > horizon.prev_Theta_maxabs) {
+        CCTK_VINFO("    Newton step rejected, taking fast flow step instead");
+        pos = horizon.prev_pos;
+        hlm = horizon.prev_hlm + horizon.prev_delta_hlm;
+        horizon.have_prev = false;
+        continue;
+      }
+
+      auto delta_hlm = step(cctkGH, pos, horizon.radius, hlm, Theta);
+      if (use_newton) {
+        horizon.have_prev = true;
+        horizon.prev_pos = pos;
+        horizon.prev_hlm = hlm;
+        horizon.prev_delta_hlm = delta_hlm;
+        horizon.prev_Theta_maxabs = Theta_maxabs;
+        const auto metric_at = [&](const coords_t<T> &coords1) {
+          return use_Brill_Lindquist_metric
+                     ? brill_lindquist_metric(cctkGH, coords1)
+                     : displace_metric(metric, coords, coords1);
+        };
+        delta_hlm = newton_step(pos, hlm, metric_at, Theta,
+                                int(newton_max_krylov),
+                                T(newton_krylov_tolerance), newton_verbose);
+      }
+      CCTK_VINFO("    Δr_avg=%g", average(delta_hlm));
+
+      if (0) {
         using std::abs, std::max, std::min;
-        T r = 0.0, rmin = 1.0 / 0.0, rmax = -1.0 / 0.0;
-        for (int m = -l; m <= +l; ++m) {
-          rmin = min(rmin, real(hlm()(l, m)));
-          rmin = min(rmin, imag(hlm()(l, m)));
-          rmax = max(rmax, real(hlm()(l, m)));
-          rmax = max(rmax, imag(hlm()(l, m)));
-          r = max(r, abs(hlm()(l, m)));
+        const int lmax = hlm.geom.lmax;
+        for (int l = 0; l <= min(4, lmax); ++l) {
+          T r = 0.0, rmin = 1.0 / 0.0, rmax = -1.0 / 0.0;
+          for (int m = -l; m <= +l; ++m) {
+            rmin = min(rmin, real(delta_hlm()(l, m)));
+            rmin = min(rmin, imag(delta_hlm()(l, m)));
+            rmax = max(rmax, real(delta_hlm()(l, m)));
+            rmax = max(rmax, imag(delta_hlm()(l, m)));
+            r = max(r, abs(delta_hlm()(l, m)));
+          }
+          CCTK_VINFO("    |Δh%dm|=%g   %g   %g", l, r, rmin, rmax);
         }
-        CCTK_VINFO("    |h%dm|=%g   %g   %g", l, r, rmin, rmax);
       }
+
+      hlm = hlm + delta_hlm;
+      if (Theta_maxabs <= max_expansion)
+        horizon.converged = true;
+    }
+  }
+
+  for (auto &horizon : horizons) {
+    update_position(horizon.pos, horizon.hlm);
+    horizon.radius = average(horizon.hlm);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The shapes of the most recently found horizons are kept in grid
+// arrays (so that they are checkpointed). The coefficient (l,m) of the
+// k-th newest shape of horizon h is stored at index
+// l (l + 1) + m + lsh[0] (k + max_history h).
+constexpr int max_history = 3;
+
+// Set the initial guess for horizon h by extrapolating its stored
+// shapes in time. Leaves `pos` and `hlm` unchanged if there are no
+// stored shapes.
+template <typename T>
+void extrapolate_shape(const cGH *const cctkGH, const int h, vec3<T> &pos,
+                       scalar_alm_t<std::complex<T> > &hlm) {
+  DECLARE_CCTK_ARGUMENTS_AHFinder_find;
+  DECLARE_CCTK_PARAMETERS;
+
+  using std::min;
+  const int nhist = min(int(ah_shape_count[h]), int(extrapolation_order) + 1);
+  if (!use_previous_shape || nhist == 0)
+    return;
+
+  int lsh[3];
+  const int ierr = CCTK_GrouplshGN(cctkGH, 3, lsh, "AHFinder::shape_history");
+  assert(!ierr);
+  const geom_t &geom = hlm.geom;
+  const int lmax = min(geom.lmax, int(ah_shape_lmax[h]));
+  const auto info = [&](const int k) { return k + max_history * h; };
+
+  // Lagrange polynomial through the stored horizons
+  array<T, max_history> weights;
+  for (int k = 0; k < nhist; ++k) {
+    weights[k] = 1;
+    for (int j = 0; j < nhist; ++j)
+      if (j != k)
+        weights[k] *= (cctk_time - ah_shape_time[info(j)]) /
+                      (ah_shape_time[info(k)] - ah_shape_time[info(j)]);
+  }
+
+  vec3<T> new_pos{0, 0, 0};
+  for (int k = 0; k < nhist; ++k) {
+    new_pos(0) += weights[k] * ah_shape_pos_x[info(k)];
+    new_pos(1) += weights[k] * ah_shape_pos_y[info(k)];
+    new_pos(2) += weights[k] * ah_shape_pos_z[info(k)];
+  }
+  scalar_alm_t<std::complex<T> > new_hlm(geom);
+  for (int l = 0; l <= lmax; ++l) {
+    for (int m = -l; m <= l; ++m) {
+      std::complex<T> a = 0;
+      for (int k = 0; k < nhist; ++k) {
+        const int ind = l * (l + 1) + m + lsh[0] * info(k);
+        a += weights[k] * std::complex<T>(ah_shape_re[ind], ah_shape_im[ind]);
+      }
+      new_hlm()(l, m) = a;
     }
+  }
+
+  // Extrapolation might fail for rapidly changing horizons
+  const auto new_hij = evaluate(new_hlm);
+  if (minimum(new_hij) <= 0) {
+    CCTK_VWARN(CCTK_WARN_ALERT,
+               "Extrapolated shape of horizon %d is not valid; starting from "
+               "a sphere",
+               h);
+    return;
+  }
 
-    const auto coords = coords_from_shape(pos, hij);
-    const auto metric = use_Brill_Lindquist_metric
-                            ? brill_lindquist_metric(cctkGH, coords)
-                            : interpolate_metric(cctkGH, coords);
-    const auto Theta = expansion(metric, pos, hlm);
-    const auto &Thetalm = Theta.Thetalm;
-    const auto Thetaij = evaluate(Thetalm);
-    CCTK_VINFO("    Θ_avg=%g   Θ_maxabs=%g", average(Thetalm),
-               maxabs(Thetaij()));
-
-    auto delta_hlm = step(cctkGH, pos, radius, hlm, Theta);
-    CCTK_VINFO("    Δr_avg=%g", average(delta_hlm));
-
-    if (0) {
-      using std::abs, std::max, std::min;
-      const int lmax = hlm.geom.lmax;
-      for (int l = 0; l <= min(4, lmax); ++l) {
-        T r = 0.0, rmin = 1.0 / 0.0, rmax = -1.0 / 0.0;
-        for (int m = -l; m <= +l; ++m) {
-          rmin = min(rmin, real(delta_hlm()(l, m)));
-          rmin = min(rmin, imag(delta_hlm()(l, m)));
-          rmax = max(rmax, real(delta_hlm()(l, m)));
-          rmax = max(rmax, imag(delta_hlm()(l, m)));
-          r = max(r, abs(delta_hlm()(l, m)));
+  pos = new_pos;
+  hlm = std::move(new_hlm);
+}
+
+// Store a shape of horizon h for later finds. A shape found at the same
+// time as the newest stored shape replaces it.
+template <typename T>
+void store_shape(const cGH *const cctkGH, const int h, const vec3<T> &pos,
+                 const scalar_alm_t<std::complex<T> > &hlm) {
+  DECLARE_CCTK_ARGUMENTS_AHFinder_find;
+
+  using std::min, std::sqrt;
+  int lsh[3];
+  const int ierr = CCTK_GrouplshGN(cctkGH, 3, lsh, "AHFinder::shape_history");
+  assert(!ierr);
+  assert(lsh[1] == max_history);
+  assert(h >= 0 && h < lsh[2]);
+  const auto info = [&](const int k) { return k + max_history * h; };
+  // The number of coefficients might have been steered
+  const int lmax = min(hlm.geom.lmax, int(sqrt(T(lsh[0]))) - 1);
+  if (ah_shape_lmax[h] != lmax)
+    ah_shape_count[h] = 0;
+  ah_shape_lmax[h] = lmax;
+
+  const bool replace =
+      ah_shape_count[h] > 0 && ah_shape_time[info(0)] == cctk_time;
+  if (!replace) {
+    for (int k = min(int(ah_shape_count[h]), max_history - 1); k > 0; --k) {
+      for (int n = 0; n < lsh[0]; ++n) {
+        const int dst = n + lsh[0] * info(k);
+        const int src = n + lsh[0] * info(k - 1);
+        ah_shape_re[dst] = ah_shape_re[src];
+        ah_shape_im[dst] = ah_shape_im[src];
+      }
+      ah_shape_time[info(k)] = ah_shape_time[info(k - 1)];
+      ah_shape_pos_x[info(k)] = ah_shape_pos_x[info(k - 1)];
+      ah_shape_pos_y[info(k)] = ah_shape_pos_y[info(k - 1)];
+      ah_shape_pos_z[info(k)] = ah_shape_pos_z[info(k - 1)];
+    }
+    ah_shape_count[h] = min(int(ah_shape_count[h]) + 1, max_history);
+  }
+
+  for (int l = 0; l <= lmax; ++l) {
+    for (int m = -l; m <= l; ++m) {
+      const int ind = l * (l + 1) + m + lsh[0] * info(0);
+      ah_shape_re[ind] = real(hlm()(l, m));
+      ah_shape_im[ind] = imag(hlm()(l, m));
+    }
+  }
+  ah_shape_time[info(0)] = cctk_time;
+  ah_shape_pos_x[info(0)] = pos(0);
+  ah_shape_pos_y[info(0)] = pos(1);
+  ah_shape_pos_z[info(0)] = pos(2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The Brill-Lindquist metric together with the derivatives that
+// displace_metric needs. The second derivatives of the metric are
+// obtained by centred differencing of its first derivatives; the
+// extrinsic curvature vanishes.
+template <typename T>
+metric_t<T> brill_lindquist_metric_derivs(const cGH *const cctkGH,
+                                          const coords_t<T> &coords) {
+  const geom_t &geom = coords.geom;
+  metric_t<T> metric = brill_lindquist_metric(cctkGH, coords);
+  metric.ddg.resize(geom.npoints);
+  metric.dK.assign(geom.npoints, zero<smat3<vec3<T> > >()());
+
+  const T h = 1.0e-4;
+  for (int d = 0; d < 3; ++d) {
+    coords_t<T> coordsm(geom), coordsp(geom);
+    for (int i = 0; i < geom.ntheta; ++i) {
+      for (int j = 0; j < geom.nphi; ++j) {
+        for (int c = 0; c < 3; ++c) {
+          const T dx = c == d ? h : 0;
+          coordsm.x(c)()(i, j) = coords.x(c)()(i, j) - dx;
+          coordsp.x(c)()(i, j) = coords.x(c)()(i, j) + dx;
         }
-        CCTK_VINFO("    |Δh%dm|=%g   %g   %g", l, r, rmin, rmax);
       }
     }
+    const auto metricm = brill_lindquist_metric(cctkGH, coordsm);
+    const auto metricp = brill_lindquist_metric(cctkGH, coordsp);
+    for (int i = 0; i < geom.ntheta; ++i) {
+      for (int j = 0; j < geom.nphi; ++j) {
+        const int n = geom.gind(i, j);
+        for (int a = 0; a < 3; ++a)
+          for (int b = a; b < 3; ++b)
+            for (int c = 0; c < 3; ++c)
+              metric.ddg[n](a, b)(c, d) = (metricp.dg(a, b)(c)()(i, j) -
+                                           metricm.dg(a, b)(c)()(i, j)) /
+                                          (2 * h);
+      }
+    }
+  }
 
-    hlm = hlm + delta_hlm;
-    if (maxabs(Thetaij()) <= max_expansion)
-      break;
+  return metric;
+}
+
+// Initial location and radius of horizon h. The scalar parameters
+// initial_pos_x etc. of a single horizon override horizon 0 when they
+// are set in the parameter file.
+struct initial_horizon_t {
+  vec3<CCTK_REAL> pos;
+  CCTK_REAL radius;
+};
+initial_horizon_t initial_horizon(const int h) {
+  DECLARE_CCTK_PARAMETERS;
+  const auto param = [&](const char *const name, const CCTK_REAL scalar,
+                         const CCTK_REAL *const array) {
+    if (h == 0 && CCTK_ParameterQueryTimesSet(name, CCTK_THORNSTRING) > 0)
+      return scalar;
+    return array[h];
+  };
+  return {{param("initial_pos_x", initial_pos_x, initial_horizon_pos_x),
+           param("initial_pos_y", initial_pos_y, initial_horizon_pos_y),
+           param("initial_pos_z", initial_pos_z, initial_horizon_pos_z)},
+          param("initial_radius", initial_radius, initial_horizon_radius)};
+}
+
+// Check that Newton steps converge quadratically for the
+// Brill-Lindquist metric. The Jacobian is applied with the analytic
+// metric, and with the metric moved by displace_metric as for
+// interpolated metrics. Starting from the horizon perturbed by eps, the
+// error after one step must scale as eps^2. The linear systems are
+// solved accurately, so that the Krylov tolerance does not limit the
+// convergence.
+template <typename T> void test_newton(const cGH *const cctkGH) {
+  DECLARE_CCTK_PARAMETERS;
+  using std::log2;
+
+  const geom_t geom(npoints);
+  for (const bool use_displace : {false, true}) {
+    const char *const jacobian_name =
+        use_displace ? "displaced metric" : "analytic metric";
+
+    // Take one Newton step from the surface `hlm`
+    const auto newton = [&](const vec3<T> &pos,
+                            const scalar_alm_t<std::complex<T> > &hlm) {
+      const auto hij = evaluate(hlm);
+      const auto coords = coords_from_shape(pos, hij);
+      const auto metric = use_displace
+                              ? brill_lindquist_metric_derivs(cctkGH, coords)
+                              : brill_lindquist_metric(cctkGH, coords);
+      const auto Theta = expansion(metric, pos, hlm);
+      const auto metric_at = [&](const coords_t<T> &coords1) {
+        return use_displace ? displace_metric(metric, coords, coords1)
+                            : brill_lindquist_metric(cctkGH, coords1);
+      };
+      return hlm + newton_step(pos, hlm, metric_at, Theta, 100, T(1.0e-12),
+                               false);
+    };
+
+    // Find the horizon
+    const auto initial = initial_horizon(0);
+    vec3<T> pos{initial.pos(0), initial.pos(1), initial.pos(2)};
+    scalar_alm_t<std::complex<T> > hlm =
+        scalar_from_const(geom, std::complex<T>(initial.radius));
+    for (int iter = 0; iter < 20; ++iter) {
+      update_position(pos, hlm);
+      hlm = newton(pos, hlm);
+    }
+    update_position(pos, hlm);
+    const scalar_alm_t<std::complex<T> > hstar = hlm;
+    {
+      const auto coords = coords_from_shape(pos, evaluate(hstar));
+      const auto metric = brill_lindquist_metric(cctkGH, coords);
+      const T Theta_maxabs =
+          maxabs(evaluate(expansion(metric, pos, hstar).Thetalm)());
+      if (!(Theta_maxabs <= max_expansion))
+        CCTK_VERROR("Newton (%s): horizon not found, |Θ|=%g", jacobian_name,
+                    double(Theta_maxabs));
+    }
+
+    // Perturb it with a smooth shape that keeps its centre
+    scalar_alm_t<std::complex<T> > dhlm(geom);
+    dhlm()(2, 0) = 1;
+    dhlm()(3, 0) = 0.5;
+    std::array<T, 2> errors;
+    for (int n = 0; n < 2; ++n) {
+      const std::complex<T> eps = T(0.01) / (1 << n);
+      const auto hlm1 = newton(pos, hstar + eps * dhlm);
+      errors[n] = maxabs(hlm1 - hstar);
+    }
+    const T order = log2(errors[0] / errors[1]);
+    CCTK_VINFO("Newton (%s): errors %g, %g after one step, order %g",
+               jacobian_name, double(errors[0]), double(errors[1]),
+               double(order));
+    if (!(order >= 1.5))
+      CCTK_VERROR("Newton (%s) does not converge quadratically",
+                  jacobian_name);
   }
 }
 
+extern "C" void AHFinder_test_newton(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_AHFinder_test_newton;
+
+  CCTK_VINFO("Testing Newton convergence...");
+  test_newton<CCTK_REAL>(cctkGH);
+  CCTK_VINFO("Done.");
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 extern "C" void AHFinder_init(CCTK_ARGUMENTS) {
   DECLARE_CCTK_ARGUMENTS_AHFinder_init;
   DECLARE_CCTK_PARAMETERS;
 
-  *ah_pos_x = initial_pos_x;
-  *ah_pos_y = initial_pos_y;
-  *ah_pos_z = initial_pos_z;
+  for (int h = 0; h < num_horizons; ++h) {
+    const auto initial = initial_horizon(h);
+    ah_pos_x[h] = initial.pos(0);
+    ah_pos_y[h] = initial.pos(1);
+    ah_pos_z[h] = initial.pos(2);
+
+    ah_radius[h] = initial.radius;
+    ah_found[h] = false;
+
+    ah_shape_count[h] = 0;
+    ah_shape_lmax[h] = -1;
+  }
+}
+
+extern "C" void AHFinder_select(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_AHFinder_select;
+  DECLARE_CCTK_PARAMETERS;
 
-  *ah_radius = initial_radius;
+  // The evolution thorn may skip the ADM variables in other iterations
+  // (see Z4c::calc_ADM_vars_every)
+  *find_needed = cctk_iteration % find_every == 0;
 }
 
 extern "C" void AHFinder_find(CCTK_ARGUMENTS) {
   DECLARE_CCTK_ARGUMENTS_AHFinder_find;
   DECLARE_CCTK_PARAMETERS;
 
-  vec3<CCTK_REAL> pos{*ah_pos_x, *ah_pos_y, *ah_pos_z};
-  CCTK_REAL radius{*ah_radius};
-
   const geom_t geom(npoints);
-  scalar_alm_t<CCTK_COMPLEX> hlm =
-      scalar_from_const(geom, CCTK_COMPLEX(radius));
-  solve(cctkGH, pos, radius, hlm);
-
-  *ah_pos_x = pos(0);
-  *ah_pos_y = pos(1);
-  *ah_pos_z = pos(2);
-  *ah_radius = radius;
+
+  std::vector<horizon_t<CCTK_REAL> > horizons;
+  horizons.reserve(num_horizons);
+  for (int h = 0; h < num_horizons; ++h) {
+    vec3<CCTK_REAL> pos{ah_pos_x[h], ah_pos_y[h], ah_pos_z[h]};
+    scalar_alm_t<CCTK_COMPLEX> hlm =
+        scalar_from_const(geom, CCTK_COMPLEX(ah_radius[h]));
+    extrapolate_shape(cctkGH, h, pos, hlm);
+    horizons.emplace_back(h, pos, ah_radius[h], hlm);
+  }
+
+  solve(cctkGH, horizons);
+
+  for (const auto &horizon : horizons) {
+    const int h = horizon.n;
+    // Keep the most recently found surface as starting point if the
+    // horizon was not found; the last iterate is not a horizon. The
+    // horizon is then marked as not found, since the surface may be
+    // outdated.
+    if (!horizon.converged) {
+      CCTK_VINFO("Horizon %d was not found", h);
+      ah_found[h] = false;
+      continue;
+    }
+    store_shape(cctkGH, h, horizon.pos, horizon.hlm);
+
+    ah_pos_x[h] = horizon.pos(0);
+    ah_pos_y[h] = horizon.pos(1);
+    ah_pos_z[h] = horizon.pos(2);
+    ah_radius[h] = horizon.radius;
+    ah_found[h] = true;
+  }
 }
 
 } // namespace AHFinder
@@ -0,0 +1,123 @@
+#include "scratch.hxx"
+
+#include <cctk.h>
+#include <cctk_Arguments.h>
+
+#ifdef __CUDACC__
+#include <cuda_runtime.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+namespace SpacetimeUtils {
+using namespace std;
+
+namespace {
+
+// A free block is only reused if it is at most this many times larger
+// than requested, so that small requests do not tie up large blocks
+constexpr size_t max_overallocation = 2;
+
+// Free blocks, indexed by their capacity
+mutex scratch_mutex;
+multimap<size_t, CCTK_REAL *> scratch_free;
+
+// Memory held by the pool (free or in use), memory in use, and the
+// high-water mark of memory in use
+size_t scratch_bytes_held = 0;
+size_t scratch_bytes_in_use = 0;
+size_t scratch_bytes_peak = 0;
+
+// Statistics
+size_t scratch_bytes_reused = 0;
+size_t scratch_bytes_allocated = 0;
+size_t scratch_bytes_released = 0;
+size_t scratch_num_reused = 0;
+size_t scratch_num_allocated = 0;
+
+CCTK_REAL *allocate(const size_t size) {
+#ifdef __CUDACC__
+  // Temporaries are accessed by device kernels
+  void *ptr;
+  const cudaError_t err = cudaMallocManaged(&ptr, size * sizeof(CCTK_REAL));
+  if (err != cudaSuccess)
+    CCTK_VERROR("Could not allocate %zu bytes of scratch memory: %s",
+                size * sizeof(CCTK_REAL), cudaGetErrorString(err));
+  return static_cast<CCTK_REAL *>(ptr);
+#else
+  return new CCTK_REAL[size];
+#endif
+}
+
+void deallocate(CCTK_REAL *const ptr) {
+#ifdef __CUDACC__
+  cudaFree(ptr);
+#else
+  delete[] ptr;
+#endif
+}
+
+} // namespace
+
+scratch_t::scratch_t(const size_t size) {
+  const lock_guard<mutex> guard(scratch_mutex);
+
+  // Reuse the smallest free block that is large enough, unless it is
+  // much too large
+  const auto it = scratch_free.lower_bound(size);
+  if (it != scratch_free.end() && it->first <= max_overallocation * size) {
+    capacity = it->first;
+    ptr = it->second;
+    scratch_free.erase(it);
+    scratch_bytes_in_use += capacity * sizeof(CCTK_REAL);
+    scratch_bytes_peak = max(scratch_bytes_peak, scratch_bytes_in_use);
+    scratch_bytes_reused += capacity * sizeof(CCTK_REAL);
+    ++scratch_num_reused;
+    return;
+  }
+
+  capacity = size;
+  scratch_bytes_in_use += capacity * sizeof(CCTK_REAL);
+  scratch_bytes_peak = max(scratch_bytes_peak, scratch_bytes_in_use);
+
+  // Release free blocks, smallest first, only as far as needed to keep
+  // the pool within the high-water mark of memory in use
+  while (!scratch_free.empty() &&
+         scratch_bytes_held + capacity * sizeof(CCTK_REAL) >
+             scratch_bytes_peak) {
+    const auto it = scratch_free.begin();
+    scratch_bytes_held -= it->first * sizeof(CCTK_REAL);
+    scratch_bytes_released += it->first * sizeof(CCTK_REAL);
+    deallocate(it->second);
+    scratch_free.erase(it);
+  }
+
+  ptr = allocate(capacity);
+  scratch_bytes_held += capacity * sizeof(CCTK_REAL);
+  scratch_bytes_allocated += capacity * sizeof(CCTK_REAL);
+  ++scratch_num_allocated;
+}
+
+scratch_t::~scratch_t() {
+  const lock_guard<mutex> guard(scratch_mutex);
+  scratch_bytes_in_use -= capacity * sizeof(CCTK_REAL);
+  scratch_free.emplace(capacity, ptr);
+}
+
+extern "C" void SpacetimeUtils_ScratchStatistics(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SpacetimeUtils_ScratchStatistics;
+
+  const lock_guard<mutex> guard(scratch_mutex);
+  CCTK_VINFO("Scratch memory: %zu blocks (%g GByte) reused, %zu blocks (%g "
+             "GByte) newly allocated, %g GByte released, %g GByte resident "
+             "(high-water mark %g GByte)",
+             scratch_num_reused, scratch_bytes_reused / 1.0e+9,
+             scratch_num_allocated, scratch_bytes_allocated / 1.0e+9,
+             scratch_bytes_released / 1.0e+9, scratch_bytes_held / 1.0e+9,
+             scratch_bytes_peak / 1.0e+9);
+}
+
+} // namespace SpacetimeUtils
@@ -0,0 +1,36 @@
+#ifndef SCRATCH_HXX
+#define SCRATCH_HXX
+
+#include <cctk.h>
+
+#include <cstddef>
+
+namespace SpacetimeUtils {
+
+// A block of scratch memory for temporaries. Blocks come from a
+// process-wide pool that grows to the high-water mark and then stays
+// resident, so that the many small boxes of a refinement level do not
+// each allocate and free their temporaries. The block is returned to
+// the pool when it is destroyed. Blocks may be destroyed by a different
+// thread than the one that created them.
+class scratch_t {
+  CCTK_REAL *ptr;
+  std::size_t capacity;
+
+public:
+  scratch_t() = delete;
+  scratch_t(const scratch_t &) = delete;
+  scratch_t(scratch_t &&) = delete;
+  scratch_t &operator=(const scratch_t &) = delete;
+  scratch_t &operator=(scratch_t &&) = delete;
+
+  // Obtain a block holding at least `size` elements
+  explicit scratch_t(std::size_t size);
+  ~scratch_t();
+
+  CCTK_REAL *data() const { return ptr; }
+};
+
+} // namespace SpacetimeUtils
+
+#endif // #ifndef SCRATCH_HXX
@@ -0,0 +1,116 @@
+#include "timers.hxx"
+
+#include <cctk.h>
+#include <cctk_Arguments.h>
+#include <cctk_Parameters.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace SpacetimeUtils {
+using namespace std;
+
+namespace {
+
+struct kernel_stats_t {
+  double flop_per_point = 0, bytes_per_point = 0;
+  double time = 0;
+  double npoints = 0;
+  ptrdiff_t ncalls = 0;
+
+  void add(const kernel_stats_t &stats) {
+    time += stats.time;
+    npoints += stats.npoints;
+    ncalls += stats.ncalls;
+  }
+};
+
+// Statistics since the last output, and since the beginning
+mutex kernel_stats_mutex;
+map<string, kernel_stats_t> kernel_stats_interval, kernel_stats_total;
+int kernel_stats_interval_start = 0;
+
+void output_kernel_stats(const map<string, kernel_stats_t> &kernel_stats,
+                         const int niterations) {
+  CCTK_VINFO("  %-24s %8s %10s %10s %9s %9s %9s %9s", "kernel", "calls",
+             "Gpoints", "time[s]", "Gpoint/s", "GFlop/s", "GByte/s",
+             "Flop/B");
+  for (const auto &name_stats : kernel_stats) {
+    const string &name = name_stats.first;
+    const kernel_stats_t &stats = name_stats.second;
+    const double flops = stats.flop_per_point * stats.npoints;
+    const double bytes = stats.bytes_per_point * stats.npoints;
+    const double per_iteration = niterations > 0 ? 1.0 / niterations : 1.0;
+    // Unknown counts are shown as "-"
+    const auto rate = [&](const double count, const bool known) {
+      char buf[16];
+      if (known)
+        snprintf(buf, sizeof buf, "%9.4g", count);
+      else
+        snprintf(buf, sizeof buf, "%9s", "-");
+      return string(buf);
+    };
+    CCTK_VINFO("  %-24s %8td %10.4g %10.4g %9.4g %s %s %s", name.c_str(),
+               stats.ncalls, stats.npoints / 1.0e+9,
+               stats.time * per_iteration, stats.npoints / stats.time / 1.0e+9,
+               rate(flops / stats.time / 1.0e+9, flops > 0).c_str(),
+               rate(bytes / stats.time / 1.0e+9, bytes > 0).c_str(),
+               rate(flops / bytes, flops > 0 && bytes > 0).c_str());
+  }
+}
+
+} // namespace
+
+kernel_timer_t::~kernel_timer_t() {
+  const auto finish = chrono::steady_clock::now();
+  kernel_stats_t stats;
+  stats.flop_per_point = kernel.flop_per_point;
+  stats.bytes_per_point = kernel.bytes_per_point;
+  stats.time = chrono::duration<double>(finish - start).count();
+  stats.npoints = npoints;
+  stats.ncalls = 1;
+
+  const lock_guard<mutex> guard(kernel_stats_mutex);
+  for (auto *const kernel_stats :
+       {&kernel_stats_interval, &kernel_stats_total}) {
+    kernel_stats_t &old_stats = (*kernel_stats)[kernel.name];
+    old_stats.flop_per_point = stats.flop_per_point;
+    old_stats.bytes_per_point = stats.bytes_per_point;
+    old_stats.add(stats);
+  }
+}
+
+extern "C" void SpacetimeUtils_OutputKernelTimers(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SpacetimeUtils_OutputKernelTimers;
+  DECLARE_CCTK_PARAMETERS;
+
+  if (!(kernel_timers_every > 0 && cctk_iteration % kernel_timers_every == 0))
+    return;
+
+  const lock_guard<mutex> guard(kernel_stats_mutex);
+  const int niterations = cctk_iteration - kernel_stats_interval_start;
+  CCTK_VINFO("Kernel timers for iterations %d to %d (time per iteration, "
+             "rates per thread):",
+             kernel_stats_interval_start, cctk_iteration);
+  output_kernel_stats(kernel_stats_interval, niterations);
+  kernel_stats_interval.clear();
+  kernel_stats_interval_start = cctk_iteration;
+}
+
+extern "C" void SpacetimeUtils_KernelTimersSummary(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SpacetimeUtils_KernelTimersSummary;
+
+  // Kernels with a low ratio Flop/B are bound by memory bandwidth,
+  // the others by floating-point throughput. Kernels without an
+  // operation count show no ratio.
+  const lock_guard<mutex> guard(kernel_stats_mutex);
+  CCTK_VINFO("Kernel timers for the whole run (total time, rates per "
+             "thread):");
+  output_kernel_stats(kernel_stats_total, 0);
+}
+
+} // namespace SpacetimeUtils
@@ -0,0 +1,44 @@
+#ifndef TIMERS_HXX
+#define TIMERS_HXX
+
+#include <chrono>
+#include <cstddef>
+
+namespace SpacetimeUtils {
+
+// Description of a kernel for the timing statistics. The operation and
+// memory traffic counts per grid point are estimates; zero means
+// unknown. Kernels without an operation count are reported without
+// floating-point rates, i.e. they are not placed on the roofline.
+struct kernel_t {
+  const char *name;
+  double flop_per_point;
+  double bytes_per_point;
+};
+
+// Time a kernel while this object exists, and add the run time and the
+// number of grid points processed to the statistics of this process.
+// Timers may run concurrently in several threads; the statistics then
+// count thread-seconds. On GPUs only the time to launch the kernels is
+// measured.
+class kernel_timer_t {
+  const kernel_t &kernel;
+  std::ptrdiff_t npoints;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  kernel_timer_t() = delete;
+  kernel_timer_t(const kernel_timer_t &) = delete;
+  kernel_timer_t(kernel_timer_t &&) = delete;
+  kernel_timer_t &operator=(const kernel_timer_t &) = delete;
+  kernel_timer_t &operator=(kernel_timer_t &&) = delete;
+
+  kernel_timer_t(const kernel_t &kernel, std::ptrdiff_t npoints)
+      : kernel(kernel), npoints(npoints),
+        start(std::chrono::steady_clock::now()) {}
+  ~kernel_timer_t();
+};
+
+} // namespace SpacetimeUtils
+
+#endif // #ifndef TIMERS_HXX
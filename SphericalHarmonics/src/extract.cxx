@@ -1,83 +1,91 @@
+#include "strain.hxx"
+
 #include <cctk.h>
 #include <cctk_Arguments.h>
 #include <cctk_Parameters.h>
 
 #include <hdf5.h>
+#include <mpi.h>
 
 #include <ssht/ssht.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
 #include <complex>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <ios>
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace SphericalHarmonics {
 
-extern "C" void SphericalHarmonics_extract(CCTK_ARGUMENTS) {
-  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_extract;
-  DECLARE_CCTK_PARAMETERS;
-
-  if (!(out_every > 0 && cctk_iteration % out_every == 0))
-    return;
-
-  const int psi4re_ind = CCTK_VarIndex("Weyl::Psi4re");
-  assert(psi4re_ind >= 0);
-  const int psi4im_ind = CCTK_VarIndex("Weyl::Psi4im");
-  assert(psi4im_ind >= 0);
+namespace {
 
-  const int nvars = 2;
-  const std::array<CCTK_INT, nvars> varinds{psi4re_ind, psi4im_ind};
+const int spin = -2; // choice (depends on grid function)
 
-  const std::array<CCTK_INT, nvars> operations{0, 0}; // no derivatives
+// Index of the coefficient for mode (l,m)
+int mode_index(const int l, const int m) {
+  assert(l >= 0);
+  assert(m >= -l && m <= l);
+  int ind;
+  ssht_sampling_elm2ind(&ind, l, m);
+  return ind;
+}
 
-  // Coefficients
-  const int lmax = 1000; // choice
-  const int nmodes = lmax + 1;
-  const int ncoeffs = nmodes * nmodes;
+// MW sampling of the sphere for band limit lmax. This also holds the
+// unit vectors pointing to the sample points, so that they need to be
+// calculated only once.
+struct sampling_t {
+  int lmax;
+  int nmodes, ncoeffs;
+  int ntheta, nphi, npoints;
+  std::vector<double> nx, ny, nz;
 
-  // Grid
-  const int ntheta = nmodes;
-  const int nphi = 2 * nmodes - 1;
-  const int npoints = ntheta * nphi;
+  explicit sampling_t(const int lmax)
+      : lmax(lmax), nmodes(lmax + 1), ncoeffs(nmodes * nmodes),
+        ntheta(nmodes), nphi(2 * nmodes - 1), npoints(ntheta * nphi),
+        nx(npoints), ny(npoints), nz(npoints) {
+    for (int i = 0; i < ntheta; ++i) {
+      const double sin_theta = sin(theta(i));
+      const double cos_theta = cos(theta(i));
+      for (int j = 0; j < nphi; ++j) {
+        const int gi = gind(i, j);
+        nx.at(gi) = sin_theta * cos(phi(j));
+        ny.at(gi) = sin_theta * sin(phi(j));
+        nz.at(gi) = cos_theta;
+      }
+    }
+  }
+  sampling_t(const sampling_t &) = delete;
+  sampling_t &operator=(const sampling_t &) = delete;
 
-  const auto coord_theta = [&](const int i, const int j) {
+  double theta(const int i) const {
     assert(i >= 0 && i < ntheta);
-    assert(j >= 0 && j < nphi);
     const double theta = ssht_sampling_mw_t2theta(i, nmodes);
     assert(theta >= 0 && theta <= M_PI);
     return theta;
-  };
+  }
 
-  const auto coord_phi = [&](const int i, const int j) {
-    assert(i >= 0 && i < ntheta);
+  double phi(const int j) const {
     assert(j >= 0 && j < nphi);
     const double phi = ssht_sampling_mw_p2phi(j, nmodes);
     assert(phi >= 0 && phi < 2 * M_PI);
     return phi;
-  };
-
-  const auto coord_dtheta = [&](const int i, const int j) {
-    assert(i >= 0 && i < ntheta);
-    assert(j >= 0 && j < nphi);
-    const double theta_m =
-        i == 0 ? 0.0 : (coord_theta(i - 1, j) + coord_theta(i, j)) / 2;
-    const double theta_p =
-        i == ntheta - 1 ? M_PI
-                        : (coord_theta(i, j) + coord_theta(i + 1, j)) / 2;
-    return theta_p - theta_m;
-  };
-
-  const auto coord_dphi = [&](const int i, const int j) {
-    return 2 * M_PI / nphi;
-  };
+  }
 
-  const auto gind = [&](const int i, const int j) {
+  int gind(const int i, const int j) const {
     // 0 <= i < ntheta
     // 0 <= j < nphi
     assert(i >= 0 && i < ntheta);
@@ -85,131 +93,1057 @@ extern "C" void SphericalHarmonics_extract(CCTK_ARGUMENTS) {
     const int ind = j + nphi * i;
     assert(ind >= 0 && ind < npoints);
     return ind;
-  };
+  }
 
-  const auto cind = [&](const int l, const int m) {
+  int cind(const int l, const int m) const {
     // 0 <= l <= lmax
     // -l <= m <= l
     assert(l >= 0 && l <= lmax);
-    assert(m >= -l && m <= l);
-    int ind;
-    ssht_sampling_elm2ind(&ind, l, m);
+    const int ind = mode_index(l, m);
     assert(ind >= 0 && ind < ncoeffs);
     return ind;
+  }
+};
+
+// The sampling for band limit lmax. Samplings are created on first
+// use and kept for all later calls.
+const sampling_t &get_sampling(const int lmax) {
+  static std::map<int, std::unique_ptr<const sampling_t> > samplings;
+  std::unique_ptr<const sampling_t> &sampling = samplings[lmax];
+  if (!sampling)
+    sampling = std::make_unique<const sampling_t>(lmax);
+  return *sampling;
+}
+
+// An extraction sphere
+struct sphere_t {
+  double r;
+  double x0, y0, z0;
+};
+
+// Abort if an HDF5 call fails, otherwise return its result
+template <typename T> T check_hdf5(const T ret, const char *const expr) {
+  if (ret < 0)
+    CCTK_VERROR("HDF5 call failed: %s", expr);
+  return ret;
+}
+#define HDF5(expr) (check_hdf5((expr), #expr))
+
+// Mode output into a single HDF5 file, which is kept open. The modes
+// of all spheres are appended to the extensible dataset "modes" with
+// the dimensions (iteration, radius, l, m + lmax_out). Entries with l <
+// |spin| or l < |m| are zero. The datasets "iteration" and "time" are
+// extended in step, and "radius" and "center" describe the spheres.
+// With the strain, the datasets "strain" and "dstrain" hold h and dh/dt
+// in the same layout as "modes", and "flux" and "radiated" hold dE/dt,
+// dP/dt, dJ/dt and E, P, J with the dimensions (iteration, radius, 7).
+class hdf5_file_t {
+  int nradii, lmax_out;
+  bool with_strain;
+  hid_t file, complex_type, iteration_dset, time_dset, modes_dset;
+  hid_t strain_dset, dstrain_dset, flux_dset, radiated_dset;
+  hsize_t noutputs;
+  int nunflushed;
+
+  // Append one element to the first dimension of a dataset and select
+  // it; returns the file and memory dataspaces
+  std::array<hid_t, 2> append(const hid_t dset) const {
+    const hid_t space0 = HDF5(H5Dget_space(dset));
+    const int rank = HDF5(H5Sget_simple_extent_ndims(space0));
+    assert(rank >= 1 && rank <= 4);
+    std::array<hsize_t, 4> dims{}, start{}, count;
+    HDF5(H5Sget_simple_extent_dims(space0, dims.data(), nullptr));
+    HDF5(H5Sclose(space0));
+    assert(dims[0] == noutputs);
+    start[0] = noutputs;
+    count = dims;
+    count[0] = 1;
+    dims[0] = noutputs + 1;
+    HDF5(H5Dset_extent(dset, dims.data()));
+    const hid_t space = HDF5(H5Dget_space(dset));
+    HDF5(H5Sselect_hyperslab(space, H5S_SELECT_SET, start.data(), nullptr,
+                             count.data(), nullptr));
+    const hid_t memspace = HDF5(H5Screate_simple(rank, count.data(), nullptr));
+    return {space, memspace};
+  }
+
+  // The dimensions of a dataset
+  static std::vector<hsize_t> get_dims(const hid_t dset) {
+    const hid_t space = HDF5(H5Dget_space(dset));
+    const int rank = HDF5(H5Sget_simple_extent_ndims(space));
+    std::vector<hsize_t> dims(rank);
+    HDF5(H5Sget_simple_extent_dims(space, dims.data(), nullptr));
+    HDF5(H5Sclose(space));
+    return dims;
+  }
+
+  // Open an existing file to append to it, and remove the outputs after
+  // iteration `last_iteration`
+  void open_file(const std::string &file_name, const int last_iteration) {
+    file = HDF5(H5Fopen(file_name.c_str(), H5F_ACC_RDWR, H5P_DEFAULT));
+
+    if ((HDF5(H5Lexists(file, "strain", H5P_DEFAULT)) > 0) != with_strain)
+      CCTK_VERROR("Cannot continue the HDF5 output in \"%s\" since "
+                  "SphericalHarmonics::calc_strain changed",
+                  file_name.c_str());
+    iteration_dset = HDF5(H5Dopen(file, "iteration", H5P_DEFAULT));
+    time_dset = HDF5(H5Dopen(file, "time", H5P_DEFAULT));
+    modes_dset = HDF5(H5Dopen(file, "modes", H5P_DEFAULT));
+    if (with_strain) {
+      strain_dset = HDF5(H5Dopen(file, "strain", H5P_DEFAULT));
+      dstrain_dset = HDF5(H5Dopen(file, "dstrain", H5P_DEFAULT));
+      flux_dset = HDF5(H5Dopen(file, "flux", H5P_DEFAULT));
+      radiated_dset = HDF5(H5Dopen(file, "radiated", H5P_DEFAULT));
+    }
+
+    // Keep the outputs up to the checkpoint; the iterations increase
+    const hsize_t nfile = get_dims(iteration_dset).at(0);
+    std::vector<int> iterations(nfile);
+    if (nfile > 0)
+      HDF5(H5Dread(iteration_dset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL,
+                   H5P_DEFAULT, iterations.data()));
+    noutputs = 0;
+    while (noutputs < nfile && iterations.at(noutputs) <= last_iteration)
+      ++noutputs;
+
+    const hsize_t nl = lmax_out + 1, nm = 2 * lmax_out + 1;
+    if (get_dims(modes_dset) !=
+        std::vector<hsize_t>{nfile, hsize_t(nradii), nl, nm})
+      CCTK_VERROR("Cannot continue the HDF5 output in \"%s\" since "
+                  "SphericalHarmonics::nradii or "
+                  "SphericalHarmonics::lmax_out changed",
+                  file_name.c_str());
+
+    const auto shrink = [&](const hid_t dset) {
+      std::vector<hsize_t> dims = get_dims(dset);
+      if (dims.at(0) != nfile)
+        CCTK_VERROR("Cannot continue the HDF5 output in \"%s\" since its "
+                    "datasets have different lengths",
+                    file_name.c_str());
+      dims.at(0) = noutputs;
+      HDF5(H5Dset_extent(dset, dims.data()));
+    };
+    shrink(iteration_dset);
+    shrink(time_dset);
+    shrink(modes_dset);
+    if (with_strain) {
+      shrink(strain_dset);
+      shrink(dstrain_dset);
+      shrink(flux_dset);
+      shrink(radiated_dset);
+    }
+  }
+
+  // Create a new file, overwriting an existing one
+  void create_file(const std::string &file_name,
+                   const std::vector<sphere_t> &spheres) {
+    file = HDF5(H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                          H5P_DEFAULT));
+
+    const auto create = [&](const char *const name, const hid_t type,
+                            const std::vector<hsize_t> &dims,
+                            const std::vector<hsize_t> &chunk_dims) {
+      std::vector<hsize_t> maxdims = dims;
+      if (!chunk_dims.empty())
+        maxdims.at(0) = H5S_UNLIMITED;
+      const hid_t space =
+          HDF5(H5Screate_simple(dims.size(), dims.data(), maxdims.data()));
+      const hid_t proplist = HDF5(H5Pcreate(H5P_DATASET_CREATE));
+      if (!chunk_dims.empty())
+        HDF5(H5Pset_chunk(proplist, chunk_dims.size(), chunk_dims.data()));
+      const hid_t dset = HDF5(H5Dcreate(file, name, type, space, H5P_DEFAULT,
+                                        proplist, H5P_DEFAULT));
+      HDF5(H5Pclose(proplist));
+      HDF5(H5Sclose(space));
+      return dset;
+    };
+
+    // Choose chunks of about 1 MByte
+    const hsize_t nl = lmax_out + 1, nm = 2 * lmax_out + 1;
+    const hsize_t iteration_size =
+        nradii * nl * nm * sizeof(std::complex<double>);
+    const hsize_t chunk_size =
+        std::max(hsize_t(1), hsize_t(1024 * 1024) / iteration_size);
+    iteration_dset = create("iteration", H5T_NATIVE_INT, {0}, {1024});
+    time_dset = create("time", H5T_NATIVE_DOUBLE, {0}, {1024});
+    modes_dset = create("modes", complex_type, {0, hsize_t(nradii), nl, nm},
+                        {chunk_size, hsize_t(nradii), nl, nm});
+    if (with_strain) {
+      strain_dset =
+          create("strain", complex_type, {0, hsize_t(nradii), nl, nm},
+                 {chunk_size, hsize_t(nradii), nl, nm});
+      dstrain_dset =
+          create("dstrain", complex_type, {0, hsize_t(nradii), nl, nm},
+                 {chunk_size, hsize_t(nradii), nl, nm});
+      flux_dset = create("flux", H5T_NATIVE_DOUBLE, {0, hsize_t(nradii), 7},
+                         {1024, hsize_t(nradii), 7});
+      radiated_dset =
+          create("radiated", H5T_NATIVE_DOUBLE, {0, hsize_t(nradii), 7},
+                 {1024, hsize_t(nradii), 7});
+    }
+
+    const hid_t attr_space = HDF5(H5Screate(H5S_SCALAR));
+    const hid_t attr = HDF5(H5Acreate(modes_dset, "spin", H5T_NATIVE_INT,
+                                      attr_space, H5P_DEFAULT, H5P_DEFAULT));
+    HDF5(H5Awrite(attr, H5T_NATIVE_INT, &spin));
+    HDF5(H5Aclose(attr));
+    HDF5(H5Sclose(attr_space));
+
+    std::vector<double> radii(nradii), centers(3 * nradii);
+    for (int s = 0; s < nradii; ++s) {
+      radii.at(s) = spheres.at(s).r;
+      centers.at(3 * s + 0) = spheres.at(s).x0;
+      centers.at(3 * s + 1) = spheres.at(s).y0;
+      centers.at(3 * s + 2) = spheres.at(s).z0;
+    }
+    const hid_t radius_dset =
+        create("radius", H5T_NATIVE_DOUBLE, {hsize_t(nradii)}, {});
+    HDF5(H5Dwrite(radius_dset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                  H5P_DEFAULT, radii.data()));
+    HDF5(H5Dclose(radius_dset));
+    const hid_t center_dset =
+        create("center", H5T_NATIVE_DOUBLE, {hsize_t(nradii), 3}, {});
+    HDF5(H5Dwrite(center_dset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                  H5P_DEFAULT, centers.data()));
+    HDF5(H5Dclose(center_dset));
+  }
+
+public:
+  // Create the file. After recovery (when `recovered_iteration` is not
+  // negative) an existing file is continued instead, dropping the
+  // outputs written after the checkpoint.
+  hdf5_file_t(const std::string &file_name,
+              const std::vector<sphere_t> &spheres, const int lmax_out,
+              const bool with_strain, const int recovered_iteration)
+      : nradii(spheres.size()), lmax_out(lmax_out), with_strain(with_strain),
+        noutputs(0), nunflushed(0) {
+    // Complex numbers, compatible with h5py
+    complex_type = HDF5(H5Tcreate(H5T_COMPOUND, sizeof(std::complex<double>)));
+    HDF5(H5Tinsert(complex_type, "r", 0, H5T_NATIVE_DOUBLE));
+    HDF5(H5Tinsert(complex_type, "i", sizeof(double), H5T_NATIVE_DOUBLE));
+
+    if (recovered_iteration >= 0 && std::ifstream(file_name).good())
+      open_file(file_name, recovered_iteration);
+    else
+      create_file(file_name, spheres);
+  }
+
+  hdf5_file_t(const hdf5_file_t &) = delete;
+  hdf5_file_t &operator=(const hdf5_file_t &) = delete;
+
+  ~hdf5_file_t() {
+    if (with_strain) {
+      HDF5(H5Dclose(radiated_dset));
+      HDF5(H5Dclose(flux_dset));
+      HDF5(H5Dclose(dstrain_dset));
+      HDF5(H5Dclose(strain_dset));
+    }
+    HDF5(H5Dclose(modes_dset));
+    HDF5(H5Dclose(time_dset));
+    HDF5(H5Dclose(iteration_dset));
+    HDF5(H5Tclose(complex_type));
+    HDF5(H5Fclose(file));
+  }
+
+  // Append the modes of all spheres for one iteration. `strains` must
+  // be given if and only if the file was created with the strain.
+  void write(const int iteration, const double time,
+             const std::vector<std::vector<std::complex<double> > > &psi4lms,
+             const std::vector<strain_t> *const strains,
+             const int flush_every) {
+    assert(int(psi4lms.size()) == nradii);
+    assert(bool(strains) == with_strain);
+    const int nl = lmax_out + 1, nm = 2 * lmax_out + 1;
+    const auto make_modes = [&](const auto &get_alm) {
+      std::vector<std::complex<double> > modes(nradii * nl * nm);
+      for (int s = 0; s < nradii; ++s) {
+        const std::vector<std::complex<double> > &alm = get_alm(s);
+        for (int l = std::abs(spin); l <= lmax_out; ++l) {
+          for (int m = -l; m <= l; ++m) {
+            modes.at((s * nl + l) * nm + m + lmax_out) =
+                alm.at(mode_index(l, m));
+          }
+        }
+      }
+      return modes;
+    };
+
+    const auto write_dset = [&](const hid_t dset, const hid_t type,
+                                const void *const buf) {
+      const std::array<hid_t, 2> spaces = append(dset);
+      HDF5(H5Dwrite(dset, type, spaces[1], spaces[0], H5P_DEFAULT, buf));
+      HDF5(H5Sclose(spaces[1]));
+      HDF5(H5Sclose(spaces[0]));
+    };
+    write_dset(iteration_dset, H5T_NATIVE_INT, &iteration);
+    write_dset(time_dset, H5T_NATIVE_DOUBLE, &time);
+    write_dset(modes_dset, complex_type,
+               make_modes([&](int s) -> const auto & { return psi4lms.at(s); })
+                   .data());
+    if (with_strain) {
+      write_dset(strain_dset, complex_type,
+                 make_modes([&](int s) -> const auto & {
+                   return strains->at(s).h();
+                 }).data());
+      write_dset(dstrain_dset, complex_type,
+                 make_modes([&](int s) -> const auto & {
+                   return strains->at(s).dh();
+                 }).data());
+      const auto make_radiation = [&](const auto &get_radiation) {
+        std::vector<double> values;
+        for (int s = 0; s < nradii; ++s) {
+          const radiation_t &radiation = get_radiation(s);
+          values.push_back(radiation.E);
+          for (int d = 0; d < 3; ++d)
+            values.push_back(radiation.P[d]);
+          for (int d = 0; d < 3; ++d)
+            values.push_back(radiation.J[d]);
+        }
+        return values;
+      };
+      write_dset(flux_dset, H5T_NATIVE_DOUBLE,
+                 make_radiation([&](int s) -> const auto & {
+                   return strains->at(s).get_flux();
+                 }).data());
+      write_dset(radiated_dset, H5T_NATIVE_DOUBLE,
+                 make_radiation([&](int s) -> const auto & {
+                   return strains->at(s).get_radiated();
+                 }).data());
+    }
+    ++noutputs;
+
+    ++nunflushed;
+    if (flush_every > 0 && nunflushed >= flush_every)
+      flush();
+  }
+
+  void flush() {
+    HDF5(H5Fflush(file, H5F_SCOPE_LOCAL));
+    nunflushed = 0;
+  }
+};
+
+// The HDF5 output file, kept open until termination
+std::unique_ptr<hdf5_file_t> hdf5_file;
+
+// The iteration from which the simulation was recovered, or -1
+int recovered_iteration = -1;
+
+// Estimate the aliasing error of the output modes: the amplitude of the
+// highest quarter of the band, relative to the amplitude of the output
+// modes. Aliasing maps these highest modes onto lower ones.
+double aliasing_error(const sampling_t &sampling,
+                      const std::vector<std::complex<double> > &psi4lm,
+                      const int lmax_out) {
+  using std::abs;
+  const int lmin_tail = std::max(lmax_out + 1, sampling.lmax * 3 / 4);
+  double norm2_out = 0, norm2_tail = 0;
+  for (int l = abs(spin); l <= sampling.lmax; ++l) {
+    for (int m = -l; m <= l; ++m) {
+      const double a2 = std::norm(psi4lm.at(sampling.cind(l, m)));
+      if (l <= lmax_out)
+        norm2_out += a2;
+      if (l >= lmin_tail)
+        norm2_tail += a2;
+    }
+  }
+  if (norm2_out == 0)
+    return norm2_tail == 0 ? 0 : std::numeric_limits<double>::infinity();
+  return sqrt(norm2_tail / norm2_out);
+}
+
+// Obtain Psi4 on several spheres. The points of all spheres are split
+// evenly over all processes and obtained in a single interpolation
+// call. Each sphere is then collected on one process: on process s %
+// nprocs if `distribute` is set, else on process 0. This must be called
+// by all processes. The samples of each sphere are returned on the
+// process that collected it, and are empty elsewhere.
+std::vector<std::vector<std::complex<double> > >
+sample_psi4(const cGH *restrict const cctkGH, const sampling_t &sampling,
+            const std::vector<sphere_t> &spheres, const bool distribute) {
+  DECLARE_CCTK_PARAMETERS;
+
+  const int myproc = CCTK_MyProc(cctkGH);
+  const int nprocs = CCTK_nProcs(cctkGH);
+
+  const int nspheres = spheres.size();
+  const int npoints = sampling.npoints;
+  const long npoints_total = long(nspheres) * npoints;
+
+  // This process handles the points [point_begin(myproc),
+  // point_begin(myproc+1)) of all spheres
+  const auto point_begin = [&](const int proc) {
+    return int(npoints_total * proc / nprocs);
+  };
+  // The process that collects sphere s
+  const auto sphere_owner = [&](const int s) {
+    return distribute ? s % nprocs : 0;
   };
 
   // Coordinates
-  const int npoints_local = CCTK_MyProc(0) == 0 ? npoints : 0;
+  const int ibegin = point_begin(myproc);
+  const int npoints_local = point_begin(myproc + 1) - ibegin;
   std::vector<CCTK_REAL> coord_x(npoints_local), coord_y(npoints_local),
       coord_z(npoints_local);
-  if (CCTK_MyProc(0) == 0) {
-    for (int i = 0; i < ntheta; ++i) {
-      for (int j = 0; j < nphi; ++j) {
-        const int gi = gind(i, j);
-        const double r = 64.0; // choice
-        const double theta = coord_theta(i, j);
-        const double phi = coord_phi(i, j);
-        const double x0 = 0.0; // choice
-        const double y0 = 0.0; // choice
-        const double z0 = 0.0; // choice
-        const double x = x0 + r * sin(theta) * cos(phi);
-        const double y = y0 + r * sin(theta) * sin(phi);
-        const double z = z0 + r * cos(theta);
-        coord_x.at(gi) = x;
-        coord_y.at(gi) = y;
-        coord_z.at(gi) = z;
-      }
-    }
+  for (int n = 0; n < npoints_local; ++n) {
+    const int gi = ibegin + n;
+    const int s = gi / npoints;
+    const sphere_t &sphere = spheres.at(s);
+    const int ind = gi % npoints;
+    coord_x.at(n) = sphere.x0 + sphere.r * sampling.nx.at(ind);
+    coord_y.at(n) = sphere.y0 + sphere.r * sampling.ny.at(ind);
+    coord_z.at(n) = sphere.z0 + sphere.r * sampling.nz.at(ind);
   }
 
   // Data
   std::vector<CCTK_REAL> psi4re(npoints_local), psi4im(npoints_local);
-  std::array<CCTK_POINTER, nvars> ptrs{psi4re.data(), psi4im.data()};
-
-  Interpolate(cctkGH, npoints_local, coord_x.data(), coord_y.data(),
-              coord_z.data(), nvars, varinds.data(), operations.data(),
-              ptrs.data());
-
-  // Calculate and output modes only on a single process
-  if (CCTK_MyProc(0) == 0) {
-
-    for (int n = 0; n < npoints; ++n) {
-      if (!(isfinite(psi4re.at(n))))
-        CCTK_VWARN(CCTK_WARN_ALERT, "psi4re is not finite: n=%d [x,y,z]=[%.17g,%.17g,%.17g]", n,
-                   coord_x.at(n), coord_y.at(n), coord_z.at(n));
-      // assert(isfinite(psi4re.at(n)));
-      // assert(isfinite(psi4im.at(n)));
-    }
-
-    // Convert values to complex numbers
-    std::vector<std::complex<double> > psi4(npoints);
-    for (int n = 0; n < npoints; ++n)
-      psi4.at(n) = std::complex<double>(psi4re.at(n), psi4im.at(n));
-
-    // Expand into spherical harmonics
-    const int spin = -2; // choice (depends on grid function)
-    const ssht_dl_method_t method = SSHT_DL_RISBO;
-    const int verbosity = 0; // [0..5]
-    std::vector<std::complex<double> > psi4lm(ncoeffs);
-    ssht_core_mw_forward_sov_conv_sym(psi4lm.data(), psi4.data(), nmodes, spin,
-                                      method, verbosity);
-
-    for (int l = abs(spin); l <= lmax; ++l) {
-      for (int m = -l; m <= +l; ++m) {
-        // assert(isfinite(real(psi4lm.at(cind(l, m)))));
-        // assert(isfinite(imag(psi4lm.at(cind(l, m)))));
-      }
+  if (CCTK_EQUALS(psi4_source, "points")) {
+    // Evaluate Psi4 only at the spheres' points
+    CalcPsi4AtPoints(cctkGH, npoints_local, coord_x.data(), coord_y.data(),
+                     coord_z.data(), psi4re.data(), psi4im.data());
+  } else {
+    const int psi4re_ind = CCTK_VarIndex("Weyl::Psi4re");
+    assert(psi4re_ind >= 0);
+    const int psi4im_ind = CCTK_VarIndex("Weyl::Psi4im");
+    assert(psi4im_ind >= 0);
+
+    const int nvars = 2;
+    const std::array<CCTK_INT, nvars> varinds{psi4re_ind, psi4im_ind};
+
+    const std::array<CCTK_INT, nvars> operations{0, 0}; // no derivatives
+
+    std::array<CCTK_POINTER, nvars> ptrs{psi4re.data(), psi4im.data()};
+
+    Interpolate(cctkGH, npoints_local, coord_x.data(), coord_y.data(),
+                coord_z.data(), nvars, varinds.data(), operations.data(),
+                ptrs.data());
+  }
+
+  for (int n = 0; n < npoints_local; ++n) {
+    if (!(isfinite(psi4re.at(n))))
+      CCTK_VWARN(CCTK_WARN_ALERT,
+                 "psi4re is not finite: n=%d [x,y,z]=[%.17g,%.17g,%.17g]",
+                 ibegin + n, coord_x.at(n), coord_y.at(n), coord_z.at(n));
+    // assert(isfinite(psi4re.at(n)));
+    // assert(isfinite(psi4im.at(n)));
+  }
+
+  // Convert values to complex numbers
+  std::vector<std::complex<double> > psi4_local(npoints_local);
+  for (int n = 0; n < npoints_local; ++n)
+    psi4_local.at(n) = std::complex<double>(psi4re.at(n), psi4im.at(n));
+
+  std::vector<std::vector<std::complex<double> > > psi4s(nspheres);
+  for (int s = 0; s < nspheres; ++s) {
+    const int owner = sphere_owner(s);
+    std::vector<int> counts(nprocs), displs(nprocs);
+    for (int p = 0; p < nprocs; ++p) {
+      const int begin = std::max(point_begin(p), s * npoints);
+      const int end = std::min(point_begin(p + 1), (s + 1) * npoints);
+      counts.at(p) = 2 * std::max(0, end - begin);
+      displs.at(p) = 2 * (begin - s * npoints);
     }
+    const int begin_local =
+        std::min(std::max(ibegin, s * npoints) - ibegin, npoints_local);
+    if (myproc == owner)
+      psi4s.at(s).resize(npoints);
+    MPI_Gatherv(psi4_local.data() + begin_local, counts.at(myproc),
+                MPI_DOUBLE, psi4s.at(s).data(), counts.data(), displs.data(),
+                MPI_DOUBLE, owner, MPI_COMM_WORLD);
+  }
+
+  return psi4s;
+}
+
+// Expand Psi4 on one sphere into spin-weighted spherical harmonics.
+// Returns the coefficients up to lmax_out, and increases `error` to the
+// estimated aliasing error if that is larger. This does not call into
+// Cactus and may run on the background thread.
+std::vector<std::complex<double> >
+transform_psi4(const sampling_t &sampling,
+               const std::vector<std::complex<double> > &psi4,
+               const int lmax_out, double &error) {
+  assert(int(psi4.size()) == sampling.npoints);
+  const ssht_dl_method_t method = SSHT_DL_RISBO;
+  const int verbosity = 0; // [0..5]
+  std::vector<std::complex<double> > psi4lm(sampling.ncoeffs);
+  ssht_core_mw_forward_sov_conv_sym(psi4lm.data(), psi4.data(),
+                                    sampling.nmodes, spin, method, verbosity);
+
+  error = std::max(error, aliasing_error(sampling, psi4lm, lmax_out));
+  psi4lm.resize((lmax_out + 1) * (lmax_out + 1));
+  return psi4lm;
+}
+
+// Obtain Psi4 on several spheres and expand it into spin-weighted
+// spherical harmonics. Different spheres are transformed concurrently
+// by different processes. This must be called by all processes. The
+// coefficients up to lmax_out for each sphere are returned on process
+// 0, and the largest estimated aliasing error on all processes.
+std::vector<std::vector<std::complex<double> > >
+expand_psi4(const cGH *restrict const cctkGH, const sampling_t &sampling,
+            const std::vector<sphere_t> &spheres, double &error) {
+  DECLARE_CCTK_PARAMETERS;
+
+  const int myproc = CCTK_MyProc(cctkGH);
+  const int nspheres = spheres.size();
 
-    // Output spherical harmonics
-    const std::string path_name = out_dir; // choice
-    static bool did_create_directory = false;
-    if (!did_create_directory) {
-      const int mode = 0755;
-      const int ierr = CCTK_CreateDirectory(mode, path_name.c_str());
-      assert(ierr >= 0);
-      did_create_directory = true;
-    }
-
-    const std::string sep = "\t";
-    const std::string eol = "\n";
-    const std::string quote = "\"";
-    using std::abs;
-    const int lmin_out = abs(spin);
-    const int lmax_out = 16;                   // choice
-    const std::string file_name = "modes.tsv"; // choice
-    const std::string output_name = path_name + "/" + file_name;
-    static bool did_create_file = false;
-    const std::ios_base::openmode mode =
-        (did_create_file ? std::ios_base::app : std::ios_base::out) |
-        std::ios_base::ate;
-    std::ofstream file(output_name, mode);
-    if (!did_create_file) {
-      file << "iteration" << sep << "time";
+  const std::vector<std::vector<std::complex<double> > > psi4s =
+      sample_psi4(cctkGH, sampling, spheres, true);
+
+  const int ncoeffs_out = (lmax_out + 1) * (lmax_out + 1);
+  std::vector<std::complex<double> > psi4lms_out(nspheres * ncoeffs_out);
+  error = 0;
+  for (int s = 0; s < nspheres; ++s) {
+    if (psi4s.at(s).empty())
+      continue;
+    const std::vector<std::complex<double> > psi4lm =
+        transform_psi4(sampling, psi4s.at(s), lmax_out, error);
+    std::copy(psi4lm.begin(), psi4lm.end(),
+              psi4lms_out.begin() + s * ncoeffs_out);
+  }
+
+  // Combine the results on process 0; each coefficient is non-zero
+  // only on the owner of its sphere
+  MPI_Allreduce(MPI_IN_PLACE, &error, 1, MPI_DOUBLE, MPI_MAX,
+                MPI_COMM_WORLD);
+  MPI_Reduce(myproc == 0 ? MPI_IN_PLACE : psi4lms_out.data(),
+             psi4lms_out.data(), 2 * psi4lms_out.size(), MPI_DOUBLE,
+             MPI_SUM, 0, MPI_COMM_WORLD);
+  if (myproc != 0)
+    return {};
+
+  std::vector<std::vector<std::complex<double> > > psi4lms(nspheres);
+  for (int s = 0; s < nspheres; ++s)
+    psi4lms.at(s).assign(psi4lms_out.begin() + s * ncoeffs_out,
+                         psi4lms_out.begin() + (s + 1) * ncoeffs_out);
+  return psi4lms;
+}
+
+// The parameters that the output reads. They are copied on the main
+// thread, so that the background thread neither reads parameters that
+// may be steered meanwhile nor calls into Cactus.
+struct output_params_t {
+  int lmax_out;
+  std::string path_name;
+  bool out_tsv, out_hdf5;
+  int out_hdf5_flush_every;
+  bool calc_strain;
+  double strain_omega0;
+};
+
+// Copy the output parameters, and create the output directory. This
+// must be called on the main thread.
+output_params_t get_output_params() {
+  DECLARE_CCTK_PARAMETERS;
+
+  output_params_t params;
+  params.lmax_out = lmax_out;
+  params.path_name = out_dir; // choice
+  params.out_tsv = CCTK_EQUALS(out_format, "tsv") ||
+                   CCTK_EQUALS(out_format, "both");
+  params.out_hdf5 = CCTK_EQUALS(out_format, "hdf5") ||
+                    CCTK_EQUALS(out_format, "both");
+  params.out_hdf5_flush_every = out_hdf5_flush_every;
+  params.calc_strain = calc_strain;
+  params.strain_omega0 = strain_omega0;
+
+  static bool did_create_directory = false;
+  if (!did_create_directory) {
+    const int mode = 0755;
+    const int ierr = CCTK_CreateDirectory(mode, params.path_name.c_str());
+    assert(ierr >= 0);
+    did_create_directory = true;
+  }
+
+  return params;
+}
+
+// The modes of one extraction, waiting to be written to the HDF5 file.
+// HDF5 is only called on the main thread: most HDF5 builds are not
+// thread-safe, and CarpetX may call HDF5 while the background thread
+// runs.
+struct hdf5_record_t {
+  int iteration;
+  double time;
+  std::vector<sphere_t> spheres;
+  std::vector<std::vector<std::complex<double> > > psi4lms;
+  // Strain at this iteration; empty without the strain
+  std::vector<strain_t> strains;
+  std::string file_name;
+  int lmax_out;
+  int flush_every;
+};
+
+// Append a record to the HDF5 file, creating the file if necessary.
+// This must be called on the main thread of process 0.
+void write_hdf5(const hdf5_record_t &record) {
+  const bool with_strain = !record.strains.empty();
+  if (!hdf5_file)
+    hdf5_file = std::make_unique<hdf5_file_t>(record.file_name, record.spheres,
+                                              record.lmax_out, with_strain,
+                                              recovered_iteration);
+  hdf5_file->write(record.iteration, record.time, record.psi4lms,
+                   with_strain ? &record.strains : nullptr,
+                   record.flush_every);
+}
+
+// Output the modes of all spheres. This must be called on process 0.
+// This does not call into Cactus or HDF5 and may run on the background
+// thread. With HDF5 output, this returns the record that the caller
+// needs to pass to `write_hdf5` on the main thread.
+std::optional<hdf5_record_t>
+output_modes(const output_params_t &params, const int iteration,
+             const double time, const std::vector<sphere_t> &spheres,
+             const std::vector<std::vector<std::complex<double> > >
+                 &psi4lms) {
+  const int nradii = spheres.size();
+  const int lmax_out = params.lmax_out;
+  const bool calc_strain = params.calc_strain;
+
+  using std::abs;
+  const int lmin_out = abs(spin);
+
+  // Output spherical harmonics
+  const std::string &path_name = params.path_name;
+
+  // Integrate in time
+  static std::vector<strain_t> strains;
+  if (calc_strain) {
+    if (strains.empty())
+      for (int s = 0; s < nradii; ++s)
+        strains.emplace_back(lmax_out, params.strain_omega0);
+    for (int s = 0; s < nradii; ++s)
+      strains.at(s).update(time, psi4lms.at(s), spheres.at(s).r);
+  }
+
+  if (params.out_tsv) {
+    // Append a line for sphere s to a file, starting with a header
+    static std::set<std::string> did_create_file;
+    const auto write_tsv = [&](const std::string &file_name, const int s,
+                               const std::vector<std::string> &columns,
+                               const std::vector<double> &values) {
+      assert(values.size() == columns.size());
+      const std::string sep = "\t";
+      const std::string eol = "\n";
+      const std::string quote = "\"";
+      const std::string output_name = path_name + "/" + file_name;
+      const bool did_create = did_create_file.count(output_name);
+      const std::ios_base::openmode mode =
+          (did_create ? std::ios_base::app : std::ios_base::out) |
+          std::ios_base::ate;
+      std::ofstream file(output_name, mode);
+      file << std::setprecision(std::numeric_limits<double>::digits10 + 1)
+           << std::scientific;
+      if (!did_create) {
+        file << "# radius=" << spheres.at(s).r << " center=["
+             << spheres.at(s).x0 << "," << spheres.at(s).y0 << ","
+             << spheres.at(s).z0 << "]" << eol;
+        file << "iteration" << sep << "time" << sep << "radius";
+        for (const std::string &column : columns)
+          file << sep << quote << column << quote;
+        file << eol;
+        did_create_file.insert(output_name);
+      }
+
+      file << iteration << sep << time << sep << spheres.at(s).r;
+      for (const double value : values)
+        file << sep << value;
+      file << eol;
+
+      file.close();
+    };
+
+    // Real and imaginary parts of all output modes
+    const auto mode_columns = [&](const std::string &prefix) {
+      std::vector<std::string> columns;
       for (int l = lmin_out; l <= lmax_out; ++l) {
-        for (int m = -l; m <= +l; ++m) {
-          file << sep << quote << "real(l=" << l << ",m=" << m << ")" << quote;
-          file << sep << quote << "imag(l=" << l << ",m=" << m << ")" << quote;
+        for (int m = -l; m <= l; ++m) {
+          const std::string lm =
+              "l=" + std::to_string(l) + ",m=" + std::to_string(m);
+          columns.push_back("real(" + prefix + lm + ")");
+          columns.push_back("imag(" + prefix + lm + ")");
         }
       }
-      file << eol;
-      did_create_file = true;
+      return columns;
+    };
+    const auto mode_values =
+        [&](const std::vector<std::complex<double> > &alm) {
+          std::vector<double> values;
+          for (int l = lmin_out; l <= lmax_out; ++l) {
+            for (int m = -l; m <= l; ++m) {
+              values.push_back(real(alm.at(mode_index(l, m))));
+              values.push_back(imag(alm.at(mode_index(l, m))));
+            }
+          }
+          return values;
+        };
+
+    // One file per extraction radius
+    for (int s = 0; s < nradii; ++s) {
+      const std::string suffix = ".r" + std::to_string(s) + ".tsv";
+      write_tsv("modes" + suffix, s, mode_columns(""),
+                mode_values(psi4lms.at(s)));
+
+      if (calc_strain) {
+        const strain_t &strain = strains.at(s);
+        std::vector<std::string> columns = mode_columns("h,");
+        std::vector<double> values = mode_values(strain.h());
+        for (const std::string &column : mode_columns("dh/dt,"))
+          columns.push_back(column);
+        for (const double value : mode_values(strain.dh()))
+          values.push_back(value);
+        write_tsv("strain" + suffix, s, columns, values);
+
+        const radiation_t &flux = strain.get_flux();
+        const radiation_t &radiated = strain.get_radiated();
+        write_tsv("radiation" + suffix, s,
+                  {"dE/dt", "dPx/dt", "dPy/dt", "dPz/dt", "dJx/dt", "dJy/dt",
+                   "dJz/dt", "E", "Px", "Py", "Pz", "Jx", "Jy", "Jz"},
+                  {flux.E, flux.P[0], flux.P[1], flux.P[2], flux.J[0],
+                   flux.J[1], flux.J[2], radiated.E, radiated.P[0],
+                   radiated.P[1], radiated.P[2], radiated.J[0],
+                   radiated.J[1], radiated.J[2]});
+      }
+    }
+  }
+
+  if (!params.out_hdf5)
+    return std::nullopt;
+
+  // One file for all extraction radii
+  return hdf5_record_t{iteration,
+                       time,
+                       spheres,
+                       psi4lms,
+                       calc_strain ? strains : std::vector<strain_t>(),
+                       path_name + "/modes.h5",
+                       lmax_out,
+                       params.out_hdf5_flush_every};
+}
+
+// A snapshot of Psi4 on all spheres, waiting to be transformed
+struct snapshot_t {
+  int iteration;
+  double time;
+  const sampling_t *sampling;
+  std::vector<sphere_t> spheres;
+  std::vector<std::vector<std::complex<double> > > psi4s;
+  // Parameters at the time of the extraction
+  output_params_t output_params;
+  bool auto_lmax;
+  double lmax_tolerance;
+  int lmax_auto_max;
+};
+
+// A background thread that transforms and outputs snapshots, so that
+// the evolution does not wait for this. Snapshots are queued; adding a
+// snapshot blocks while the queue is full. The HDF5 output is handed
+// back and written by the main thread at the next extraction or
+// checkpoint. This lives on process 0.
+class worker_t {
+  const int max_queue_length;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<snapshot_t> queue;
+  bool busy;
+  bool stopping;
+  // Band limit the worker found necessary, and the largest aliasing
+  // error it found at the maximum band limit. The main thread reports
+  // these, since the worker does not call into Cactus.
+  int lmax_wanted;
+  double error_at_max;
+  // Records for the HDF5 file, which the main thread writes
+  std::deque<hdf5_record_t> hdf5_records;
+
+  std::thread thread;
+
+  void process(const snapshot_t &snapshot) {
+    const sampling_t &sampling = *snapshot.sampling;
+    const int nspheres = snapshot.spheres.size();
+    std::vector<std::vector<std::complex<double> > > psi4lms(nspheres);
+    double error = 0;
+    for (int s = 0; s < nspheres; ++s)
+      psi4lms.at(s) = transform_psi4(sampling, snapshot.psi4s.at(s),
+                                     snapshot.output_params.lmax_out, error);
+
+    // In automatic mode, ask for a larger band limit for later
+    // extractions if this one was not accurate enough
+    if (snapshot.auto_lmax && error > snapshot.lmax_tolerance) {
+      const std::lock_guard<std::mutex> lock(mutex);
+      if (sampling.lmax < snapshot.lmax_auto_max)
+        lmax_wanted =
+            std::max(lmax_wanted,
+                     std::min(2 * sampling.lmax, snapshot.lmax_auto_max));
+      else
+        error_at_max = std::max(error_at_max, error);
+    }
+
+    std::optional<hdf5_record_t> hdf5_record =
+        output_modes(snapshot.output_params, snapshot.iteration,
+                     snapshot.time, snapshot.spheres, psi4lms);
+    if (hdf5_record) {
+      const std::lock_guard<std::mutex> lock(mutex);
+      hdf5_records.push_back(std::move(*hdf5_record));
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      cond.wait(lock, [&] { return stopping || !queue.empty(); });
+      if (queue.empty())
+        break;
+      const snapshot_t snapshot = std::move(queue.front());
+      queue.pop_front();
+      busy = true;
+      cond.notify_all();
+      lock.unlock();
+      process(snapshot);
+      lock.lock();
+      busy = false;
+      cond.notify_all();
+    }
+  }
+
+public:
+  explicit worker_t(const int max_queue_length)
+      : max_queue_length(max_queue_length), busy(false), stopping(false),
+        lmax_wanted(0), error_at_max(0), thread([this] { run(); }) {}
+
+  worker_t(const worker_t &) = delete;
+  worker_t &operator=(const worker_t &) = delete;
+
+  // Process all queued snapshots, then stop the thread
+  ~worker_t() {
+    {
+      const std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cond.notify_all();
+    thread.join();
+  }
+
+  void push(snapshot_t snapshot) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&] { return int(queue.size()) < max_queue_length; });
+    queue.push_back(std::move(snapshot));
+    cond.notify_all();
+  }
+
+  // Wait until all queued snapshots have been processed
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&] { return queue.empty() && !busy; });
+  }
+
+  int get_lmax_wanted() {
+    const std::lock_guard<std::mutex> lock(mutex);
+    return lmax_wanted;
+  }
+
+  double get_error_at_max() {
+    const std::lock_guard<std::mutex> lock(mutex);
+    return error_at_max;
+  }
+
+  // Write the records for the HDF5 file that are ready. This must be
+  // called on the main thread.
+  void write_hdf5_records() {
+    std::deque<hdf5_record_t> records;
+    {
+      const std::lock_guard<std::mutex> lock(mutex);
+      records.swap(hdf5_records);
     }
+    for (const hdf5_record_t &record : records)
+      write_hdf5(record);
+  }
+};
+
+// The background worker, created on first use
+std::unique_ptr<worker_t> worker;
+
+} // namespace
+
+extern "C" void SphericalHarmonics_paramcheck(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_paramcheck;
+  DECLARE_CCTK_PARAMETERS;
+
+  // Weyl::Psi4re and Weyl::Psi4im are only valid in iterations that are
+  // a multiple of Weyl::calc_every
+  if (CCTK_EQUALS(psi4_source, "grid") && out_every > 0 &&
+      out_every % calc_every != 0)
+    CCTK_VERROR("IO::out_every=%d must be a multiple of "
+                "Weyl::calc_every=%d when extracting from the grid",
+                int(out_every), int(calc_every));
+}
+
+extern "C" void SphericalHarmonics_select(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_select;
+  DECLARE_CCTK_PARAMETERS;
+
+  *extract_needed = out_every > 0 && cctk_iteration % out_every == 0;
+}
+
+extern "C" void SphericalHarmonics_extract(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_extract;
+  DECLARE_CCTK_PARAMETERS;
+
+  if (lmax > 0 && lmax < lmax_out)
+    CCTK_VERROR("SphericalHarmonics::lmax=%d must not be smaller than "
+                "SphericalHarmonics::lmax_out=%d",
+                int(lmax), int(lmax_out));
+  if (lmax == 0 && lmax_auto_max < lmax_out)
+    CCTK_VERROR("SphericalHarmonics::lmax_auto_max=%d must not be smaller "
+                "than SphericalHarmonics::lmax_out=%d",
+                int(lmax_auto_max), int(lmax_out));
+
+  std::vector<sphere_t> spheres(nradii);
+  for (int s = 0; s < nradii; ++s)
+    spheres.at(s) = {radius[s], center_x[s], center_y[s], center_z[s]};
 
-    file << std::setprecision(std::numeric_limits<double>::digits10 + 1)
-         << std::scientific;
-    file << cctk_iteration << sep << cctk_time;
-    for (int l = lmin_out; l <= lmax_out; ++l) {
-      for (int m = -l; m <= l; ++m) {
-        file << sep << real(psi4lm.at(cind(l, m)));
-        file << sep << imag(psi4lm.at(cind(l, m)));
+  // Band limit chosen in automatic mode. It is kept for later calls
+  // and is only increased, never decreased, even if Psi4 becomes
+  // smoother later on.
+  static int lmax_auto = 0;
+  // Warn only once that lmax_auto_max is not sufficient
+  static bool did_warn_lmax = false;
+
+  if (async) {
+    // The worker checks the band limit only after the fact, so that a
+    // larger band limit takes effect with the next extraction
+    if (lmax == 0) {
+      const double error_at_max = worker ? worker->get_error_at_max() : 0;
+      if (error_at_max > 0 && !did_warn_lmax) {
+        CCTK_VWARN(CCTK_WARN_ALERT,
+                   "Estimated aliasing error %g exceeds "
+                   "SphericalHarmonics::lmax_tolerance=%g at the maximum "
+                   "band limit SphericalHarmonics::lmax_auto_max=%d (warning "
+                   "only once)",
+                   error_at_max, double(lmax_tolerance), int(lmax_auto_max));
+        did_warn_lmax = true;
+      }
+      int lmax_wanted = worker ? worker->get_lmax_wanted() : 0;
+      MPI_Bcast(&lmax_wanted, 1, MPI_INT, 0, MPI_COMM_WORLD);
+      if (lmax_wanted > lmax_auto) {
+        lmax_auto = lmax_wanted;
+        CCTK_VINFO("Using band limit lmax=%d", lmax_auto);
       }
     }
-    file << eol;
+    const sampling_t &sampling = get_sampling(
+        lmax > 0         ? int(lmax)
+        : lmax_auto > 0 ? lmax_auto
+                        : std::min(2 * int(lmax_out), int(lmax_auto_max)));
+    if (lmax == 0 && lmax_auto == 0) {
+      lmax_auto = sampling.lmax;
+      CCTK_VINFO("Using band limit lmax=%d", lmax_auto);
+    }
+
+    // Only the interpolation is done synchronously; all spheres are
+    // collected on process 0
+    std::vector<std::vector<std::complex<double> > > psi4s =
+        sample_psi4(cctkGH, sampling, spheres, false);
+    if (CCTK_MyProc(cctkGH) == 0) {
+      if (!worker)
+        worker = std::make_unique<worker_t>(async_queue_length);
+      worker->write_hdf5_records();
+      worker->push({cctk_iteration, cctk_time, &sampling, std::move(spheres),
+                    std::move(psi4s), get_output_params(), lmax == 0,
+                    lmax_tolerance, int(lmax_auto_max)});
+    }
+    return;
+  }
+
+  const sampling_t *sampling = &get_sampling(
+      lmax > 0         ? int(lmax)
+      : lmax_auto > 0 ? lmax_auto
+                      : std::min(2 * int(lmax_out), int(lmax_auto_max)));
+  std::vector<std::vector<std::complex<double> > > psi4lms;
+  for (;;) {
+    double error;
+    psi4lms = expand_psi4(cctkGH, *sampling, spheres, error);
+    if (lmax > 0)
+      break;
+
+    // All processes know the largest aliasing error, and increase the
+    // band limit consistently since interpolation is collective
+    const bool done =
+        error <= lmax_tolerance || sampling->lmax >= lmax_auto_max;
+    if (done && error > lmax_tolerance && !did_warn_lmax) {
+      CCTK_VWARN(CCTK_WARN_ALERT,
+                 "Estimated aliasing error %g exceeds "
+                 "SphericalHarmonics::lmax_tolerance=%g at the maximum band "
+                 "limit SphericalHarmonics::lmax_auto_max=%d (warning only "
+                 "once)",
+                 error, double(lmax_tolerance), int(lmax_auto_max));
+      did_warn_lmax = true;
+    }
+    if (done)
+      break;
+    sampling = &get_sampling(
+        std::min(2 * sampling->lmax, int(lmax_auto_max)));
+  }
+  if (lmax == 0 && sampling->lmax != lmax_auto) {
+    lmax_auto = sampling->lmax;
+    CCTK_VINFO("Using band limit lmax=%d", lmax_auto);
+  }
 
-    file.close();
+  // Output modes only on a single process
+  if (CCTK_MyProc(cctkGH) == 0) {
+    const std::optional<hdf5_record_t> hdf5_record = output_modes(
+        get_output_params(), cctk_iteration, cctk_time, spheres, psi4lms);
+    if (hdf5_record)
+      write_hdf5(*hdf5_record);
+  }
+}
 
-  } // if (CCTK_MyProc(0) == 0)
+extern "C" void SphericalHarmonics_check_recovery(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_check_recovery;
+  DECLARE_CCTK_PARAMETERS;
+
+  // The strain integrators live only in memory; after recovery they
+  // would silently start again at zero
+  if (!strain_restart_on_recovery)
+    CCTK_ERROR("The time integration of the strain is not checkpointed. "
+               "Set SphericalHarmonics::strain_restart_on_recovery=yes to "
+               "restart it at zero after recovery.");
+  CCTK_WARN(CCTK_WARN_ALERT,
+            "The time integration of the strain is not checkpointed, and "
+            "restarts at zero after recovery. The strain and the radiated "
+            "energy, momentum, and angular momentum are offset from the "
+            "values before the checkpoint.");
+}
+
+extern "C" void SphericalHarmonics_recover(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_recover;
+
+  // Continue the HDF5 output from the checkpoint
+  recovered_iteration = cctk_iteration;
+}
+
+extern "C" void SphericalHarmonics_flush(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_flush;
+
+  // Wait for the background worker, so that all extractions up to now
+  // are in the output files
+  if (worker) {
+    worker->wait();
+    worker->write_hdf5_records();
+  }
+  if (hdf5_file)
+    hdf5_file->flush();
+}
+
+extern "C" void SphericalHarmonics_terminate(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_SphericalHarmonics_terminate;
+
+  if (worker) {
+    worker->wait();
+    worker->write_hdf5_records();
+  }
+  worker.reset();
+  hdf5_file.reset();
 }
 
 } // namespace SphericalHarmonics
@@ -0,0 +1,135 @@
+#include "strain.hxx"
+
+#include <ssht/ssht.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace SphericalHarmonics {
+
+namespace {
+const int spin = -2;
+
+// Coefficients coupling neighbouring modes in the radiated momentum
+// and angular momentum, see Ruiz et al., Gen. Rel. Grav. 40, 1705
+// (2008), eqns. (3.14), (3.15), and (3.22)-(3.24)
+double coeff_a(const int l, const int m) {
+  return std::sqrt(double((l - m) * (l + m + 1))) / (l * (l + 1));
+}
+double coeff_b(const int l, const int m) {
+  return std::sqrt(std::max(0.0, double((l - 2) * (l + 2) * (l + m) *
+                                        (l + m - 1)) /
+                                     ((2 * l - 1) * (2 * l + 1)))) /
+         (2 * l);
+}
+double coeff_c(const int l, const int m) { return 2.0 * m / (l * (l + 1)); }
+double coeff_d(const int l, const int m) {
+  return std::sqrt(std::max(0.0, double((l - 2) * (l + 2) * (l - m) *
+                                        (l + m)) /
+                                     ((2 * l - 1) * (2 * l + 1)))) /
+         l;
+}
+double coeff_f(const int l, const int m) {
+  return std::sqrt(std::max(0, l * (l + 1) - m * (m + 1)));
+}
+} // namespace
+
+strain_t::strain_t(const int lmax, const double omega0)
+    : lmax(lmax), omega0(omega0), initialized(false), time(0) {
+  assert(lmax >= std::abs(spin));
+  assert(omega0 >= 0);
+}
+
+// Mode (l,m) of a spin-weighted quantity; modes that are not stored
+// vanish
+std::complex<double>
+strain_t::get(const std::vector<std::complex<double> > &alm, const int l,
+              const int m) const {
+  if (l < std::abs(spin) || l > lmax || m < -l || m > l)
+    return 0;
+  int ind;
+  ssht_sampling_elm2ind(&ind, l, m);
+  return alm.at(ind);
+}
+
+radiation_t strain_t::calc_flux(const double radius) const {
+  using std::conj;
+  const double r2 = radius * radius;
+
+  double dE = 0;
+  std::complex<double> dPp = 0; // dPx + i dPy
+  double dPz = 0;
+  std::complex<double> dJp = 0; // combines dJx and dJy
+  std::complex<double> dJm = 0;
+  double dJz = 0;
+  for (int l = std::abs(spin); l <= lmax; ++l) {
+    for (int m = -l; m <= l; ++m) {
+      const std::complex<double> h = get(hlm, l, m);
+      const std::complex<double> dh = get(dhlm, l, m);
+      dE += std::norm(dh);
+      dPp += dh * (coeff_a(l, m) * conj(get(dhlm, l, m + 1)) +
+                   coeff_b(l, -m) * conj(get(dhlm, l - 1, m + 1)) -
+                   coeff_b(l + 1, m + 1) * conj(get(dhlm, l + 1, m + 1)));
+      dPz += real(dh * (coeff_c(l, m) * conj(dh) +
+                        coeff_d(l, m) * conj(get(dhlm, l - 1, m)) +
+                        coeff_d(l + 1, m) * conj(get(dhlm, l + 1, m))));
+      dJp += h * coeff_f(l, m) * conj(get(dhlm, l, m + 1));
+      dJm += h * coeff_f(l, -m) * conj(get(dhlm, l, m - 1));
+      dJz += m * imag(h * conj(dh));
+    }
+  }
+
+  radiation_t flux;
+  flux.E = r2 / (16 * M_PI) * dE;
+  flux.P = {r2 / (8 * M_PI) * real(dPp), r2 / (8 * M_PI) * imag(dPp),
+            r2 / (16 * M_PI) * dPz};
+  flux.J = {r2 / (32 * M_PI) * imag(dJp + dJm),
+            -r2 / (32 * M_PI) * real(dJp - dJm), r2 / (16 * M_PI) * dJz};
+  return flux;
+}
+
+void strain_t::update(const double new_time,
+                      const std::vector<std::complex<double> > &new_psi4lm,
+                      const double radius) {
+  const int ncoeffs = (lmax + 1) * (lmax + 1);
+  assert(int(new_psi4lm.size()) == ncoeffs);
+
+  if (!initialized) {
+    time = new_time;
+    psi4lm = new_psi4lm;
+    dhlm.assign(ncoeffs, 0);
+    hlm.assign(ncoeffs, 0);
+    flux = calc_flux(radius);
+    radiated = {0, {0, 0, 0}, {0, 0, 0}};
+    initialized = true;
+    return;
+  }
+
+  const double dt = new_time - time;
+  assert(dt >= 0);
+  if (dt == 0)
+    return;
+
+  // Damped trapezoidal rule: x(t+dt) = a x(t) + dt/2 (a y(t) + y(t+dt))
+  // integrates dx/dt = y - omega0 x
+  const double a = std::exp(-omega0 * dt);
+  for (int n = 0; n < ncoeffs; ++n) {
+    const std::complex<double> dh_old = dhlm.at(n);
+    dhlm.at(n) =
+        a * dh_old + dt / 2 * (a * psi4lm.at(n) + new_psi4lm.at(n));
+    hlm.at(n) = a * hlm.at(n) + dt / 2 * (a * dh_old + dhlm.at(n));
+  }
+  time = new_time;
+  psi4lm = new_psi4lm;
+
+  const radiation_t old_flux = flux;
+  flux = calc_flux(radius);
+  radiated.E += dt / 2 * (old_flux.E + flux.E);
+  for (int d = 0; d < 3; ++d) {
+    radiated.P[d] += dt / 2 * (old_flux.P[d] + flux.P[d]);
+    radiated.J[d] += dt / 2 * (old_flux.J[d] + flux.J[d]);
+  }
+}
+
+} // namespace SphericalHarmonics
@@ -0,0 +1,60 @@
+#ifndef STRAIN_HXX
+#define STRAIN_HXX
+
+#include <array>
+#include <complex>
+#include <vector>
+
+namespace SphericalHarmonics {
+
+// Energy, linear momentum, and angular momentum carried by
+// gravitational waves
+struct radiation_t {
+  double E;
+  std::array<double, 3> P, J;
+};
+
+// Integrate the modes of Psi4 on one sphere in time while they are
+// extracted, to obtain the modes of the strain h = h_+ - i h_x (with
+// Psi4 = d^2/dt^2 h) and its time derivative, as well as the radiated
+// energy, momentum, and angular momentum.
+//
+// Each integration uses the trapezoidal rule. If omega0 > 0, it also
+// damps the result with the rate omega0, which suppresses frequencies
+// below omega0 and removes the drifts caused by unknown integration
+// constants and by noise. The strain and all integrals start at zero
+// with the first extraction. They are not checkpointed, and start at
+// zero again after recovery.
+class strain_t {
+  int lmax;
+  double omega0;
+
+  bool initialized;
+  double time;
+  std::vector<std::complex<double> > psi4lm, dhlm, hlm;
+  radiation_t flux, radiated;
+
+  std::complex<double> get(const std::vector<std::complex<double> > &alm,
+                           int l, int m) const;
+  radiation_t calc_flux(double radius) const;
+
+public:
+  strain_t(int lmax, double omega0);
+
+  // Add the modes of Psi4 up to lmax at a later time
+  void update(double time, const std::vector<std::complex<double> > &psi4lm,
+              double radius);
+
+  // Modes of the strain and its time derivative, in the same order as
+  // the modes of Psi4
+  const std::vector<std::complex<double> > &h() const { return hlm; }
+  const std::vector<std::complex<double> > &dh() const { return dhlm; }
+
+  // Current fluxes, and their time integrals
+  const radiation_t &get_flux() const { return flux; }
+  const radiation_t &get_radiated() const { return radiated; }
+};
+
+} // namespace SphericalHarmonics
+
+#endif // #ifndef STRAIN_HXX
@@ -9,6 +9,11 @@ void gfs_t::calc_curvature() const {
   typedef simdl<CCTK_REAL> vbool;
   constexpr std::size_t vsize = std::tuple_size_v<vreal>;
 
+  // Read 150 components of the 4-metric and its derivatives, write 21
+  // components of the Weyl tensor
+  static const kernel_t kernel{"Weyl curvature", 0, 171 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
   grid.loop_int_device<0, 0, 0, vsize>(
       grid.nghostzones,
       [layout0 = layout0,                                             //
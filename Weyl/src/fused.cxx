@@ -0,0 +1,149 @@
+#include "weyl.hxx"
+
+#include "weyl_vars.hxx"
+
+namespace Weyl {
+
+// The fused kernels evaluate the same expressions as the staged
+// kernels, but keep the 4-metric and the 4-curvature in registers
+// instead of writing them to the intermediate tiles and reading them
+// back. They read only the derivatives of the ADM variables.
+
+void gfs_t::calc_scalars_fused() const {
+  typedef simd<CCTK_REAL> vreal;
+  typedef simdl<CCTK_REAL> vbool;
+  constexpr std::size_t vsize = std::tuple_size_v<vreal>;
+
+  // Read 150 derivatives of the ADM variables, write 10 Weyl scalars
+  static const kernel_t kernel{"Weyl fused scalars", 0, 160 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  const CCTK_REAL time = cctkGH->cctk_time;
+
+  grid.loop_int_device<0, 0, 0, vsize>(
+      grid.nghostzones,
+      [layout0 = layout0, layout5 = layout5, //
+       time,                                 //
+       gf_gamma0 = gf_gamma0, gf_alpha0 = gf_alpha0, gf_beta0 = gf_beta0,
+       gf_K0 = gf_K0, gf_dtalpha0 = gf_dtalpha0, gf_dtbeta0 = gf_dtbeta0,
+       gf_dgamma0 = gf_dgamma0, gf_dalpha0 = gf_dalpha0, gf_dbeta0 = gf_dbeta0,
+       gf_dtK0 = gf_dtK0, gf_dt2alpha0 = gf_dt2alpha0,
+       gf_dt2beta0 = gf_dt2beta0, gf_dK0 = gf_dK0, gf_ddtalpha0 = gf_ddtalpha0,
+       gf_ddtbeta0 = gf_ddtbeta0, gf_ddgamma0 = gf_ddgamma0,
+       gf_ddalpha0 = gf_ddalpha0, gf_ddbeta0 = gf_ddbeta0, //
+       gf_Psi0re5 = gf_Psi0re5, gf_Psi0im5 = gf_Psi0im5,
+       gf_Psi1re5 = gf_Psi1re5, gf_Psi1im5 = gf_Psi1im5,
+       gf_Psi2re5 = gf_Psi2re5, gf_Psi2im5 = gf_Psi2im5,
+       gf_Psi3re5 = gf_Psi3re5, gf_Psi3im5 = gf_Psi3im5,
+       gf_Psi4re5 = gf_Psi4re5,
+       gf_Psi4im5 = gf_Psi4im5 //
+  ] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+        const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+        const GF3D5index index0(layout0, p.I);
+        const GF3D5index index5(layout5, p.I);
+
+        // Load and calculate
+
+        const auto id3 = one<smat<int, 3> >()();
+
+        const weyl_vars_metric<vreal> metric(
+            gf_gamma0(mask, index0, id3), gf_alpha0(mask, index0, 1),
+            gf_beta0(mask, index0), //
+            gf_K0(mask, index0), gf_dtalpha0(mask, index0),
+            gf_dtbeta0(mask, index0), //
+            gf_dgamma0(mask, index0), gf_dalpha0(mask, index0),
+            gf_dbeta0(mask, index0), //
+            gf_dtK0(mask, index0), gf_dt2alpha0(mask, index0),
+            gf_dt2beta0(mask, index0), //
+            gf_dK0(mask, index0), gf_ddtalpha0(mask, index0),
+            gf_ddtbeta0(mask, index0), //
+            gf_ddgamma0(mask, index0), gf_ddalpha0(mask, index0),
+            gf_ddbeta0(mask, index0));
+
+        const weyl_vars_curvature<vreal> curvature(metric.g, metric.dg,
+                                                   metric.ddg);
+
+        const vec<vreal, 3> coord3(
+            [&](int d) { return p.X[d] + iota<vreal>() * p.DX[d]; });
+        const vec<vreal, 4> coord4{time, coord3(0), coord3(1), coord3(2)};
+
+        const weyl_vars_scalars<vreal> vars(coord4, metric.g, curvature.R,
+                                            curvature.C);
+
+        // Store
+
+        gf_Psi0re5.store(mask, index5, real(vars.Psi0));
+        gf_Psi0im5.store(mask, index5, imag(vars.Psi0));
+        gf_Psi1re5.store(mask, index5, real(vars.Psi1));
+        gf_Psi1im5.store(mask, index5, imag(vars.Psi1));
+        gf_Psi2re5.store(mask, index5, real(vars.Psi2));
+        gf_Psi2im5.store(mask, index5, imag(vars.Psi2));
+        gf_Psi3re5.store(mask, index5, real(vars.Psi3));
+        gf_Psi3im5.store(mask, index5, imag(vars.Psi3));
+        gf_Psi4re5.store(mask, index5, real(vars.Psi4));
+        gf_Psi4im5.store(mask, index5, imag(vars.Psi4));
+      });
+}
+
+void gfs_t::calc_psi4_fused() const {
+  typedef simd<CCTK_REAL> vreal;
+  typedef simdl<CCTK_REAL> vbool;
+  constexpr std::size_t vsize = std::tuple_size_v<vreal>;
+
+  // Read 150 derivatives of the ADM variables, write 2 components of
+  // Psi4
+  static const kernel_t kernel{"Weyl fused Psi4", 0, 152 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  const CCTK_REAL time = cctkGH->cctk_time;
+
+  grid.loop_int_device<0, 0, 0, vsize>(
+      grid.nghostzones,
+      [layout0 = layout0, layout5 = layout5, //
+       time,                                 //
+       gf_gamma0 = gf_gamma0, gf_alpha0 = gf_alpha0, gf_beta0 = gf_beta0,
+       gf_K0 = gf_K0, gf_dtalpha0 = gf_dtalpha0, gf_dtbeta0 = gf_dtbeta0,
+       gf_dgamma0 = gf_dgamma0, gf_dalpha0 = gf_dalpha0, gf_dbeta0 = gf_dbeta0,
+       gf_dtK0 = gf_dtK0, gf_dt2alpha0 = gf_dt2alpha0,
+       gf_dt2beta0 = gf_dt2beta0, gf_dK0 = gf_dK0, gf_ddtalpha0 = gf_ddtalpha0,
+       gf_ddtbeta0 = gf_ddtbeta0, gf_ddgamma0 = gf_ddgamma0,
+       gf_ddalpha0 = gf_ddalpha0, gf_ddbeta0 = gf_ddbeta0, //
+       gf_Psi4re5 = gf_Psi4re5, gf_Psi4im5 = gf_Psi4im5] //
+      ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+        const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+        const GF3D5index index0(layout0, p.I);
+        const GF3D5index index5(layout5, p.I);
+
+        // Load and calculate
+
+        const auto id3 = one<smat<int, 3> >()();
+
+        const weyl_vars_metric<vreal> metric(
+            gf_gamma0(mask, index0, id3), gf_alpha0(mask, index0, 1),
+            gf_beta0(mask, index0), //
+            gf_K0(mask, index0), gf_dtalpha0(mask, index0),
+            gf_dtbeta0(mask, index0), //
+            gf_dgamma0(mask, index0), gf_dalpha0(mask, index0),
+            gf_dbeta0(mask, index0), //
+            gf_dtK0(mask, index0), gf_dt2alpha0(mask, index0),
+            gf_dt2beta0(mask, index0), //
+            gf_dK0(mask, index0), gf_ddtalpha0(mask, index0),
+            gf_ddtbeta0(mask, index0), //
+            gf_ddgamma0(mask, index0), gf_ddalpha0(mask, index0),
+            gf_ddbeta0(mask, index0));
+
+        const vec<vreal, 3> coord3(
+            [&](int d) { return p.X[d] + iota<vreal>() * p.DX[d]; });
+        const vec<vreal, 4> coord4{time, coord3(0), coord3(1), coord3(2)};
+
+        const weyl_vars_psi4<vreal> vars(coord4, metric.g, metric.dg,
+                                         metric.ddg);
+
+        // Store
+
+        gf_Psi4re5.store(mask, index5, real(vars.Psi4));
+        gf_Psi4im5.store(mask, index5, imag(vars.Psi4));
+      });
+}
+
+} // namespace Weyl
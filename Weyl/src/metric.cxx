@@ -9,6 +9,11 @@ void gfs_t::calc_metric() const {
   typedef simdl<CCTK_REAL> vbool;
   constexpr std::size_t vsize = std::tuple_size_v<vreal>;
 
+  // Read 150 derivatives of the ADM variables, write 150 components of
+  // the 4-metric and its derivatives
+  static const kernel_t kernel{"Weyl metric", 0, 300 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
   grid.loop_int_device<0, 0, 0, vsize>(
       grid.nghostzones,
       [layout0 = layout0, //
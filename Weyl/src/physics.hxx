@@ -107,9 +107,7 @@ calc_dgammal(const smat<smat<T, D>, D> &ddg) {
   return vec<smat<vec<T, D>, D>, D>([&](int a) ARITH_INLINE {
     return smat<vec<T, D>, D>([&](int b, int c) ARITH_INLINE {
       return vec<T, D>([&](int d) ARITH_INLINE {
-        return sum<D>([&](int x) ARITH_INLINE {
-          return (ddg(a, b)(c, d) + ddg(a, c)(b, d) - ddg(b, c)(a, d)) / 2;
-        });
+        return (ddg(a, b)(c, d) + ddg(a, c)(b, d) - ddg(b, c)(a, d)) / 2;
       });
     });
   });
@@ -295,6 +293,50 @@ calc_er(const vec<T, 4> &x, const gmat<T, 4, symm> &g, const vec<T, 4> &etheta,
   return er;
 }
 
+// Spatial tetrad vectors, constructed from the 3-metric. These agree
+// with the spatial components of the 4-dimensional tetrad vectors
+// above, which have no time components.
+
+template <typename T, symm_t symm>
+constexpr ARITH_INLINE ARITH_DEVICE ARITH_HOST vec<T, 3>
+calc_ephi(const vec<T, 3> &x, const gmat<T, 3, symm> &gamma) {
+  const T z = zero<T>();
+  const T o = one<T>();
+  const vec<T, 3> ephi_z_axis{-o, z, z};
+  vec<T, 3> ephi{-x(1), x(0), z};
+  ephi = normalized(gamma, ephi, ephi_z_axis);
+  return ephi;
+}
+
+template <typename T, symm_t symm>
+constexpr ARITH_INLINE ARITH_DEVICE ARITH_HOST vec<T, 3>
+calc_etheta(const vec<T, 3> &x, const gmat<T, 3, symm> &gamma,
+            const vec<T, 3> &ephi) {
+  const T z = zero<T>();
+  const T o = one<T>();
+  const vec<T, 3> etheta_z_axis{x(2), z, o};
+  const T rho2 = pow2(x(0)) + pow2(x(1));
+  vec<T, 3> etheta{x(0) * x(2), x(1) * x(2), -rho2};
+  etheta = normalized(gamma, etheta, etheta_z_axis); // to improve accuracy
+  etheta = rejected(gamma, etheta, ephi);
+  etheta = normalized(gamma, etheta, etheta_z_axis);
+  return etheta;
+}
+
+template <typename T, symm_t symm>
+constexpr ARITH_INLINE ARITH_DEVICE ARITH_HOST vec<T, 3>
+calc_er(const vec<T, 3> &x, const gmat<T, 3, symm> &gamma,
+        const vec<T, 3> &etheta, const vec<T, 3> &ephi) {
+  const T z = zero<T>();
+  const T o = one<T>();
+  const vec<T, 3> er_origin{o, z, z};
+  vec<T, 3> er{x(0), x(1), x(2)};
+  er = normalized(gamma, er, er_origin); // to improve accuracy
+  er = rejected(gamma, er, etheta);
+  er = rejected(gamma, er, ephi);
+  return er;
+}
+
 template <typename T, int D, symm_t symm>
 constexpr ARITH_INLINE ARITH_DEVICE ARITH_HOST vec<vec<T, D>, D>
 calc_det(const gmat<T, D, symm> &gu, const gmat<vec<T, D>, D, symm> &dgu,
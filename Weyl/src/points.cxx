@@ -0,0 +1,206 @@
+#include "weyl_vars.hxx"
+
+#include <cplx.hxx>
+#include <mat.hxx>
+#include <timers.hxx>
+#include <vec.hxx>
+
+#include <cctk.h>
+#include <cctk_Functions.h>
+#include <cctk_Parameters.h>
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+namespace Weyl {
+using namespace Arith;
+using namespace SpacetimeUtils;
+using namespace std;
+
+namespace {
+
+// Variables and derivatives to interpolate, and the interpolated
+// values. Each variable is interpolated together with a fixed set of
+// its spatial derivatives. The interpolator's operation codes are 0 for
+// the value, d for the first derivative in direction d, and 10 d + e
+// for the second derivative in directions d and e (1 <= d <= e <= 3).
+class interpolator_t {
+  int npoints;
+  vector<CCTK_INT> varinds, operations;
+  vector<vector<CCTK_REAL> > results;
+
+  // Index of the second derivative in directions a and b
+  static int symm_ind(const int a, const int b) {
+    const int i = min(a, b), j = max(a, b);
+    return i * (5 - i) / 2 + j;
+  }
+
+public:
+  explicit interpolator_t(const int npoints) : npoints(npoints) {}
+
+  // Request a variable with its first `nderivs` derivatives, and return
+  // a handle to the interpolated values
+  int add(const string &varname, const int nderivs) {
+    const int varind = CCTK_VarIndex(varname.c_str());
+    if (varind < 0)
+      CCTK_VERROR("Variable \"%s\" does not exist", varname.c_str());
+    const int handle = varinds.size();
+    varinds.push_back(varind);
+    operations.push_back(0);
+    if (nderivs >= 1)
+      for (int d = 1; d <= 3; ++d) {
+        varinds.push_back(varind);
+        operations.push_back(d);
+      }
+    if (nderivs >= 2)
+      for (int d = 1; d <= 3; ++d)
+        for (int e = d; e <= 3; ++e) {
+          varinds.push_back(varind);
+          operations.push_back(10 * d + e);
+        }
+    return handle;
+  }
+  array<int, 3> add_vec(const string &prefix, const int nderivs) {
+    return {add(prefix + "x", nderivs), add(prefix + "y", nderivs),
+            add(prefix + "z", nderivs)};
+  }
+  array<int, 6> add_smat(const string &prefix, const int nderivs) {
+    return {add(prefix + "xx", nderivs), add(prefix + "xy", nderivs),
+            add(prefix + "xz", nderivs), add(prefix + "yy", nderivs),
+            add(prefix + "yz", nderivs), add(prefix + "zz", nderivs)};
+  }
+
+  void interpolate(const cGH *restrict const cctkGH,
+                   const CCTK_REAL *restrict const coordsx,
+                   const CCTK_REAL *restrict const coordsy,
+                   const CCTK_REAL *restrict const coordsz) {
+    const int nvars = varinds.size();
+    results.assign(nvars, vector<CCTK_REAL>(npoints));
+    vector<CCTK_POINTER> resultptrs(nvars);
+    for (int v = 0; v < nvars; ++v)
+      resultptrs.at(v) = results.at(v).data();
+    Interpolate(cctkGH, npoints, coordsx, coordsy, coordsz, nvars,
+                varinds.data(), operations.data(), resultptrs.data());
+  }
+
+  // Access interpolated values at point n
+
+  CCTK_REAL val(const int h, const int n) const { return results[h][n]; }
+  vec<CCTK_REAL, 3> deriv(const int h, const int n) const {
+    return vec<CCTK_REAL, 3>([&](int a) { return results[h + 1 + a][n]; });
+  }
+  smat<CCTK_REAL, 3> deriv2(const int h, const int n) const {
+    return smat<CCTK_REAL, 3>(
+        [&](int a, int b) { return results[h + 4 + symm_ind(a, b)][n]; });
+  }
+
+  vec<CCTK_REAL, 3> val(const array<int, 3> &h, const int n) const {
+    return vec<CCTK_REAL, 3>([&](int a) { return val(h[a], n); });
+  }
+  vec<vec<CCTK_REAL, 3>, 3> deriv(const array<int, 3> &h, const int n) const {
+    return vec<vec<CCTK_REAL, 3>, 3>([&](int a) { return deriv(h[a], n); });
+  }
+  vec<smat<CCTK_REAL, 3>, 3> deriv2(const array<int, 3> &h,
+                                    const int n) const {
+    return vec<smat<CCTK_REAL, 3>, 3>(
+        [&](int a) { return deriv2(h[a], n); });
+  }
+
+  smat<CCTK_REAL, 3> val(const array<int, 6> &h, const int n) const {
+    return smat<CCTK_REAL, 3>(
+        [&](int a, int b) { return val(h[symm_ind(a, b)], n); });
+  }
+  smat<vec<CCTK_REAL, 3>, 3> deriv(const array<int, 6> &h,
+                                   const int n) const {
+    return smat<vec<CCTK_REAL, 3>, 3>(
+        [&](int a, int b) { return deriv(h[symm_ind(a, b)], n); });
+  }
+  smat<smat<CCTK_REAL, 3>, 3> deriv2(const array<int, 6> &h,
+                                     const int n) const {
+    return smat<smat<CCTK_REAL, 3>, 3>(
+        [&](int a, int b) { return deriv2(h[symm_ind(a, b)], n); });
+  }
+};
+
+} // namespace
+
+// Calculate Psi4 at arbitrary points. The ADM variables and their
+// spatial derivatives are interpolated to the points, and Psi4 is
+// evaluated there with the same kernels as on the grid. This must be
+// called in global mode by all processes.
+extern "C" void
+Weyl_CalcPsi4AtPoints(const CCTK_POINTER_TO_CONST cctkGH_,
+                      const CCTK_INT npoints,
+                      const CCTK_REAL *restrict const coordsx,
+                      const CCTK_REAL *restrict const coordsy,
+                      const CCTK_REAL *restrict const coordsz,
+                      CCTK_REAL *restrict const psi4re,
+                      CCTK_REAL *restrict const psi4im) {
+  DECLARE_CCTK_PARAMETERS;
+  const cGH *restrict const cctkGH = static_cast<const cGH *>(cctkGH_);
+
+  const bool use_3p1 = CCTK_EQUALS(psi4_method, "3+1");
+
+  interpolator_t interp(npoints);
+  const auto gamma = interp.add_smat("ADMBaseX::g", 2);
+  const auto K = interp.add_smat("ADMBaseX::k", 1);
+  array<int, 6> dtK;
+  array<int, 3> beta, dtbeta, dt2beta;
+  int alpha, dtalpha, dt2alpha;
+  if (!use_3p1) {
+    alpha = interp.add("ADMBaseX::alp", 2);
+    beta = interp.add_vec("ADMBaseX::beta", 2);
+    dtalpha = interp.add("ADMBaseX::dtalp", 1);
+    dtbeta = interp.add_vec("ADMBaseX::dtbeta", 1);
+    dtK = interp.add_smat("ADMBaseX::dtk", 0);
+    dt2alpha = interp.add("ADMBaseX::dt2alp", 0);
+    dt2beta = interp.add_vec("ADMBaseX::dt2beta", 0);
+  }
+
+  interp.interpolate(cctkGH, coordsx, coordsy, coordsz);
+
+  static const kernel_t kernel3p1{"Weyl Psi4 at points (3+1)", 0, 86 * 8};
+  static const kernel_t kernel4{"Weyl Psi4 at points", 0, 152 * 8};
+  const kernel_timer_t timer(use_3p1 ? kernel3p1 : kernel4, npoints);
+
+  for (int n = 0; n < npoints; ++n) {
+    const vec<CCTK_REAL, 3> coord3{coordsx[n], coordsy[n], coordsz[n]};
+
+    cplx<CCTK_REAL> Psi4;
+    if (use_3p1) {
+      const weyl_vars_psi4_3p1<CCTK_REAL> vars(
+          coord3, interp.val(gamma, n), interp.val(K, n),
+          interp.deriv(gamma, n), interp.deriv2(gamma, n), interp.deriv(K, n));
+      Psi4 = vars.Psi4;
+    } else {
+      const weyl_vars_metric<CCTK_REAL> metric(
+          interp.val(gamma, n), interp.val(alpha, n), interp.val(beta, n),
+          //
+          interp.val(K, n), interp.val(dtalpha, n), interp.val(dtbeta, n),
+          //
+          interp.deriv(gamma, n), interp.deriv(alpha, n),
+          interp.deriv(beta, n),
+          //
+          interp.val(dtK, n), interp.val(dt2alpha, n),
+          interp.val(dt2beta, n),
+          //
+          interp.deriv(K, n), interp.deriv(dtalpha, n),
+          interp.deriv(dtbeta, n),
+          //
+          interp.deriv2(gamma, n), interp.deriv2(alpha, n),
+          interp.deriv2(beta, n));
+      const vec<CCTK_REAL, 4> coord4{cctkGH->cctk_time, coord3(0), coord3(1),
+                                     coord3(2)};
+      const weyl_vars_psi4<CCTK_REAL> vars(coord4, metric.g, metric.dg,
+                                           metric.ddg);
+      Psi4 = vars.Psi4;
+    }
+
+    psi4re[n] = real(Psi4);
+    psi4im[n] = imag(Psi4);
+  }
+}
+
+} // namespace Weyl
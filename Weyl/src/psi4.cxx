@@ -0,0 +1,93 @@
+#include "weyl.hxx"
+
+#include "weyl_vars.hxx"
+
+namespace Weyl {
+
+void gfs_t::calc_psi4() const {
+  typedef simd<CCTK_REAL> vreal;
+  typedef simdl<CCTK_REAL> vbool;
+  constexpr std::size_t vsize = std::tuple_size_v<vreal>;
+
+  // Read 150 components of the 4-metric and its derivatives, write 2
+  // components of Psi4
+  static const kernel_t kernel{"Weyl Psi4", 0, 152 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  const CCTK_REAL time = cctkGH->cctk_time;
+
+  grid.loop_int_device<0, 0, 0, vsize>(
+      grid.nghostzones,
+      [layout0 = layout0, layout5 = layout5,                          //
+       time,                                                          //
+       tile_g4 = tile_g4, tile_dg4 = tile_dg4, tile_ddg4 = tile_ddg4, //
+       gf_Psi4re5 = gf_Psi4re5, gf_Psi4im5 = gf_Psi4im5] //
+      ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+        const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+        const GF3D5index index0(layout0, p.I);
+        const GF3D5index index5(layout5, p.I);
+
+        // Load and calculate
+
+        constexpr smat<int, 4> id4{-1, 0, 0, 0, //
+                                   +1, 0, 0,    //
+                                   +1, 0,       //
+                                   +1};
+
+        const vec<vreal, 3> coord3(
+            [&](int d) { return p.X[d] + iota<vreal>() * p.DX[d]; });
+        const vec<vreal, 4> coord4{time, coord3(0), coord3(1), coord3(2)};
+
+        const weyl_vars_psi4<vreal> vars(coord4, //
+                                         tile_g4(mask, index0, id4),
+                                         tile_dg4(mask, index0),
+                                         tile_ddg4(mask, index0));
+
+        // Store
+
+        gf_Psi4re5.store(mask, index5, real(vars.Psi4));
+        gf_Psi4im5.store(mask, index5, imag(vars.Psi4));
+      });
+}
+
+void gfs_t::calc_psi4_3p1() const {
+  typedef simd<CCTK_REAL> vreal;
+  typedef simdl<CCTK_REAL> vbool;
+  constexpr std::size_t vsize = std::tuple_size_v<vreal>;
+
+  // Read 84 components of the 3-metric, the extrinsic curvature, and
+  // their derivatives, write 2 components of Psi4
+  static const kernel_t kernel{"Weyl Psi4 (3+1)", 0, 86 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  grid.loop_int_device<0, 0, 0, vsize>(
+      grid.nghostzones,
+      [layout0 = layout0, layout5 = layout5, //
+       gf_gamma0 = gf_gamma0, gf_dgamma0 = gf_dgamma0,
+       gf_ddgamma0 = gf_ddgamma0, gf_K0 = gf_K0, gf_dK0 = gf_dK0, //
+       gf_Psi4re5 = gf_Psi4re5, gf_Psi4im5 = gf_Psi4im5]         //
+      ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+        const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+        const GF3D5index index0(layout0, p.I);
+        const GF3D5index index5(layout5, p.I);
+
+        // Load and calculate
+
+        const auto id3 = one<smat<int, 3> >()();
+
+        const vec<vreal, 3> coord3(
+            [&](int d) { return p.X[d] + iota<vreal>() * p.DX[d]; });
+
+        const weyl_vars_psi4_3p1<vreal> vars(
+            coord3, gf_gamma0(mask, index0, id3), gf_K0(mask, index0),
+            gf_dgamma0(mask, index0), gf_ddgamma0(mask, index0),
+            gf_dK0(mask, index0));
+
+        // Store
+
+        gf_Psi4re5.store(mask, index5, real(vars.Psi4));
+        gf_Psi4im5.store(mask, index5, imag(vars.Psi4));
+      });
+}
+
+} // namespace Weyl
@@ -9,6 +9,11 @@ void gfs_t::calc_scalars() const {
   typedef simdl<CCTK_REAL> vbool;
   constexpr std::size_t vsize = std::tuple_size_v<vreal>;
 
+  // Read 41 components of the 4-metric and curvature, write 10 Weyl
+  // scalars
+  static const kernel_t kernel{"Weyl scalars", 0, 51 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
   const CCTK_REAL time = cctkGH->cctk_time;
 
   grid.loop_int_device<0, 0, 0, vsize>(
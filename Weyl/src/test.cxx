@@ -1,361 +1,352 @@
-#include "derivs.hxx"
 #include "physics.hxx"
-#include "tensor.hxx"
+#include "weyl_vars.hxx"
+
+#include <cplx.hxx>
+#include <mat.hxx>
+#include <vec.hxx>
 
 #include <cctk.h>
+#include <cctk_Arguments.h>
 
-#include <algorithm>
 #include <array>
-#include <cassert>
 #include <cmath>
 #include <random>
 
 namespace Weyl {
+using namespace Arith;
 using namespace std;
 
-// TODO: Use GoogleTest instead of assert
+namespace {
+
+// A random 4-metric g_ab(x) = eta_ab + A_abc x^c + B_abcd x^c x^d / 2
+// close to Minkowski, with its first and second derivatives
+struct quadratic_metric_t {
+  array<array<array<double, 4>, 4>, 4> A;
+  array<array<array<array<double, 4>, 4>, 4>, 4> B;
+
+  explicit quadratic_metric_t(mt19937 &engine) {
+    uniform_real_distribution<double> dist(-0.1, 0.1);
+    for (int a = 0; a < 4; ++a)
+      for (int b = a; b < 4; ++b)
+        for (int c = 0; c < 4; ++c)
+          A[a][b][c] = A[b][a][c] = dist(engine);
+    for (int a = 0; a < 4; ++a)
+      for (int b = a; b < 4; ++b)
+        for (int c = 0; c < 4; ++c)
+          for (int d = c; d < 4; ++d)
+            B[a][b][c][d] = B[b][a][c][d] = B[a][b][d][c] = B[b][a][d][c] =
+                dist(engine);
+  }
 
-extern "C" void Weyl_Test(CCTK_ARGUMENTS) {
-  DECLARE_CCTK_ARGUMENTS;
+  smat<double, 4> g(const vec<double, 4> &x) const {
+    return smat<double, 4>([&](int a, int b) {
+      double r = a != b ? 0 : a == 0 ? -1 : 1;
+      for (int c = 0; c < 4; ++c) {
+        r += A[a][b][c] * x(c);
+        for (int d = 0; d < 4; ++d)
+          r += B[a][b][c][d] * x(c) * x(d) / 2;
+      }
+      return r;
+    });
+  }
 
-  // Test tensors
-  {
-    mt19937 engine(42);
-    uniform_int_distribution<int> dist(-10, 10);
-    const auto rand10{[&]() { return double(dist(engine)); }};
-    const auto randmat10{[&]() {
-      array<array<double, 3>, 3> arr;
-      for (int a = 0; a < 3; ++a)
-        for (int b = 0; b < 3; ++b)
-          arr[a][b] = rand10();
-      return mat3<double, DN, DN>(
-          [&](int a, int b) { return arr[min(a, b)][max(a, b)]; });
-    }};
-
-    const mat3<double, DN, DN> Z([&](int a, int b) { return double(0); });
-    const mat3<double, DN, DN> I([&](int a, int b) { return double(a == b); });
-    assert(I != Z);
-    const mat3<double, UP, UP> Zup([&](int a, int b) { return double(0); });
-    const mat3<double, UP, UP> Iup(
-        [&](int a, int b) { return double(a == b); });
-    assert(Iup != Zup);
-
-    for (int n = 0; n < 100; ++n) {
-      const mat3<double, DN, DN> A = randmat10();
-      const mat3<double, DN, DN> B = randmat10();
-      const mat3<double, DN, DN> C = randmat10();
-      const double a = rand10();
-      const double b = rand10();
-
-      assert((A + B) + C == A + (B + C));
-      assert(Z + A == A);
-      assert(A + Z == A);
-      assert(A + (-A) == Z);
-      assert((-A) + A == Z);
-      assert(A - B == A + (-B));
-      assert(A + B == B + A);
-
-      assert(1 * A == A);
-      assert(0 * A == Z);
-      assert(-1 * A == -A);
-      // assert(mul(a * A, B) == a * mul(A, B));
-      assert((a * b) * A == a * (b * A));
-      assert(a * (A + B) == a * A + a * B);
-      assert((a + b) * A == a * A + b * A);
-
-      // assert(mul(mul(A, B), C) == mul(A, mul(B, C)));
-      // DNUP  assert(mul(I, A) == A);
-      // DNUP  assert(mul(A, I) == A);
-      // DNUP  assert(mul(Z, A) == Z);
-      // DNUP  assert(mul(A, Z) == Z);
-
-      assert(Z.det() == 0);
-      assert(I.det() == 1);
-      assert((a * A).det() == pow3(a) * A.det());
-
-      assert(Z.inv(1) == Zup);
-      assert(I.inv(1) == Iup);
-
-      // DNUP assert(mul(A.inv(1), A) == A.det() * Iup);
-      // DNUP assert(mul(A, A.inv(1)) == A.det() * Iup);
-
-      assert((a * A).inv(1) == pow2(a) * A.inv(1));
-    }
+  smat<vec<double, 4>, 4> dg(const vec<double, 4> &x) const {
+    return smat<vec<double, 4>, 4>([&](int a, int b) {
+      return vec<double, 4>([&](int c) {
+        double r = A[a][b][c];
+        for (int d = 0; d < 4; ++d)
+          r += B[a][b][c][d] * x(d);
+        return r;
+      });
+    });
   }
 
-  // Test 4-tensors
-  {
-    mt19937 engine(42);
-    uniform_int_distribution<int> dist(-10, 10);
-    const auto rand10{[&]() { return double(dist(engine)); }};
-    const auto randmat10{[&]() {
-      array<array<double, 4>, 4> arr;
-      for (int a = 0; a < 4; ++a)
-        for (int b = 0; b < 4; ++b)
-          arr[a][b] = rand10();
-      return mat4<double, DN, DN>(
-          [&](int a, int b) { return arr[min(a, b)][max(a, b)]; });
-    }};
-
-    const mat4<double, DN, DN> Z([&](int a, int b) { return double(0); });
-    const mat4<double, DN, DN> I([&](int a, int b) { return double(a == b); });
-    assert(I != Z);
-    const mat4<double, UP, UP> Zup([&](int a, int b) { return double(0); });
-    const mat4<double, UP, UP> Iup(
-        [&](int a, int b) { return double(a == b); });
-    assert(Iup != Zup);
-
-    for (int n = 0; n < 100; ++n) {
-      const mat4<double, DN, DN> A = randmat10();
-      const mat4<double, DN, DN> B = randmat10();
-      const mat4<double, DN, DN> C = randmat10();
-      const double a = rand10();
-      const double b = rand10();
-
-      assert((A + B) + C == A + (B + C));
-      assert(Z + A == A);
-      assert(A + Z == A);
-      assert(A + (-A) == Z);
-      assert((-A) + A == Z);
-      assert(A - B == A + (-B));
-      assert(A + B == B + A);
-
-      assert(1 * A == A);
-      assert(0 * A == Z);
-      assert(-1 * A == -A);
-      // assert(mul(a * A, B) == a * mul(A, B));
-      assert((a * b) * A == a * (b * A));
-      assert(a * (A + B) == a * A + a * B);
-      assert((a + b) * A == a * A + b * A);
-
-      // assert(mul(mul(A, B), C) == mul(A, mul(B, C)));
-      // DNUP  assert(mul(I, A) == A);
-      // DNUP  assert(mul(A, I) == A);
-      // DNUP  assert(mul(Z, A) == Z);
-      // DNUP  assert(mul(A, Z) == Z);
-
-      assert(Z.det() == 0);
-      assert(I.det() == 1);
-      assert((a * A).det() == pow4(a) * A.det());
-
-      assert(Z.inv(1) == Zup);
-      assert(I.inv(1) == Iup);
-
-      // DNUP assert(mul(A.inv(1), A) == A.det() * Iup);
-      // DNUP assert(mul(A, A.inv(1)) == A.det() * Iup);
-
-      assert((a * A).inv(1) == pow3(a) * A.inv(1));
-    }
+  smat<smat<double, 4>, 4> ddg() const {
+    return smat<smat<double, 4>, 4>([&](int a, int b) {
+      return smat<double, 4>([&](int c, int d) { return B[a][b][c][d]; });
+    });
   }
+};
+
+// The derivative of the Christoffel symbols must be the derivative of
+// calc_gammal. For a quadratic metric, the Christoffel symbols are
+// linear in x, and a centred difference is exact up to round-off.
+void test_dgammal() {
+  mt19937 engine(42);
+  const quadratic_metric_t metric(engine);
+  const vec<double, 4> x{0.1, 0.2, -0.3, 0.4};
+  const double h = 0.5;
+
+  const vec<smat<vec<double, 4>, 4>, 4> dGammal = calc_dgammal(metric.ddg());
+  for (int d = 0; d < 4; ++d) {
+    const vec<double, 4> xp([&](int c) { return x(c) + (c == d ? h : 0); });
+    const vec<double, 4> xm([&](int c) { return x(c) - (c == d ? h : 0); });
+    const vec<smat<double, 4>, 4> Gammalp = calc_gammal(metric.dg(xp));
+    const vec<smat<double, 4>, 4> Gammalm = calc_gammal(metric.dg(xm));
+    for (int a = 0; a < 4; ++a)
+      for (int b = 0; b < 4; ++b)
+        for (int c = b; c < 4; ++c) {
+          const double expected =
+              (Gammalp(a)(b, c) - Gammalm(a)(b, c)) / (2 * h);
+          const double found = dGammal(a)(b, c)(d);
+          if (!(fabs(found - expected) <= 1.0e-12))
+            CCTK_VERROR("calc_dgammal: Gamma_%d%d%d,%d is %.17g, expected "
+                        "%.17g",
+                        a, b, c, d, found, expected);
+        }
+  }
+}
+
+// The inverse 4-metric must be the inverse of the 4-metric, whose
+// determinant is negative
+void test_inverse_metric() {
+  mt19937 engine(42);
+  const quadratic_metric_t metric(engine);
+  const vec<double, 4> x{0.1, 0.2, -0.3, 0.4};
+  const smat<double, 4> g = metric.g(x);
+  const smat<vec<double, 4>, 4> dg = metric.dg(x);
+  const smat<smat<double, 4>, 4> ddg = metric.ddg();
+
+  const auto check = [&](const char *const name, const double detg,
+                         const smat<double, 4> &gu) {
+    const double expected_detg = calc_det(g);
+    if (!(fabs(detg - expected_detg) <= 1.0e-12 * fabs(expected_detg)))
+      CCTK_VERROR("%s: det g is %.17g, expected %.17g", name, detg,
+                  expected_detg);
+    for (int a = 0; a < 4; ++a)
+      for (int b = 0; b < 4; ++b) {
+        double found = 0;
+        for (int c = 0; c < 4; ++c)
+          found += gu(a, c) * g(c, b);
+        if (!(fabs(found - (a == b)) <= 1.0e-12))
+          CCTK_VERROR("%s: (g^-1 g)^%d_%d is %.17g", name, a, b, found);
+      }
+  };
 
-  // Test antisymmetric 4-tensors
-  {
-    mt19937 engine(42);
-    uniform_int_distribution<int> dist(-10, 10);
-    const auto rand10{[&]() { return double(dist(engine)); }};
-    const auto randamat10{[&]() {
-      array<array<double, 4>, 4> arr;
-      for (int a = 0; a < 4; ++a)
-        for (int b = 0; b < 4; ++b)
-          arr[a][b] = rand10();
-      return amat4<double, DN, DN>(
-          [&](int a, int b) { return arr[min(a, b)][max(a, b)]; });
-    }};
-
-    const amat4<double, DN, DN> Z([&](int a, int b) { return double(0); });
-
-    for (int n = 0; n < 100; ++n) {
-      const amat4<double, DN, DN> A = randamat10();
-      const amat4<double, DN, DN> B = randamat10();
-      const amat4<double, DN, DN> C = randamat10();
-      const double a = rand10();
-      const double b = rand10();
-
-      assert((A + B) + C == A + (B + C));
-      assert(Z + A == A);
-      assert(A + Z == A);
-      assert(A + (-A) == Z);
-      assert((-A) + A == Z);
-      assert(A - B == A + (-B));
-      assert(A + B == B + A);
-
-      assert(1 * A == A);
-      assert(0 * A == Z);
-      assert(-1 * A == -A);
-      assert((a * b) * A == a * (b * A));
-      assert(a * (A + B) == a * A + a * B);
-      assert((a + b) * A == a * A + b * A);
+  const weyl_vars_curvature<double> curvature(g, dg, ddg);
+  check("weyl_vars_curvature", curvature.detg, curvature.gu);
+  const weyl_vars_psi4<double> psi4(x, g, dg, ddg);
+  check("weyl_vars_psi4", psi4.detg, psi4.gu);
+}
+
+// A function of the spatial coordinates together with its first and
+// second derivatives at a point
+struct jet_t {
+  double val;
+  array<double, 3> d;
+  array<array<double, 3>, 3> dd;
+
+  static jet_t constant(const double a) {
+    jet_t r;
+    r.val = a;
+    for (int i = 0; i < 3; ++i) {
+      r.d[i] = 0;
+      for (int j = 0; j < 3; ++j)
+        r.dd[i][j] = 0;
     }
+    return r;
+  }
+  static jet_t coordinate(const double x, const int dir) {
+    jet_t r = constant(x);
+    r.d[dir] = 1;
+    return r;
   }
 
-  // Test Riemann tensors
-  {
-    mt19937 engine(42);
-    uniform_int_distribution<int> dist(-10, 10);
-    const auto rand10{[&]() { return double(dist(engine)); }};
-    const auto randrten10{[&]() {
-      array<array<array<array<double, 4>, 4>, 4>, 4> arr;
-      for (int a = 0; a < 4; ++a)
-        for (int b = 0; b < 4; ++b)
-          for (int c = 0; c < 4; ++c)
-            for (int d = 0; d < 4; ++d)
-              arr[a][b][c][d] = rand10();
-      return rten4<double, DN, DN, DN, DN>(
-          [&](int a, int b, int c, int d) { return arr[a][b][c][d]; });
-    }};
-
-    const rten4<double, DN, DN, DN, DN> Z(
-        [&](int a, int b, int c, int d) { return double(0); });
-
-    for (int n = 0; n < 100; ++n) {
-      const rten4<double, DN, DN, DN, DN> A = randrten10();
-      const rten4<double, DN, DN, DN, DN> B = randrten10();
-      const rten4<double, DN, DN, DN, DN> C = randrten10();
-      const double a = rand10();
-      const double b = rand10();
-
-      assert((A + B) + C == A + (B + C));
-      assert(Z + A == A);
-      assert(A + Z == A);
-      assert(A + (-A) == Z);
-      assert((-A) + A == Z);
-      assert(A - B == A + (-B));
-      assert(A + B == B + A);
-
-      assert(1 * A == A);
-      assert(0 * A == Z);
-      assert(-1 * A == -A);
-      assert((a * b) * A == a * (b * A));
-      assert(a * (A + B) == a * A + a * B);
-      assert((a + b) * A == a * A + b * A);
+  // Apply a function with value f, derivative df, and second
+  // derivative ddf at `val` (chain rule)
+  jet_t chain(const double f, const double df, const double ddf) const {
+    jet_t r;
+    r.val = f;
+    for (int i = 0; i < 3; ++i) {
+      r.d[i] = df * d[i];
+      for (int j = 0; j < 3; ++j)
+        r.dd[i][j] = df * dd[i][j] + ddf * d[i] * d[j];
     }
+    return r;
   }
 
-  // Test derivatives
-
-  static_assert(deriv_order % 2 == 0, "");
-  constexpr int required_ghosts = deriv_order / 2 + 1;
-  constexpr int fences = 3;
-  constexpr int vsize = tuple_size_v<simd<double> >;
-  const double eps = 1.0e-12;
-
-  // deriv
-  for (int npoints = 1; npoints <= vsize; ++npoints) {
-    for (int order = 0; order <= deriv_order; ++order) {
-      // CCTK_VINFO("Testing deriv order=%d", order);
-      array<double, 2 * (fences + required_ghosts) + vsize> arr;
-      for (size_t i = 0; i < arr.size(); ++i)
-        arr[i] = NAN;
-      double *const var = &arr[fences + required_ghosts];
-      for (int i = -deriv_order / 2; i < vsize + deriv_order / 2; ++i)
-        var[i] = pown(i, order);
-      const simd<double> expected =
-          order == 0 ? 0 : order * pown(iota<simd<double> >(), order - 1);
-      const simdl<double> mask = mask_for_loop_tail<simdl<double> >(0, npoints);
-      const simd<double> found = deriv1d(mask, var, 1, 1.0);
-      if (!(all(fabs(found - expected) <= eps || !mask)))
-        cout << "deriv:\n"
-             << "  npoints: " << npoints << "\n"
-             << "  order: " << order << "\n"
-             << "  expected: " << expected << "\n"
-             << "  found: " << found << "\n";
-      assert(all(fabs(found - expected) <= eps || !mask));
+  // The derivative in direction `dir`. Its second derivatives are
+  // unknown.
+  jet_t deriv(const int dir) const {
+    jet_t r;
+    r.val = d[dir];
+    for (int i = 0; i < 3; ++i) {
+      r.d[i] = dd[dir][i];
+      for (int j = 0; j < 3; ++j)
+        r.dd[i][j] = NAN;
     }
+    return r;
   }
 
-  // deriv (upwind)
-  for (int npoints = 1; npoints <= vsize; ++npoints) {
-    for (int order = 0; order <= deriv_order; ++order) {
-      for (int sign = 0; sign <= 1; ++sign) {
-        // CCTK_VINFO("Testing deriv (upwind) order=%d sign=%d", order, sign);
-        array<double, 2 * (fences + required_ghosts) + vsize> arr;
-        for (size_t i = 0; i < arr.size(); ++i)
-          arr[i] = NAN;
-        double *const var = &arr[fences + required_ghosts];
-        for (int i = -deriv_order / 2 - 1; i < vsize + deriv_order / 2 + 1; ++i)
-          var[i] = pown(i, order);
-        const simd<double> vel = sign ? -1 : +1;
-        const simd<double> expected =
-            vel *
-            (order == 0 ? 0 : order * pown(iota<simd<double> >(), order - 1));
-        const simdl<double> mask =
-            mask_for_loop_tail<simdl<double> >(0, npoints);
-        const simd<double> found = deriv1d_upwind(mask, var, 1, vel, 1.0);
-        if (!(all(fabs(found - expected) <= eps || !mask)))
-          cout << "deriv_upwind:\n"
-               << "  npoints: " << npoints << "\n"
-               << "  order: " << order << "\n"
-               << "  sign: " << sign << "\n"
-               << "  expected: " << expected << "\n"
-               << "  found: " << found << "\n";
-        assert(all(fabs(found - expected) <= eps || !mask));
-      }
+  friend jet_t operator+(const jet_t &a, const jet_t &b) {
+    jet_t r;
+    r.val = a.val + b.val;
+    for (int i = 0; i < 3; ++i) {
+      r.d[i] = a.d[i] + b.d[i];
+      for (int j = 0; j < 3; ++j)
+        r.dd[i][j] = a.dd[i][j] + b.dd[i][j];
     }
+    return r;
   }
-
-  // deriv2
-  for (int npoints = 1; npoints <= vsize; ++npoints) {
-    for (int order = 0; order <= deriv_order; ++order) {
-      // CCTK_VINFO("Testing deriv2 order=%d", order);
-      array<double, 2 * (fences + required_ghosts) + vsize> arr;
-      for (size_t i = 0; i < arr.size(); ++i)
-        arr[i] = NAN;
-      double *const var = &arr[fences + required_ghosts];
-      for (int i = -deriv_order / 2; i < vsize + deriv_order / 2; ++i)
-        var[i] = pown(i, order);
-      const simd<double> expected =
-          order < 2
-              ? 0
-              : order * (order - 1) * pown(iota<simd<double> >(), order - 2);
-      const simdl<double> mask = mask_for_loop_tail<simdl<double> >(0, npoints);
-      const simd<double> found = deriv2_1d(mask, var, 1, 1.0);
-      if (!(all(fabs(found - expected) <= eps || !mask)))
-        cout << "deriv_upwind:\n"
-             << "  npoints: " << npoints << "\n"
-             << "  order: " << order << "\n"
-             << "  expected: " << expected << "\n"
-             << "  found: " << found << "\n";
-      assert(all(fabs(found - expected) <= eps || !mask));
+  friend jet_t operator-(const jet_t &a) { return a.chain(-a.val, -1, 0); }
+  friend jet_t operator-(const jet_t &a, const jet_t &b) { return a + -b; }
+  friend jet_t operator*(const jet_t &a, const jet_t &b) {
+    jet_t r;
+    r.val = a.val * b.val;
+    for (int i = 0; i < 3; ++i) {
+      r.d[i] = a.d[i] * b.val + a.val * b.d[i];
+      for (int j = 0; j < 3; ++j)
+        r.dd[i][j] = a.dd[i][j] * b.val + a.d[i] * b.d[j] +
+                     a.d[j] * b.d[i] + a.val * b.dd[i][j];
     }
+    return r;
+  }
+  friend jet_t operator/(const jet_t &a, const jet_t &b) {
+    const double x = b.val;
+    return a * b.chain(1 / x, -1 / (x * x), 2 / (x * x * x));
+  }
+  friend jet_t sqrt(const jet_t &a) {
+    const double s = std::sqrt(a.val);
+    return a.chain(s, 1 / (2 * s), -1 / (4 * s * a.val));
   }
+};
+
+jet_t operator+(const jet_t &a, const double b) {
+  return a + jet_t::constant(b);
+}
+jet_t operator*(const double a, const jet_t &b) {
+  return jet_t::constant(a) * b;
+}
+jet_t operator/(const double a, const jet_t &b) {
+  return jet_t::constant(a) / b;
+}
 
-  // deriv2 (mixed)
-  for (int npoints = 1; npoints <= vsize; ++npoints) {
-    for (int orderj = 0; orderj <= deriv_order; ++orderj) {
-      for (int orderi = 0; orderi <= deriv_order; ++orderi) {
-        // CCTK_VINFO("Testing deriv2 (mixed) order=%d,%d", orderi, orderj);
-        array<array<double, 2 * (fences + required_ghosts) + vsize>,
-              2 * (fences + required_ghosts) + 1>
-            arr;
-        for (size_t j = 0; j < arr.size(); ++j)
-          for (size_t i = 0; i < arr[0].size(); ++i)
-            arr[j][i] = NAN;
-        const int di = 1;
-        const int dj = arr[0].size();
-        double *const var =
-            &arr[fences + required_ghosts][fences + required_ghosts];
-        for (int j = -deriv_order / 2; j < 1 + deriv_order / 2; ++j)
-          for (int i = -deriv_order / 2; i < vsize + deriv_order / 2; ++i)
-            var[j * dj + i * di] = pown(i, orderi) * pown(j, orderj);
-        const simd<double> expected =
-            (orderi == 0 ? 0
-                         : orderi * pown(iota<simd<double> >(), orderi - 1)) *
-            (orderj == 0 ? 0 : orderj * pown(0.0, orderj - 1));
-        const simdl<double> mask =
-            mask_for_loop_tail<simdl<double> >(0, npoints);
-        const simd<double> found =
-            deriv2_2d(npoints, mask, var, di, dj, 1.0, 1.0);
-        if (!(all(fabs(found - expected) <= eps || !mask)))
-          cout << "deriv2_mixed:\n"
-               << "  npoints: " << npoints << "\n"
-               << "  orderi: " << orderi << "\n"
-               << "  orderj: " << orderj << "\n"
-               << "  expected: " << expected << "\n"
-               << "  found: " << found << "\n";
-        assert(all(fabs(found - expected) <= eps || !mask));
+// Psi4 from the 3+1 variables must agree with Psi4 from the 4-metric
+// in vacuum. The test uses the Kerr metric in Kerr-Schild coordinates,
+// which is stationary, and whose derivatives are calculated exactly.
+void test_psi4_3p1() {
+  const double M = 1.0, a = 0.6;
+  const array<array<double, 3>, 3> points{{
+      {3.0, 1.5, 2.0},
+      {-2.5, 3.5, -1.0},
+      {1.0, -4.0, 0.5},
+  }};
+
+  for (const auto &point : points) {
+    const jet_t x = jet_t::coordinate(point[0], 0);
+    const jet_t y = jet_t::coordinate(point[1], 1);
+    const jet_t z = jet_t::coordinate(point[2], 2);
+
+    // Kerr-Schild form g_ab = eta_ab + 2 H l_a l_b
+    const jet_t rho2 = x * x + y * y + z * z;
+    const jet_t w = rho2 + -a * a;
+    const jet_t r2 = 0.5 * w + sqrt(0.25 * w * w + a * a * z * z);
+    const jet_t r = sqrt(r2);
+    const jet_t H = M * r * r2 / (r2 * r2 + a * a * z * z);
+    const array<jet_t, 4> l{jet_t::constant(1),
+                            (r * x + a * y) / (r2 + a * a),
+                            (r * y - a * x) / (r2 + a * a), z / r};
+    const auto g4 = [&](const int i, const int j) {
+      const double eta = i != j ? 0 : i == 0 ? -1 : 1;
+      return 2 * H * l[i] * l[j] + eta;
+    };
+
+    // Psi4 from the 4-metric; all time derivatives vanish
+    const vec<double, 4> coord4{0, point[0], point[1], point[2]};
+    const smat<double, 4> g([&](int i, int j) { return g4(i, j).val; });
+    const smat<vec<double, 4>, 4> dg([&](int i, int j) {
+      const jet_t gij = g4(i, j);
+      return vec<double, 4>([&](int k) { return k == 0 ? 0 : gij.d[k - 1]; });
+    });
+    const smat<smat<double, 4>, 4> ddg([&](int i, int j) {
+      const jet_t gij = g4(i, j);
+      return smat<double, 4>([&](int k, int m) {
+        return k == 0 || m == 0 ? 0 : gij.dd[k - 1][m - 1];
+      });
+    });
+    const weyl_vars_psi4<double> vars4(coord4, g, dg, ddg);
+
+    // 3+1 variables: gamma_ij = g_ij, beta_i = g_0i, alpha^2 =
+    // 1 / (1 + 2 H), and K_ij = (D_i beta_j + D_j beta_i) / (2 alpha)
+    // since the metric is stationary
+    const auto gamma = [&](const int i, const int j) {
+      return g4(i + 1, j + 1);
+    };
+    const auto beta = [&](const int i) { return g4(0, i + 1); };
+    const jet_t alpha = 1.0 / sqrt(2 * H + 1);
+    const auto cofactor = [&](const int i, const int j) {
+      const int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+      const int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+      return gamma(i1, j1) * gamma(i2, j2) - gamma(i1, j2) * gamma(i2, j1);
+    };
+    const jet_t detgamma = gamma(0, 0) * cofactor(0, 0) +
+                           gamma(0, 1) * cofactor(0, 1) +
+                           gamma(0, 2) * cofactor(0, 2);
+    const auto gammau = [&](const int i, const int j) {
+      return cofactor(j, i) / detgamma;
+    };
+    const auto Gamma = [&](const int k, const int i, const int j) {
+      jet_t r = jet_t::constant(0);
+      for (int m = 0; m < 3; ++m)
+        r = r + 0.5 * gammau(k, m) *
+                    (gamma(m, i).deriv(j) + gamma(m, j).deriv(i) -
+                     gamma(i, j).deriv(m));
+      return r;
+    };
+    const auto Dbeta = [&](const int i, const int j) {
+      jet_t r = beta(j).deriv(i);
+      for (int k = 0; k < 3; ++k)
+        r = r - Gamma(k, i, j) * beta(k);
+      return r;
+    };
+    const auto K = [&](const int i, const int j) {
+      return 0.5 * (Dbeta(i, j) + Dbeta(j, i)) / alpha;
+    };
+
+    const vec<double, 3> coord3{point[0], point[1], point[2]};
+    array<array<jet_t, 3>, 3> gamma3, K3;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j) {
+        gamma3[i][j] = gamma(i, j);
+        K3[i][j] = K(i, j);
       }
-    }
+    const weyl_vars_psi4_3p1<double> vars3p1(
+        coord3, smat<double, 3>([&](int i, int j) { return gamma3[i][j].val; }),
+        smat<double, 3>([&](int i, int j) { return K3[i][j].val; }),
+        smat<vec<double, 3>, 3>([&](int i, int j) {
+          return vec<double, 3>([&](int k) { return gamma3[i][j].d[k]; });
+        }),
+        smat<smat<double, 3>, 3>([&](int i, int j) {
+          return smat<double, 3>(
+              [&](int k, int m) { return gamma3[i][j].dd[k][m]; });
+        }),
+        smat<vec<double, 3>, 3>([&](int i, int j) {
+          return vec<double, 3>([&](int k) { return K3[i][j].d[k]; });
+        }));
+
+    const cplx<double> Psi4 = vars4.Psi4;
+    const cplx<double> Psi4_3p1 = vars3p1.Psi4;
+    const double scale = sqrt(pow2(real(Psi4)) + pow2(imag(Psi4)));
+    const double error = sqrt(pow2(real(Psi4_3p1) - real(Psi4)) +
+                              pow2(imag(Psi4_3p1) - imag(Psi4)));
+    if (!(scale > 0 && error <= 1.0e-10 * scale))
+      CCTK_VERROR("Psi4 at (%g,%g,%g): the 3+1 kernel gives %.17g%+.17gi, "
+                  "the 4-metric kernel gives %.17g%+.17gi",
+                  point[0], point[1], point[2], real(Psi4_3p1),
+                  imag(Psi4_3p1), real(Psi4), imag(Psi4));
   }
 }
 
+} // namespace
+
+extern "C" void Weyl_Test(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS;
+
+#ifndef __CUDACC__
+  test_dgammal();
+  test_inverse_metric();
+  test_psi4_3p1();
+#endif
+}
+
 } // namespace Weyl
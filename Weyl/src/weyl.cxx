@@ -23,9 +23,13 @@
 
 #include <cctk.h>
 #include <cctk_Arguments.h>
+#include <cctk_Functions.h>
 #include <cctk_Parameters.h>
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
+#include <vector>
 
 namespace Weyl {
 using namespace Arith;
@@ -60,8 +64,8 @@ inline vect<int, dim> box_int_imax(const GridDescBase &grid,
     return GF3D5<TYPE>(layout5, NAME);                                         \
   }())
 
-gfs_t::gfs_t(const cGH *const cctkGH)
-    : cctkGH(cctkGH),
+gfs_t::gfs_t(const cGH *const cctkGH, const mode_t mode, const bool fused)
+    : cctkGH(cctkGH), mode(mode), fused(fused),
       //
       indextype{0, 0, 0}, nghostzones{cctkGH->cctk_nghostzones[0],
                                       cctkGH->cctk_nghostzones[1],
@@ -83,9 +87,9 @@ gfs_t::gfs_t(const cGH *const cctkGH)
       gf_dtbeta1{GETVAR2(const CCTK_REAL, dtbetax),
                  GETVAR2(const CCTK_REAL, dtbetay),
                  GETVAR2(const CCTK_REAL, dtbetaz)},
-      gf_dtK1{GETVAR2(const CCTK_REAL, kxx), GETVAR2(const CCTK_REAL, kxy),
-              GETVAR2(const CCTK_REAL, kxz), GETVAR2(const CCTK_REAL, kyy),
-              GETVAR2(const CCTK_REAL, kyz), GETVAR2(const CCTK_REAL, kzz)},
+      gf_dtK1{GETVAR2(const CCTK_REAL, dtkxx), GETVAR2(const CCTK_REAL, dtkxy),
+              GETVAR2(const CCTK_REAL, dtkxz), GETVAR2(const CCTK_REAL, dtkyy),
+              GETVAR2(const CCTK_REAL, dtkyz), GETVAR2(const CCTK_REAL, dtkzz)},
       gf_dt2alpha1(GETVAR2(const CCTK_REAL, dt2alp)),
       gf_dt2beta1{GETVAR2(const CCTK_REAL, dt2betax),
                   GETVAR2(const CCTK_REAL, dt2betay),
@@ -102,26 +106,37 @@ gfs_t::gfs_t(const cGH *const cctkGH)
       gf_Psi4re5(GETVAR5(CCTK_REAL, Psi4re)),
       gf_Psi4im5(GETVAR5(CCTK_REAL, Psi4im)),
       //
-      nvars(371), ivar(0), vars(layout0, nvars),
+      nvars(use_curvature_tiles() ? 371
+            : use_metric4_tiles() ? 300
+            : use_metric4()       ? 150
+                                  : 84),
+      ivar(0),
+      vars(std::size_t(nvars) * layout0.np),
       //
-      gf_alpha0(make_gf()), gf_dalpha0(make_vec_gf()),
-      gf_ddalpha0(make_mat_gf()), gf_beta0(make_vec_gf()),
-      gf_dbeta0(make_vec_vec_gf()), gf_ddbeta0(make_vec_mat_gf()),
-      gf_gamma0(make_mat_gf()), gf_dgamma0(make_mat_vec_gf()),
-      gf_ddgamma0(make_mat_mat_gf()), gf_K0(make_mat_gf()),
-      gf_dK0(make_mat_vec_gf()),
+      gf_alpha0(make_gf(use_metric4())), gf_dalpha0(make_vec_gf(use_metric4())),
+      gf_ddalpha0(make_mat_gf(use_metric4())),
+      gf_beta0(make_vec_gf(use_metric4())),
+      gf_dbeta0(make_vec_vec_gf(use_metric4())),
+      gf_ddbeta0(make_vec_mat_gf(use_metric4())), gf_gamma0(make_mat_gf()),
+      gf_dgamma0(make_mat_vec_gf()), gf_ddgamma0(make_mat_mat_gf()),
+      gf_K0(make_mat_gf()), gf_dK0(make_mat_vec_gf()),
       //
-      gf_dtalpha0(make_gf()), gf_ddtalpha0(make_vec_gf()),
-      gf_dtbeta0(make_vec_gf()), gf_ddtbeta0(make_vec_vec_gf()),
-      gf_dtK0(make_mat_gf()),
+      gf_dtalpha0(make_gf(use_metric4())),
+      gf_ddtalpha0(make_vec_gf(use_metric4())),
+      gf_dtbeta0(make_vec_gf(use_metric4())),
+      gf_ddtbeta0(make_vec_vec_gf(use_metric4())),
+      gf_dtK0(make_mat_gf(use_metric4())),
       //
-      gf_dt2alpha0(make_gf()), gf_dt2beta0(make_vec_gf()),
+      gf_dt2alpha0(make_gf(use_metric4())),
+      gf_dt2beta0(make_vec_gf(use_metric4())),
       // Intermediate variables: 4-metric
-      tile_g4(make_mat4_gf()), tile_dg4(make_mat4_vec4_gf()),
-      tile_ddg4(make_mat4_mat4_gf()),
+      tile_g4(make_mat4_gf(use_metric4_tiles())),
+      tile_dg4(make_mat4_vec4_gf(use_metric4_tiles())),
+      tile_ddg4(make_mat4_mat4_gf(use_metric4_tiles())),
       // Intermediate variables: 4-curvature
-      tile_Gamma4(make_vec4_mat4_gf()), tile_R4(make_mat4_gf()),
-      tile_C4(make_rten4_gf())
+      tile_Gamma4(make_vec4_mat4_gf(use_curvature_tiles())),
+      tile_R4(make_mat4_gf(use_curvature_tiles())),
+      tile_C4(make_rten4_gf(use_curvature_tiles()))
 //
 {
   if (ivar != nvars)
@@ -129,10 +144,38 @@ gfs_t::gfs_t(const cGH *const cctkGH)
                 "these. Update the definition of `nvars`.",
                 nvars, ivar);
 
-  calc_derivs2(cctkGH, gf_alpha1, gf_alpha0, gf_dalpha0, gf_ddalpha0, layout0);
-  calc_derivs2(cctkGH, gf_beta1, gf_beta0, gf_dbeta0, gf_ddbeta0, layout0);
-  calc_derivs2(cctkGH, gf_gamma1, gf_gamma0, gf_dgamma0, gf_ddgamma0, layout0);
-  calc_derivs(cctkGH, gf_K1, gf_K0, gf_dK0, layout0);
+  const bool have_adm_derivs = get_adm_derivs();
+
+  if (!use_metric4()) {
+    if (have_adm_derivs)
+      return;
+
+    // Read 12 ADM variables, write 84 derivatives
+    static const kernel_t kernel{"Weyl derivatives (3+1)", 0, 96 * 8};
+    const kernel_timer_t timer(kernel, prod(imax - imin));
+
+    calc_derivs2(cctkGH, gf_gamma1, gf_gamma0, gf_dgamma0, gf_ddgamma0,
+                 layout0);
+    calc_derivs(cctkGH, gf_K1, gf_K0, gf_dK0, layout0);
+    return;
+  }
+
+  if (!have_adm_derivs) {
+    // Read 16 ADM variables, write 124 derivatives
+    static const kernel_t kernel{"Weyl derivatives", 0, 140 * 8};
+    const kernel_timer_t timer(kernel, prod(imax - imin));
+
+    calc_derivs2(cctkGH, gf_alpha1, gf_alpha0, gf_dalpha0, gf_ddalpha0,
+                 layout0);
+    calc_derivs2(cctkGH, gf_beta1, gf_beta0, gf_dbeta0, gf_ddbeta0, layout0);
+    calc_derivs2(cctkGH, gf_gamma1, gf_gamma0, gf_dgamma0, gf_ddgamma0,
+                 layout0);
+    calc_derivs(cctkGH, gf_K1, gf_K0, gf_dK0, layout0);
+  }
+
+  // Read 14 time derivatives of the ADM variables, write 26 derivatives
+  static const kernel_t kernel{"Weyl time derivatives", 0, 40 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
 
   calc_derivs(cctkGH, gf_dtalpha1, gf_dtalpha0, gf_ddtalpha0, layout0);
   calc_derivs(cctkGH, gf_dtbeta1, gf_dtbeta0, gf_ddtbeta0, layout0);
@@ -142,9 +185,100 @@ gfs_t::gfs_t(const cGH *const cctkGH)
   calc_copy(cctkGH, gf_dt2beta1, gf_dt2beta0, layout0);
 }
 
+bool gfs_t::get_adm_derivs() const {
+  DECLARE_CCTK_PARAMETERS;
+
+  if (!use_evolution_derivs)
+    return false;
+  if (!CCTK_IsFunctionAliased("GetADMDerivatives"))
+    CCTK_ERROR("Weyl::use_evolution_derivs is set, but no active thorn "
+               "provides the function GetADMDerivatives");
+
+  // The lapse, shift, 3-metric, and extrinsic curvature and their
+  // derivatives are the first temporaries, allocated in the order that
+  // GetADMDerivatives expects. Without the 4-metric the lapse and shift
+  // are not needed.
+  constexpr int ngauge = 40, nadm = 124;
+  const int ioffset = use_metric4() ? 0 : ngauge;
+  std::array<CCTK_POINTER, nadm> ptrs;
+  for (int n = 0; n < nadm; ++n)
+    ptrs[n] = n < ioffset ? nullptr
+                          : vars.data() + std::size_t(n - ioffset) * layout0.np;
+
+  const std::array<CCTK_INT, dim> imin1{imin[0], imin[1], imin[2]};
+  const std::array<CCTK_INT, dim> imax1{imax[0], imax[1], imax[2]};
+  return GetADMDerivatives(cctkGH, imin1.data(), imax1.data(), ptrs.data()) ==
+         0;
+}
+
 #undef GETVAR2
 #undef GETVAR5
 
+namespace {
+// Run the staged kernels after the fused kernels and compare the Weyl
+// scalars. Both evaluate the same weyl_vars expressions and differ only
+// in which intermediate results pass through memory, so they must agree
+// to round-off.
+void check_fused(const cGH *const cctkGH, const gfs_t::mode_t mode) {
+#ifdef __CUDACC__
+  CCTK_ERROR("Weyl::check_fused_kernel is not supported on GPUs");
+#else
+  DECLARE_CCTK_ARGUMENTS_Weyl_Weyl;
+
+  const bool all_scalars = mode == gfs_t::mode_t::all_scalars;
+  std::vector<std::pair<const char *, const CCTK_REAL *> > vars;
+  if (all_scalars)
+    vars = {{"Psi0re", Psi0re}, {"Psi0im", Psi0im}, {"Psi1re", Psi1re},
+            {"Psi1im", Psi1im}, {"Psi2re", Psi2re}, {"Psi2im", Psi2im},
+            {"Psi3re", Psi3re}, {"Psi3im", Psi3im}};
+  vars.push_back({"Psi4re", Psi4re});
+  vars.push_back({"Psi4im", Psi4im});
+
+  const std::size_t np = std::size_t(cctk_ash[0]) * cctk_ash[1] * cctk_ash[2];
+  std::vector<std::vector<CCTK_REAL> > fused_vals;
+  for (const auto &var : vars)
+    fused_vals.emplace_back(var.second, var.second + np);
+
+  {
+    const gfs_t gfs(cctkGH, mode, false);
+    gfs.calc_metric();
+    if (all_scalars) {
+      gfs.calc_curvature();
+      gfs.calc_scalars();
+    } else {
+      gfs.calc_psi4();
+    }
+  }
+
+  const std::array<int, dim> indextype{0, 0, 0};
+  const GF3D2layout layout1(cctkGH, indextype);
+  const GridDescBase grid(cctkGH);
+  for (std::size_t n = 0; n < vars.size(); ++n) {
+    const GF3D2<const CCTK_REAL> gf_fused(layout1, fused_vals[n].data());
+    const GF3D2<const CCTK_REAL> gf_staged(layout1, vars[n].second);
+    CCTK_REAL maxabs = 0, maxdiff = 0;
+    grid.loop_int<0, 0, 0>(grid.nghostzones, [&](const PointDesc &p) {
+      maxabs = max(maxabs, fabs(gf_staged(p.I)));
+      maxdiff = max(maxdiff, fabs(gf_fused(p.I) - gf_staged(p.I)));
+    });
+    if (!(maxdiff <= 1.0e-10 * maxabs))
+      CCTK_VERROR("The fused and staged kernels disagree for %s: "
+                  "max |difference| = %g, max |value| = %g",
+                  vars[n].first, double(maxdiff), double(maxabs));
+  }
+#endif
+}
+} // namespace
+
+extern "C" void Weyl_SelectWeyl(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Weyl_SelectWeyl;
+  DECLARE_CCTK_PARAMETERS;
+
+  // The Weyl scalars remain invalid in other iterations. The evolution
+  // thorn may skip the ADM variables there (see Z4c::calc_ADM_vars_every).
+  *Weyl_needed = cctk_iteration % calc_every == 0;
+}
+
 extern "C" void Weyl_Weyl(CCTK_ARGUMENTS) {
   DECLARE_CCTK_ARGUMENTS_Weyl_Weyl;
   DECLARE_CCTK_PARAMETERS;
@@ -165,10 +299,38 @@ extern "C" void Weyl_Weyl(CCTK_ARGUMENTS) {
     assert(np > 0);
   }
 
-  const gfs_t gfs(cctkGH);
-  gfs.calc_metric();
-  gfs.calc_curvature();
-  gfs.calc_scalars();
+  gfs_t::mode_t mode = gfs_t::mode_t::all_scalars;
+  if (calc_psi4_only)
+    mode = CCTK_EQUALS(psi4_method, "3+1") ? gfs_t::mode_t::psi4_3p1
+                                           : gfs_t::mode_t::psi4;
+
+  const gfs_t gfs(cctkGH, mode, fused_kernel);
+  switch (mode) {
+  case gfs_t::mode_t::all_scalars:
+    if (fused_kernel) {
+      gfs.calc_scalars_fused();
+      if (check_fused_kernel)
+        check_fused(cctkGH, mode);
+    } else {
+      gfs.calc_metric();
+      gfs.calc_curvature();
+      gfs.calc_scalars();
+    }
+    break;
+  case gfs_t::mode_t::psi4:
+    if (fused_kernel) {
+      gfs.calc_psi4_fused();
+      if (check_fused_kernel)
+        check_fused(cctkGH, mode);
+    } else {
+      gfs.calc_metric();
+      gfs.calc_psi4();
+    }
+    break;
+  case gfs_t::mode_t::psi4_3p1:
+    gfs.calc_psi4_3p1();
+    break;
+  }
 }
 
 } // namespace Weyl
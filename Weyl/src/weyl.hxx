@@ -4,6 +4,8 @@
 #include <loop_device.hxx>
 #include <mat.hxx>
 #include <rten.hxx>
+#include <scratch.hxx>
+#include <timers.hxx>
 #include <vec.hxx>
 #include <vect.hxx>
 
@@ -15,11 +17,24 @@
 namespace Weyl {
 using namespace Arith;
 using namespace Loop;
+using namespace SpacetimeUtils;
 
 struct gfs_t {
 
   const cGH *restrict cctkGH;
 
+  // What to calculate
+  enum class mode_t {
+    all_scalars, // all Weyl scalars from the 4-metric
+    psi4,        // only Psi4 from the 4-metric
+    psi4_3p1     // only Psi4 from the 3+1 variables
+  };
+  mode_t mode;
+
+  // Calculate in a single pass, without storing the 4-metric and the
+  // 4-curvature in intermediate tiles
+  bool fused;
+
   std::array<int, dim> indextype;
   std::array<int, dim> nghostzones;
   GridDescBaseDevice grid;
@@ -60,11 +75,16 @@ struct gfs_t {
   GF3D5<CCTK_REAL> gf_Psi4im5;
 
 private:
+  bool use_metric4() const { return mode != mode_t::psi4_3p1; }
+  bool use_curvature() const { return mode == mode_t::all_scalars; }
+  bool use_metric4_tiles() const { return use_metric4() && !fused; }
+  bool use_curvature_tiles() const { return use_curvature() && !fused; }
+
   // Temporary variables
 
   int nvars;
   mutable int ivar;
-  GF3D5vector<CCTK_REAL> vars;
+  scratch_t vars;
 
   template <typename F, typename R = std::result_of_t<F()> >
   static auto make_vec(const F &f) {
@@ -87,45 +107,54 @@ private:
     return rten<R, 4>([&](int, int, int, int) { return f(); });
   }
 
-  auto make_gf() const { return GF3D5<CCTK_REAL>(vars(ivar++)); }
-  auto make_vec_gf() const {
-    return make_vec([&]() { return make_gf(); });
+  // Temporaries that are not needed are not allocated
+  auto make_gf(const bool needed = true) const {
+    if (!needed)
+      return GF3D5<CCTK_REAL>(layout0, nullptr);
+    return GF3D5<CCTK_REAL>(layout0, vars.data() + ivar++ * layout0.np);
   }
-  auto make_mat_gf() const {
-    return make_mat([&]() { return make_gf(); });
+  auto make_vec_gf(const bool needed = true) const {
+    return make_vec([&]() { return make_gf(needed); });
   }
-  auto make_vec_vec_gf() const {
-    return make_vec([&]() { return make_vec_gf(); });
+  auto make_mat_gf(const bool needed = true) const {
+    return make_mat([&]() { return make_gf(needed); });
   }
-  auto make_vec_mat_gf() const {
-    return make_vec([&]() { return make_mat_gf(); });
+  auto make_vec_vec_gf(const bool needed = true) const {
+    return make_vec([&]() { return make_vec_gf(needed); });
   }
-  auto make_mat_vec_gf() const {
-    return make_mat([&]() { return make_vec_gf(); });
+  auto make_vec_mat_gf(const bool needed = true) const {
+    return make_vec([&]() { return make_mat_gf(needed); });
   }
-  auto make_mat_mat_gf() const {
-    return make_mat([&]() { return make_mat_gf(); });
+  auto make_mat_vec_gf(const bool needed = true) const {
+    return make_mat([&]() { return make_vec_gf(needed); });
+  }
+  auto make_mat_mat_gf(const bool needed = true) const {
+    return make_mat([&]() { return make_mat_gf(needed); });
   }
 
-  auto make_vec4_gf() const {
-    return make_vec4([&]() { return make_gf(); });
+  auto make_vec4_gf(const bool needed = true) const {
+    return make_vec4([&]() { return make_gf(needed); });
   }
-  auto make_mat4_gf() const {
-    return make_mat4([&]() { return make_gf(); });
+  auto make_mat4_gf(const bool needed = true) const {
+    return make_mat4([&]() { return make_gf(needed); });
   }
-  auto make_rten4_gf() const {
-    return make_rten4([&]() { return make_gf(); });
+  auto make_rten4_gf(const bool needed = true) const {
+    return make_rten4([&]() { return make_gf(needed); });
   }
-  auto make_vec4_mat4_gf() const {
-    return make_vec4([&]() { return make_mat4_gf(); });
+  auto make_vec4_mat4_gf(const bool needed = true) const {
+    return make_vec4([&]() { return make_mat4_gf(needed); });
   }
-  auto make_mat4_vec4_gf() const {
-    return make_mat4([&]() { return make_vec4_gf(); });
+  auto make_mat4_vec4_gf(const bool needed = true) const {
+    return make_mat4([&]() { return make_vec4_gf(needed); });
   }
-  auto make_mat4_mat4_gf() const {
-    return make_mat4([&]() { return make_mat4_gf(); });
+  auto make_mat4_mat4_gf(const bool needed = true) const {
+    return make_mat4([&]() { return make_mat4_gf(needed); });
   }
 
+  // Obtain the derivatives of the ADM variables from the evolution
+  // thorn; returns false if they are not available
+  bool get_adm_derivs() const;
+
 public:
   // Input variables: ADM variables
 
@@ -176,11 +205,18 @@ public:
   gfs_t &operator=(const gfs_t &) = delete;
   gfs_t &operator=(gfs_t &&) = delete;
 
-  gfs_t(const cGH *cctkGH);
+  gfs_t(const cGH *cctkGH, mode_t mode, bool fused);
 
   void calc_metric() const;
   void calc_curvature() const;
   void calc_scalars() const;
+  void calc_psi4() const;
+  void calc_psi4_3p1() const;
+
+  // Fused kernels, equivalent to calc_metric followed by calc_curvature
+  // and calc_scalars, or by calc_psi4
+  void calc_scalars_fused() const;
+  void calc_psi4_fused() const;
 };
 
 } // namespace Weyl
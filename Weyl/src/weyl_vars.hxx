@@ -362,8 +362,9 @@ template <typename T> struct weyl_vars_curvature {
                       const smat<smat<T, 4>, 4> &ddg)
       : g(g), dg(dg), ddg(ddg),
         //
-        detg(min(1.0e+6, max(1.0e-6, calc_det(g)))), //
-        gu(calc_inv(g, detg)),                       //
+        // The determinant of the 4-metric is negative
+        detg(-min(1.0e+6, max(1.0e-6, -calc_det(g)))), //
+        gu(calc_inv(g, detg)),                         //
         //
         dgu(calc_dgu(gu, dg)),
         //
@@ -572,6 +573,259 @@ template <typename T> struct weyl_vars_scalars {
   {}
 };
 
+// Calculate only Psi4. This skips the Ricci tensor, the Weyl tensor,
+// and all other Newman-Penrose scalars.
+template <typename T> struct weyl_vars_psi4 {
+
+  // Position
+  const vec<T, 4> coord;
+
+  // 4-metric
+  const smat<T, 4> g;
+
+  // Derivatives of 4-metric
+  const smat<vec<T, 4>, 4> dg;
+  const smat<smat<T, 4>, 4> ddg;
+
+  // Inverse 4-metric
+  const T detg;
+  const smat<T, 4> gu;
+
+  // Derivative of inverse of 4-metric
+  const smat<vec<T, 4>, 4> dgu;
+
+  // Christoffel symbol
+  const vec<smat<T, 4>, 4> Gammal;
+  const vec<smat<T, 4>, 4> Gamma;
+
+  const vec<smat<vec<T, 4>, 4>, 4> dGammal;
+  const vec<smat<vec<T, 4>, 4>, 4> dGamma;
+
+  // Riemann
+  const rten<T, 4> Rm;
+
+  // Tetrad
+  const vec<T, 4> et, ephi, etheta, er;
+  const vec<T, 4> n;
+  const vec<cplx<T>, 4> m;
+
+  // Index pairs a < b of antisymmetric tensors
+  static constexpr ARITH_INLINE ARITH_DEVICE ARITH_HOST int pair_a(int p) {
+    return p < 3 ? 0 : p < 5 ? 1 : 2;
+  }
+  static constexpr ARITH_INLINE ARITH_DEVICE ARITH_HOST int pair_b(int p) {
+    return p < 3 ? p + 1 : p < 5 ? p - 1 : 3;
+  }
+
+  // Bivector mbar^a n^b - mbar^b n^a, indexed by pairs
+  const vec<cplx<T>, 6> mbarn;
+
+  // Weyl scalar
+  const cplx<T> Psi4;
+
+  inline ARITH_INLINE ARITH_DEVICE ARITH_HOST
+  weyl_vars_psi4(const vec<T, 4> &coord, const smat<T, 4> &g,
+                 const smat<vec<T, 4>, 4> &dg, const smat<smat<T, 4>, 4> &ddg)
+      : coord(coord), g(g), dg(dg), ddg(ddg),
+        //
+        // The tetrad is constructed with the same (bounded) inverse
+        // metric as the curvature. This differs from
+        // `weyl_vars_scalars` only where the metric is degenerate.
+        detg(-min(1.0e+6, max(1.0e-6, -calc_det(g)))), //
+        gu(calc_inv(g, detg)),                         //
+        //
+        dgu(calc_dgu(gu, dg)),
+        //
+        Gammal(calc_gammal(dg)),       //
+        Gamma(calc_gamma(gu, Gammal)), //
+        //
+        dGammal(calc_dgammal(ddg)),                    //
+        dGamma(calc_dgamma(gu, dgu, Gammal, dGammal)), //
+        //
+        Rm(calc_riemann(g, Gamma, dGamma)), //
+        //
+        et(calc_et(gu)),                     //
+        ephi(calc_ephi(coord, g)),           //
+        etheta(calc_etheta(coord, g, ephi)), //
+        er(calc_er(coord, g, etheta, ephi)), //
+        n([&](int a) ARITH_INLINE { return (et(a) - er(a)) / sqrt(T(2)); }),
+        m([&](int a) ARITH_INLINE {
+          return cplx<T>(etheta(a), ephi(a)) / sqrt(T(2));
+        }),
+        //
+        mbarn([&](int p) ARITH_INLINE {
+          const int a = pair_a(p), b = pair_b(p);
+          return conj(m(a)) * n(b) - conj(m(b)) * n(a);
+        }),
+        //
+        // Psi4 = C_abcd mbar^a n^b mbar^c n^d. The tetrad vector mbar
+        // is null and orthogonal to n, so that the trace terms of the
+        // Weyl tensor contribute only R_ab mbar^a mbar^b n^c n_c, which
+        // vanishes in vacuum. We contract the Riemann tensor instead.
+        // Its antisymmetry reduces the sum to the 6 x 6 independent
+        // index pairs.
+        Psi4(sum<6>([&](int p) ARITH_INLINE {
+          return mbarn(p) * sum<6>([&](int q) ARITH_INLINE {
+                   return Rm(pair_a(p), pair_b(p), pair_a(q), pair_b(q)) *
+                          mbarn(q);
+                 });
+        }))
+  //
+  {}
+};
+
+// Calculate Psi4 from the 3+1 variables via the electric and magnetic
+// parts of the Weyl tensor. This assumes vacuum. It needs only the
+// 3-metric and the extrinsic curvature with their spatial derivatives,
+// but not the lapse, the shift, or any time derivatives.
+template <typename T> struct weyl_vars_psi4_3p1 {
+
+  // Position
+  const vec<T, 3> coord;
+
+  // ADM variables
+  const smat<T, 3> gamma;
+  const smat<T, 3> K;
+
+  // Spatial derivatives of ADM variables
+  const smat<vec<T, 3>, 3> dgamma;
+  const smat<smat<T, 3>, 3> ddgamma;
+  const smat<vec<T, 3>, 3> dK;
+
+  // Inverse 3-metric
+  const T detgamma;
+  const smat<T, 3> gammau;
+
+  // Derivative of inverse of 3-metric
+  const smat<vec<T, 3>, 3> dgammau;
+
+  // Christoffel symbol
+  const vec<smat<T, 3>, 3> Gammal;
+  const vec<smat<T, 3>, 3> Gamma;
+
+  const vec<smat<vec<T, 3>, 3>, 3> dGammal;
+  const vec<smat<vec<T, 3>, 3>, 3> dGamma;
+
+  // Ricci tensor
+  const smat<T, 3> R;
+
+  // Covariant derivative of the extrinsic curvature, D_k K_ij
+  const smat<vec<T, 3>, 3> DK;
+
+  // Electric part E_ij and magnetic part B_i^j of the Weyl tensor
+  const T trK;
+  const smat<T, 3> E;
+  const vec<vec<T, 3>, 3> B;
+
+  // Tetrad
+  const vec<T, 3> ephi, etheta, er;
+  const vec<cplx<T>, 3> m;
+
+  // Tetrad projections
+  const T er2, Krr;
+  const cplx<T> Kmr, Kmm;
+  const vec<cplx<T>, 3> mxr; // epsilon_ijk mbar^j er^k
+
+  // Weyl scalar
+  const cplx<T> Psi4;
+
+  inline ARITH_INLINE ARITH_DEVICE ARITH_HOST weyl_vars_psi4_3p1(
+      const vec<T, 3> &coord, const smat<T, 3> &gamma, const smat<T, 3> &K,
+      const smat<vec<T, 3>, 3> &dgamma, const smat<smat<T, 3>, 3> &ddgamma,
+      const smat<vec<T, 3>, 3> &dK)
+      : coord(coord), gamma(gamma), K(K), dgamma(dgamma), ddgamma(ddgamma),
+        dK(dK),
+        //
+        detgamma(calc_det(gamma)),         //
+        gammau(calc_inv(gamma, detgamma)), //
+        //
+        dgammau(calc_dgu(gammau, dgamma)),
+        //
+        Gammal(calc_gammal(dgamma)),       //
+        Gamma(calc_gamma(gammau, Gammal)), //
+        //
+        dGammal(calc_dgammal(ddgamma)), //
+        dGamma(calc_dgamma(gammau, dgammau, Gammal, dGammal)),
+        //
+        // R_ab = Gamma^x_ab,x - Gamma^x_ax,b
+        //        + Gamma^x_xy Gamma^y_ab - Gamma^x_by Gamma^y_ax
+        R([&](int a, int b) ARITH_INLINE {
+          return sum<3>([&](int x) ARITH_INLINE {
+            return dGamma(x)(a, b)(x) - dGamma(x)(a, x)(b) +
+                   sum<3>([&](int y) ARITH_INLINE {
+                     return Gamma(x)(x, y) * Gamma(y)(a, b) -
+                            Gamma(x)(b, y) * Gamma(y)(a, x);
+                   });
+          });
+        }),
+        //
+        DK([&](int a, int b) ARITH_INLINE {
+          return vec<T, 3>([&](int c) ARITH_INLINE {
+            return dK(a, b)(c) - sum<3>([&](int x) ARITH_INLINE {
+                     return Gamma(x)(c, a) * K(x, b) + Gamma(x)(c, b) * K(a, x);
+                   });
+          });
+        }),
+        //
+        // In vacuum, E_ab = R_ab + K K_ab - K_ax K^x_b (Gauss and
+        // Ricci equations), and B_a^b = epsilon^bxy D_x K_ya (Codazzi
+        // equation)
+        trK(calc_trace(K, gammau)), //
+        E([&](int a, int b) ARITH_INLINE {
+          return R(a, b) + trK * K(a, b) - sum<3>([&](int x) ARITH_INLINE {
+                   return K(a, x) * sum<3>([&](int y) ARITH_INLINE {
+                            return gammau(x, y) * K(y, b);
+                          });
+                 });
+        }),
+        B([&](int a) ARITH_INLINE {
+          return vec<T, 3>([&](int b) ARITH_INLINE {
+            const int x = (b + 1) % 3, y = (b + 2) % 3;
+            return (DK(y, a)(x) - DK(x, a)(y)) / sqrt(detgamma);
+          });
+        }),
+        //
+        ephi(calc_ephi(coord, gamma)),           //
+        etheta(calc_etheta(coord, gamma, ephi)), //
+        er(calc_er(coord, gamma, etheta, ephi)), //
+        m([&](int a) ARITH_INLINE {
+          return cplx<T>(etheta(a), ephi(a)) / sqrt(T(2));
+        }),
+        //
+        er2(sum_symm<3>([&](int a, int b) ARITH_INLINE {
+          return gamma(a, b) * er(a) * er(b);
+        })),
+        Krr(sum_symm<3>([&](int a, int b) ARITH_INLINE {
+          return K(a, b) * er(a) * er(b);
+        })),
+        Kmr(sum<3>([&](int a, int b) ARITH_INLINE {
+          return K(a, b) * conj(m(a)) * er(b);
+        })),
+        Kmm(sum_symm<3>([&](int a, int b) ARITH_INLINE {
+          return K(a, b) * conj(m(a)) * conj(m(b));
+        })),
+        mxr([&](int a) ARITH_INLINE {
+          const int x = (a + 1) % 3, y = (a + 2) % 3;
+          return sqrt(detgamma) * (conj(m(x)) * er(y) - conj(m(y)) * er(x));
+        }),
+        //
+        // With n = (et - er) / sqrt(2) and the Gauss-Codazzi equations,
+        // Psi4 = Rm_abcd mbar^a n^b mbar^c n^d
+        //      = 1/2 (E_ab + er^x er_x R_ab) mbar^a mbar^b
+        //        + 1/2 (K_mm K_rr - K_mr^2) - B_a^b mbar^a (mbar x er)_b
+        // The tetrad vector er is not normalized exactly, so that we do
+        // not combine the Ricci and extrinsic curvature terms into E_ab.
+        Psi4(sum_symm<3>([&](int a, int b) ARITH_INLINE {
+               return (E(a, b) + er2 * R(a, b)) * conj(m(a)) * conj(m(b));
+             }) / T(2) +
+             (Kmm * Krr - Kmr * Kmr) / T(2) -
+             sum<3>([&](int a, int b) ARITH_INLINE {
+               return B(a)(b) * conj(m(a)) * mxr(b);
+             }))
+  //
+  {}
+};
+
 } // namespace Weyl
 
 #endif // #ifndef WEYL_VARS_HXX
@@ -7,12 +7,14 @@
 
 #include <cctk.h>
 #include <cctk_Arguments.h>
+#include <cctk_Parameter.h>
 #include <cctk_Parameters.h>
 
 #ifdef __CUDACC__
 #include <nvToolsExt.h>
 #endif
 
+#include <array>
 #include <cmath>
 
 namespace Z4c {
@@ -20,6 +22,60 @@ using namespace Arith;
 using namespace Loop;
 using namespace std;
 
+namespace {
+// Get an integer or boolean parameter of another thorn
+CCTK_INT get_int_parameter(const char *const thorn, const char *const name) {
+  int type;
+  const void *const ptr = CCTK_ParameterGet(name, thorn, &type);
+  if (!ptr || !(type == PARAMETER_INT || type == PARAMETER_BOOLEAN))
+    CCTK_VERROR("Cannot access the parameter %s::%s", thorn, name);
+  return *static_cast<const CCTK_INT *>(ptr);
+}
+} // namespace
+
+extern "C" void Z4c_ParamCheck(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_ParamCheck;
+  DECLARE_CCTK_PARAMETERS;
+
+  if (!(calc_ADM_vars || calc_ADMRHS_vars) || calc_ADM_vars_every == 1)
+    return;
+
+  // Matter thorns read the ADM variables in every iteration to
+  // calculate the stress-energy tensor, and they cannot declare this
+  if (!vacuum)
+    CCTK_ERROR("Z4c::calc_ADM_vars_every > 1 requires Z4c::vacuum = yes");
+
+  // The ADM variables are invalid in the skipped iterations. All
+  // routines reading them must therefore run only in iterations that
+  // are a multiple of calc_ADM_vars_every.
+  const auto check_every = [&](const char *const thorn,
+                               const char *const name, const CCTK_INT every) {
+    if (every % calc_ADM_vars_every != 0)
+      CCTK_VERROR("%s::%s=%d must be a multiple of "
+                  "Z4c::calc_ADM_vars_every=%d",
+                  thorn, name, int(every), int(calc_ADM_vars_every));
+  };
+  if (CCTK_IsThornActive("Weyl") && get_int_parameter("Weyl", "calc_on_grid"))
+    check_every("Weyl", "calc_every", get_int_parameter("Weyl", "calc_every"));
+  if (CCTK_IsThornActive("AHFinderX"))
+    check_every("AHFinderX", "find_every",
+                get_int_parameter("AHFinderX", "find_every"));
+  if (CCTK_IsThornActive("SphericalHarmonics") && out_every > 0)
+    check_every("IO", "out_every", out_every);
+}
+
+extern "C" void Z4c_SelectADMVars(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_SelectADMVars;
+  DECLARE_CCTK_PARAMETERS;
+
+  // Z4c_ADM and Z4c_ADM2 are skipped in other iterations. Their results
+  // then remain invalid (they depend on the Z4c state variables), so
+  // that a routine reading them in such an iteration is caught by the
+  // driver instead of seeing outdated values. Z4c_ParamCheck ensures
+  // that the known consumers run only in the selected iterations.
+  *ADM_vars_needed = cctk_iteration % calc_ADM_vars_every == 0;
+}
+
 extern "C" void Z4c_ADM(CCTK_ARGUMENTS) {
   DECLARE_CCTK_ARGUMENTS_Z4c_ADM;
   DECLARE_CCTK_PARAMETERS;
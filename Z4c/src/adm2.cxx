@@ -8,6 +8,7 @@
 #endif
 #endif
 
+#include "deriv_cache.hxx"
 #include "derivs.hxx"
 #include "physics.hxx"
 #include "z4c_vars.hxx"
@@ -87,67 +88,10 @@ extern "C" void Z4c_ADM2(CCTK_ARGUMENTS) {
 
   //
 
-  constexpr int nvars = 154;
-  GF3D5vector<CCTK_REAL> vars(layout0, nvars);
-
-  int ivar = 0;
-
-  const auto make_gf = [&]() { return GF3D5<CCTK_REAL>(vars(ivar++)); };
-  const auto make_vec = [&](const auto &f) {
-    return vec<result_of_t<decltype(f)()>, 3>([&](int) { return f(); });
-  };
-  const auto make_mat = [&](const auto &f) {
-    return smat<result_of_t<decltype(f)()>, 3>([&](int, int) { return f(); });
-  };
-  const auto make_vec_gf = [&]() { return make_vec(make_gf); };
-  const auto make_mat_gf = [&]() { return make_mat(make_gf); };
-  const auto make_vec_vec_gf = [&]() { return make_vec(make_vec_gf); };
-  const auto make_vec_mat_gf = [&]() { return make_vec(make_mat_gf); };
-  const auto make_mat_vec_gf = [&]() { return make_mat(make_vec_gf); };
-  const auto make_mat_mat_gf = [&]() { return make_mat(make_mat_gf); };
-
-  const GF3D5<CCTK_REAL> gf_chi0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dchi0(make_vec_gf());
-  const smat<GF3D5<CCTK_REAL>, 3> gf_ddchi0(make_mat_gf());
-  calc_derivs2(cctkGH, gf_chi1, gf_chi0, gf_dchi0, gf_ddchi0, layout0);
-
-  const smat<GF3D5<CCTK_REAL>, 3> gf_gammat0(make_mat_gf());
-  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dgammat0(make_mat_vec_gf());
-  const smat<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddgammat0(make_mat_mat_gf());
-  calc_derivs2(cctkGH, gf_gammat1, gf_gammat0, gf_dgammat0, gf_ddgammat0,
-               layout0);
-
-  const GF3D5<CCTK_REAL> gf_Kh0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dKh0(make_vec_gf());
-  calc_derivs(cctkGH, gf_Kh1, gf_Kh0, gf_dKh0, layout0);
-
-  const smat<GF3D5<CCTK_REAL>, 3> gf_At0(make_mat_gf());
-  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dAt0(make_mat_vec_gf());
-  calc_derivs(cctkGH, gf_At1, gf_At0, gf_dAt0, layout0);
-
-  const vec<GF3D5<CCTK_REAL>, 3> gf_Gamt0(make_vec_gf());
-  const vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dGamt0(make_vec_vec_gf());
-  calc_derivs(cctkGH, gf_Gamt1, gf_Gamt0, gf_dGamt0, layout0);
-
-  const GF3D5<CCTK_REAL> gf_Theta0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dTheta0(make_vec_gf());
-  calc_derivs(cctkGH, gf_Theta1, gf_Theta0, gf_dTheta0, layout0);
-
-  const GF3D5<CCTK_REAL> gf_alphaG0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dalphaG0(make_vec_gf());
-  const smat<GF3D5<CCTK_REAL>, 3> gf_ddalphaG0(make_mat_gf());
-  calc_derivs2(cctkGH, gf_alphaG1, gf_alphaG0, gf_dalphaG0, gf_ddalphaG0,
-               layout0);
-
-  const vec<GF3D5<CCTK_REAL>, 3> gf_betaG0(make_vec_gf());
-  const vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dbetaG0(make_vec_vec_gf());
-  const vec<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddbetaG0(make_vec_mat_gf());
-  calc_derivs2(cctkGH, gf_betaG1, gf_betaG0, gf_dbetaG0, gf_ddbetaG0, layout0);
-
-  if (ivar != nvars)
-    CCTK_VERROR("Wrong number of temporary variables: nvars=%d ivar=%d", nvars,
-                ivar);
-  ivar = -1;
+  const auto storage = get_derivs(cctkGH, layout0, imin, imax, gf_chi1,
+                                  gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1,
+                                  gf_Theta1, gf_alphaG1, gf_betaG1);
+  const z4c_derivs_t derivs = storage->derivs;
 
   //
 
@@ -198,18 +142,18 @@ extern "C" void Z4c_ADM2(CCTK_ARGUMENTS) {
         // load and calculate
         const z4c_vars<vreal> vars(
             set_Theta_zero, kappa1, kappa2, f_mu_L, f_mu_S, eta, //
-            gf_chi0(mask, index0), gf_dchi0(mask, index0),
-            gf_ddchi0(mask, index0), //
-            gf_gammat0(mask, index0), gf_dgammat0(mask, index0),
-            gf_ddgammat0(mask, index0),                        //
-            gf_Kh0(mask, index0), gf_dKh0(mask, index0),       //
-            gf_At0(mask, index0), gf_dAt0(mask, index0),       //
-            gf_Gamt0(mask, index0), gf_dGamt0(mask, index0),   //
-            gf_Theta0(mask, index0), gf_dTheta0(mask, index0), //
-            gf_alphaG0(mask, index0), gf_dalphaG0(mask, index0),
-            gf_ddalphaG0(mask, index0), //
-            gf_betaG0(mask, index0), gf_dbetaG0(mask, index0),
-            gf_ddbetaG0(mask, index0), //
+            derivs.gf_chi0(mask, index0), derivs.gf_dchi0(mask, index0),
+            derivs.gf_ddchi0(mask, index0), //
+            derivs.gf_gammat0(mask, index0), derivs.gf_dgammat0(mask, index0),
+            derivs.gf_ddgammat0(mask, index0), //
+            derivs.gf_Kh0(mask, index0), derivs.gf_dKh0(mask, index0), //
+            derivs.gf_At0(mask, index0), derivs.gf_dAt0(mask, index0), //
+            derivs.gf_Gamt0(mask, index0), derivs.gf_dGamt0(mask, index0), //
+            derivs.gf_Theta0(mask, index0), derivs.gf_dTheta0(mask, index0), //
+            derivs.gf_alphaG0(mask, index0), derivs.gf_dalphaG0(mask, index0),
+            derivs.gf_ddalphaG0(mask, index0), //
+            derivs.gf_betaG0(mask, index0), derivs.gf_dbetaG0(mask, index0),
+            derivs.gf_ddbetaG0(mask, index0), //
             gf_eTtt1(mask, index1), gf_eTti1(mask, index1),
             gf_eTij1(mask, index1));
 
@@ -0,0 +1,251 @@
+#include <cctk.h>
+
+#ifdef __CUDACC__
+// Disable CCTK_DEBUG since the debug information takes too much
+// parameter space to launch the kernels
+#ifdef CCTK_DEBUG
+#undef CCTK_DEBUG
+#endif
+#endif
+
+#include "deriv_cache.hxx"
+
+#include <loop_device.hxx>
+#include <mat.hxx>
+#include <simd.hxx>
+#include <timers.hxx>
+#include <vec.hxx>
+
+#include <cctk.h>
+#include <cctk_Parameters.h>
+
+#include <array>
+#include <cassert>
+#include <type_traits>
+
+namespace Z4c {
+using namespace Arith;
+using namespace Loop;
+using namespace SpacetimeUtils;
+using namespace std;
+
+namespace {
+
+// Spatial derivatives of the ADM 3-metric and extrinsic curvature,
+// calculated from the Z4c variables and their derivatives
+template <typename T> struct adm_derivs_vars {
+  // Constants
+  const smat<T, 3> delta3;
+
+  // Conformal factor and conformal metric; the Z4c variables are stored
+  // as deviations from flat space
+  const T c;
+  const smat<T, 3> G;
+  // Trace part of the extrinsic curvature
+  const T S;
+  const vec<T, 3> dS;
+
+  // g = G / c, K = (At + S G) / c
+  const smat<T, 3> g;
+  const smat<vec<T, 3>, 3> dg;
+  const smat<smat<T, 3>, 3> ddg;
+  const smat<T, 3> K;
+  const smat<vec<T, 3>, 3> dK;
+
+  ARITH_INLINE ARITH_DEVICE ARITH_HOST adm_derivs_vars(
+      const T &chi, const vec<T, 3> &dchi, const smat<T, 3> &ddchi,
+      const smat<T, 3> &gammat, const smat<vec<T, 3>, 3> &dgammat,
+      const smat<smat<T, 3>, 3> &ddgammat, const T &Kh, const vec<T, 3> &dKh,
+      const smat<T, 3> &At, const smat<vec<T, 3>, 3> &dAt, const T &Theta,
+      const vec<T, 3> &dTheta)
+      : delta3(one<smat<T, 3> >()()),
+        //
+        c(1 + chi), G([&](int a, int b) ARITH_INLINE {
+          return delta3(a, b) + gammat(a, b);
+        }),
+        S((Kh + 2 * Theta) / 3), dS([&](int k) ARITH_INLINE {
+          return (dKh(k) + 2 * dTheta(k)) / 3;
+        }),
+        //
+        g([&](int a, int b) ARITH_INLINE { return G(a, b) / c; }),
+        dg([&](int a, int b) ARITH_INLINE {
+          return vec<T, 3>([&](int k) ARITH_INLINE {
+            return dgammat(a, b)(k) / c - G(a, b) * dchi(k) / pow2(c);
+          });
+        }),
+        ddg([&](int a, int b) ARITH_INLINE {
+          return smat<T, 3>([&](int k, int l) ARITH_INLINE {
+            return ddgammat(a, b)(k, l) / c //
+                   - (dgammat(a, b)(k) * dchi(l) +
+                      dgammat(a, b)(l) * dchi(k)) /
+                         pow2(c)                      //
+                   - G(a, b) * ddchi(k, l) / pow2(c) //
+                   + 2 * G(a, b) * dchi(k) * dchi(l) / pow3(c);
+          });
+        }),
+        K([&](int a, int b) ARITH_INLINE {
+          return (At(a, b) + S * G(a, b)) / c;
+        }),
+        dK([&](int a, int b) ARITH_INLINE {
+          return vec<T, 3>([&](int k) ARITH_INLINE {
+            const T N = At(a, b) + S * G(a, b);
+            const T dN = dAt(a, b)(k) + dS(k) * G(a, b) + S * dgammat(a, b)(k);
+            return dN / c - N * dchi(k) / pow2(c);
+          });
+        }) {}
+};
+
+template <typename F, typename R = result_of_t<F()> >
+auto make_vec(const F &f) {
+  return vec<R, 3>([&](int) { return f(); });
+}
+template <typename F, typename R = result_of_t<F()> >
+auto make_mat(const F &f) {
+  return smat<R, 3>([&](int, int) { return f(); });
+}
+
+} // namespace
+
+// Provide the ADM variables and their first and second spatial
+// derivatives in the interior [imin, imax) of the current box. These
+// are calculated from the derivatives of the Z4c variables (which are
+// shared via the derivative cache) instead of by finite differencing
+// the ADM variables. `ptrs` points to an array of 124 pointers to
+// temporaries without ghost zones, in this order: alpha (1), dalpha
+// (3), ddalpha (6), beta (3), dbeta (9), ddbeta (18), gamma (6), dgamma
+// (18), ddgamma (36), K (6), dK (18). If the first pointer is null, the
+// lapse and shift (the first 40 entries) are not calculated. Returns 0
+// on success. Must be called in local mode, from a routine that READS
+// the Z4c state variables everywhere.
+extern "C" CCTK_INT
+Z4c_GetADMDerivatives(const CCTK_POINTER_TO_CONST cctkGH_,
+                      const CCTK_INT *restrict const imin_,
+                      const CCTK_INT *restrict const imax_,
+                      const CCTK_POINTER ptrs_) {
+  DECLARE_CCTK_PARAMETERS;
+  const cGH *restrict const cctkGH = static_cast<const cGH *>(cctkGH_);
+  CCTK_REAL *const *restrict const ptrs =
+      static_cast<CCTK_REAL *const *>(ptrs_);
+
+  for (int d = 0; d < 3; ++d)
+    if (cctkGH->cctk_nghostzones[d] < deriv_order / 2 + 1)
+      return -1;
+
+  // Only the whole interior of a box is supported
+  const array<int, dim> indextype = {0, 0, 0};
+  const array<int, dim> nghostzones = {cctkGH->cctk_nghostzones[0],
+                                       cctkGH->cctk_nghostzones[1],
+                                       cctkGH->cctk_nghostzones[2]};
+  vect<int, dim> imin, imax;
+  GridDescBase(cctkGH).box_int<0, 0, 0>(nghostzones, imin, imax);
+  for (int d = 0; d < dim; ++d)
+    if (imin_[d] != imin[d] || imax_[d] != imax[d])
+      return -1;
+
+  // Suffix 1: with ghost zones, suffix 0: without ghost zones
+  const GF3D2layout layout1(cctkGH, indextype);
+  const GF3D5layout layout0(imin, imax);
+
+  const auto getvar = [&](const char *const name) {
+    const CCTK_REAL *const ptr =
+        static_cast<const CCTK_REAL *>(CCTK_VarDataPtr(cctkGH, 0, name));
+    if (!ptr)
+      CCTK_VERROR("No storage for variable \"%s\"", name);
+    return GF3D2<const CCTK_REAL>(layout1, ptr);
+  };
+
+  const GF3D2<const CCTK_REAL> gf_chi1 = getvar("Z4c::chi");
+  const smat<GF3D2<const CCTK_REAL>, 3> gf_gammat1{
+      getvar("Z4c::gammatxx"), getvar("Z4c::gammatxy"),
+      getvar("Z4c::gammatxz"), getvar("Z4c::gammatyy"),
+      getvar("Z4c::gammatyz"), getvar("Z4c::gammatzz")};
+  const GF3D2<const CCTK_REAL> gf_Kh1 = getvar("Z4c::Kh");
+  const smat<GF3D2<const CCTK_REAL>, 3> gf_At1{
+      getvar("Z4c::Atxx"), getvar("Z4c::Atxy"), getvar("Z4c::Atxz"),
+      getvar("Z4c::Atyy"), getvar("Z4c::Atyz"), getvar("Z4c::Atzz")};
+  const vec<GF3D2<const CCTK_REAL>, 3> gf_Gamt1{
+      getvar("Z4c::Gamtx"), getvar("Z4c::Gamty"), getvar("Z4c::Gamtz")};
+  const GF3D2<const CCTK_REAL> gf_Theta1 = getvar("Z4c::Theta");
+  const GF3D2<const CCTK_REAL> gf_alphaG1 = getvar("Z4c::alphaG");
+  const vec<GF3D2<const CCTK_REAL>, 3> gf_betaG1{
+      getvar("Z4c::betaGx"), getvar("Z4c::betaGy"), getvar("Z4c::betaGz")};
+
+  const auto storage = get_derivs(cctkGH, layout0, imin, imax, gf_chi1,
+                                  gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1,
+                                  gf_Theta1, gf_alphaG1, gf_betaG1);
+  const z4c_derivs_t derivs = storage->derivs;
+
+  // Output variables
+
+  // Null pointers lead to null temporaries, which are not stored
+  const bool calc_gauge = ptrs[0] != nullptr;
+  int iptr = 0;
+  const auto make_gf = [&]() {
+    return GF3D5<CCTK_REAL>(layout0, ptrs[iptr++]);
+  };
+
+  const GF3D5<CCTK_REAL> gf_alpha0 = make_gf();
+  const vec<GF3D5<CCTK_REAL>, 3> gf_dalpha0 = make_vec(make_gf);
+  const smat<GF3D5<CCTK_REAL>, 3> gf_ddalpha0 = make_mat(make_gf);
+  const vec<GF3D5<CCTK_REAL>, 3> gf_beta0 = make_vec(make_gf);
+  const vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dbeta0 =
+      make_vec([&]() { return make_vec(make_gf); });
+  const vec<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddbeta0 =
+      make_vec([&]() { return make_mat(make_gf); });
+  const smat<GF3D5<CCTK_REAL>, 3> gf_gamma0 = make_mat(make_gf);
+  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dgamma0 =
+      make_mat([&]() { return make_vec(make_gf); });
+  const smat<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddgamma0 =
+      make_mat([&]() { return make_mat(make_gf); });
+  const smat<GF3D5<CCTK_REAL>, 3> gf_K0 = make_mat(make_gf);
+  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dK0 =
+      make_mat([&]() { return make_vec(make_gf); });
+  assert(iptr == 124);
+
+  // Read 142 derivatives of the Z4c variables, write 124 (or 84)
+  // derivatives of the ADM variables
+  static const kernel_t kernel{"Z4c ADM derivatives", 0, 266 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  typedef simd<CCTK_REAL> vreal;
+  typedef simdl<CCTK_REAL> vbool;
+  constexpr size_t vsize = tuple_size_v<vreal>;
+
+  const Loop::GridDescBaseDevice grid(cctkGH);
+  grid.loop_int_device<0, 0, 0, vsize>(
+      grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+        const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+        const GF3D5index index0(layout0, p.I);
+
+        // Load and calculate
+
+        const adm_derivs_vars<vreal> vars(
+            derivs.gf_chi0(mask, index0), derivs.gf_dchi0(mask, index0),
+            derivs.gf_ddchi0(mask, index0), //
+            derivs.gf_gammat0(mask, index0), derivs.gf_dgammat0(mask, index0),
+            derivs.gf_ddgammat0(mask, index0), //
+            derivs.gf_Kh0(mask, index0), derivs.gf_dKh0(mask, index0), //
+            derivs.gf_At0(mask, index0), derivs.gf_dAt0(mask, index0), //
+            derivs.gf_Theta0(mask, index0), derivs.gf_dTheta0(mask, index0));
+
+        // Store
+
+        if (calc_gauge) {
+          gf_alpha0.store(mask, index0, 1 + derivs.gf_alphaG0(mask, index0));
+          gf_dalpha0.store(mask, index0, derivs.gf_dalphaG0(mask, index0));
+          gf_ddalpha0.store(mask, index0, derivs.gf_ddalphaG0(mask, index0));
+          gf_beta0.store(mask, index0, derivs.gf_betaG0(mask, index0));
+          gf_dbeta0.store(mask, index0, derivs.gf_dbetaG0(mask, index0));
+          gf_ddbeta0.store(mask, index0, derivs.gf_ddbetaG0(mask, index0));
+        }
+        gf_gamma0.store(mask, index0, vars.g);
+        gf_dgamma0.store(mask, index0, vars.dg);
+        gf_ddgamma0.store(mask, index0, vars.ddg);
+        gf_K0.store(mask, index0, vars.K);
+        gf_dK0.store(mask, index0, vars.dK);
+      });
+
+  return 0;
+}
+
+} // namespace Z4c
@@ -0,0 +1,331 @@
+#include <cctk.h>
+
+#include "constraint_norms.hxx"
+#include "deriv_cache.hxx"
+#include "derivs.hxx"
+#include "excision.hxx"
+#include "physics.hxx"
+#include "z4c_vars.hxx"
+
+#include <loop_device.hxx>
+#include <simd.hxx>
+#include <timers.hxx>
+
+#include <cctk.h>
+#include <cctk_Arguments.h>
+#include <cctk_Parameters.h>
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <ios>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Z4c {
+using namespace Arith;
+using namespace Loop;
+using namespace SpacetimeUtils;
+using namespace std;
+
+namespace {
+
+const array<string, nconstraints> constraint_names{"ZtC", "HC", "MtC",
+                                                   "allC"};
+
+// Norms of the constraints on one refinement level
+struct constraint_norms_t {
+  // Sums that are added across boxes and processes
+  CCTK_REAL volume = 0;
+  array<CCTK_REAL, nconstraints> sum2{};
+  // Maxima across boxes and processes
+  array<CCTK_REAL, nconstraints> maxabs{};
+
+  void add(const constraint_norms_t &norms) {
+    volume += norms.volume;
+    for (int n = 0; n < nconstraints; ++n) {
+      sum2[n] += norms.sum2[n];
+      maxabs[n] = fmax(maxabs[n], norms.maxabs[n]);
+    }
+  }
+};
+
+// Norms accumulated by Z4c_Constraints or Z4c_ConstraintNorms, indexed
+// by refinement level, and reset by Z4c_ConstraintNorms_Output
+mutex constraint_norms_mutex;
+vector<constraint_norms_t> constraint_norms;
+
+} // namespace
+
+bool do_constraint_norms(const cGH *restrict const cctkGH) {
+  DECLARE_CCTK_PARAMETERS;
+  return constraint_norms_every > 0 &&
+         cctkGH->cctk_iteration % constraint_norms_every == 0;
+}
+
+void constraint_norms_box_t::finish(const cGH *restrict const cctkGH) const {
+  constexpr size_t vsize = tuple_size_v<vreal>;
+
+  // Combine the SIMD lanes
+  constraint_norms_t norms;
+  CCTK_REAL cell_volume = 1;
+  for (int d = 0; d < dim; ++d)
+    cell_volume *= cctkGH->cctk_delta_space[d] / cctkGH->cctk_levfac[d];
+  norms.volume = cell_volume * npoints;
+  const vbool all_lanes = mask_for_loop_tail<vbool>(0, vsize);
+  for (int n = 0; n < nconstraints; ++n) {
+    array<CCTK_REAL, vsize> sum2_lanes, maxabs_lanes;
+    mask_storeu(all_lanes, sum2_lanes.data(), vsum2[n]);
+    mask_storeu(all_lanes, maxabs_lanes.data(), vmaxabs[n]);
+    for (size_t l = 0; l < vsize; ++l) {
+      norms.sum2[n] += cell_volume * sum2_lanes[l];
+      norms.maxabs[n] = fmax(norms.maxabs[n], maxabs_lanes[l]);
+    }
+  }
+
+  // Combine the boxes
+  int level = 0;
+  while ((1 << level) < cctkGH->cctk_levfac[0])
+    ++level;
+  const lock_guard<mutex> guard(constraint_norms_mutex);
+  if (int(constraint_norms.size()) <= level)
+    constraint_norms.resize(level + 1);
+  constraint_norms.at(level).add(norms);
+}
+
+// Calculate the constraint norms without storing the constraints. This
+// is only scheduled when the constraints are not stored in grid
+// functions; otherwise `Z4c_Constraints` calculates the norms.
+
+extern "C" void Z4c_ConstraintNorms(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_ConstraintNorms;
+  DECLARE_CCTK_PARAMETERS;
+
+  if (!do_constraint_norms(cctkGH))
+    return;
+
+#ifdef __CUDACC__
+  CCTK_ERROR("Calculating constraint norms is not supported on GPUs; use "
+             "Z4c::constraint_gfs and reduce the grid functions instead");
+#endif
+
+  for (int d = 0; d < 3; ++d)
+    if (cctk_nghostzones[d] < deriv_order / 2 + 1)
+      CCTK_VERROR("Need at least %d ghost zones", deriv_order / 2 + 1);
+
+  //
+
+  const array<int, dim> indextype = {0, 0, 0};
+  const array<int, dim> nghostzones = {cctk_nghostzones[0], cctk_nghostzones[1],
+                                       cctk_nghostzones[2]};
+  vect<int, dim> imin, imax;
+  GridDescBase(cctkGH).box_int<0, 0, 0>(nghostzones, imin, imax);
+  // Suffix 1: with ghost zones, suffix 0: without ghost zones
+  const GF3D2layout layout1(cctkGH, indextype);
+  const GF3D5layout layout0(imin, imax);
+
+  const GF3D2<const CCTK_REAL> gf_chi1(layout1, chi);
+
+  const smat<GF3D2<const CCTK_REAL>, 3> gf_gammat1{
+      GF3D2<const CCTK_REAL>(layout1, gammatxx),
+      GF3D2<const CCTK_REAL>(layout1, gammatxy),
+      GF3D2<const CCTK_REAL>(layout1, gammatxz),
+      GF3D2<const CCTK_REAL>(layout1, gammatyy),
+      GF3D2<const CCTK_REAL>(layout1, gammatyz),
+      GF3D2<const CCTK_REAL>(layout1, gammatzz)};
+
+  const GF3D2<const CCTK_REAL> gf_Kh1(layout1, Kh);
+
+  const smat<GF3D2<const CCTK_REAL>, 3> gf_At1{
+      GF3D2<const CCTK_REAL>(layout1, Atxx),
+      GF3D2<const CCTK_REAL>(layout1, Atxy),
+      GF3D2<const CCTK_REAL>(layout1, Atxz),
+      GF3D2<const CCTK_REAL>(layout1, Atyy),
+      GF3D2<const CCTK_REAL>(layout1, Atyz),
+      GF3D2<const CCTK_REAL>(layout1, Atzz)};
+
+  const vec<GF3D2<const CCTK_REAL>, 3> gf_Gamt1{
+      GF3D2<const CCTK_REAL>(layout1, Gamtx),
+      GF3D2<const CCTK_REAL>(layout1, Gamty),
+      GF3D2<const CCTK_REAL>(layout1, Gamtz)};
+
+  const GF3D2<const CCTK_REAL> gf_Theta1(layout1, Theta);
+
+  const GF3D2<const CCTK_REAL> gf_alphaG1(layout1, alphaG);
+
+  const vec<GF3D2<const CCTK_REAL>, 3> gf_betaG1{
+      GF3D2<const CCTK_REAL>(layout1, betaGx),
+      GF3D2<const CCTK_REAL>(layout1, betaGy),
+      GF3D2<const CCTK_REAL>(layout1, betaGz)};
+
+  //
+
+  // Excised points do not contribute to the norms
+  const excision_t excision = get_excision();
+  if (excision.box_inside(cctkGH, imin, imax))
+    return;
+
+  const auto storage = get_derivs(cctkGH, layout0, imin, imax, gf_chi1,
+                                  gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1,
+                                  gf_Theta1, gf_alphaG1, gf_betaG1);
+  const z4c_derivs_t derivs = storage->derivs;
+
+  //
+
+  const GF3D2<const CCTK_REAL> gf_eTtt1(layout1, eTtt);
+
+  const vec<GF3D2<const CCTK_REAL>, 3> gf_eTti1{
+      GF3D2<const CCTK_REAL>(layout1, eTtx),
+      GF3D2<const CCTK_REAL>(layout1, eTty),
+      GF3D2<const CCTK_REAL>(layout1, eTtz)};
+
+  const smat<GF3D2<const CCTK_REAL>, 3> gf_eTij1{
+      GF3D2<const CCTK_REAL>(layout1, eTxx),
+      GF3D2<const CCTK_REAL>(layout1, eTxy),
+      GF3D2<const CCTK_REAL>(layout1, eTxz),
+      GF3D2<const CCTK_REAL>(layout1, eTyy),
+      GF3D2<const CCTK_REAL>(layout1, eTyz),
+      GF3D2<const CCTK_REAL>(layout1, eTzz)};
+
+  //
+
+  typedef simd<CCTK_REAL> vreal;
+  typedef simdl<CCTK_REAL> vbool;
+  constexpr size_t vsize = tuple_size_v<vreal>;
+
+  constraint_norms_box_t box_norms;
+
+  // Read 154 temporaries and 10 components of Tmunu
+  static const kernel_t kernel{"Z4c constraint norms", 0, 164 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  const Loop::GridDescBase grid(cctkGH);
+  grid.loop_int<0, 0, 0, vsize>(grid.nghostzones, [&](const PointDesc &p) {
+    const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+    const GF3D2index index1(layout1, p.I);
+    const GF3D5index index0(layout0, p.I);
+
+    if (excision.all_inside(p))
+      return;
+
+    // Load and calculate
+
+    const z4c_vars<vreal> vars(
+        set_Theta_zero, kappa1, kappa2, f_mu_L, f_mu_S, eta, //
+        derivs.gf_chi0(mask, index0), derivs.gf_dchi0(mask, index0),
+        derivs.gf_ddchi0(mask, index0), //
+        derivs.gf_gammat0(mask, index0), derivs.gf_dgammat0(mask, index0),
+        derivs.gf_ddgammat0(mask, index0), //
+        derivs.gf_Kh0(mask, index0), derivs.gf_dKh0(mask, index0), //
+        derivs.gf_At0(mask, index0), derivs.gf_dAt0(mask, index0), //
+        derivs.gf_Gamt0(mask, index0), derivs.gf_dGamt0(mask, index0), //
+        derivs.gf_Theta0(mask, index0), derivs.gf_dTheta0(mask, index0), //
+        derivs.gf_alphaG0(mask, index0), derivs.gf_dalphaG0(mask, index0),
+        derivs.gf_ddalphaG0(mask, index0), //
+        derivs.gf_betaG0(mask, index0), derivs.gf_dbetaG0(mask, index0),
+        derivs.gf_ddbetaG0(mask, index0), //
+        gf_eTtt1(mask, index1), gf_eTti1(mask, index1),
+        gf_eTij1(mask, index1));
+
+    // Reduce
+    box_norms.add(mask, p, vars);
+  });
+
+  box_norms.finish(cctkGH);
+}
+
+extern "C" void Z4c_ConstraintNorms_Output(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_ConstraintNorms_Output;
+  DECLARE_CCTK_PARAMETERS;
+
+  if (!do_constraint_norms(cctkGH))
+    return;
+
+  // Combine the processes
+  vector<constraint_norms_t> norms;
+  {
+    const lock_guard<mutex> guard(constraint_norms_mutex);
+    norms.swap(constraint_norms);
+  }
+
+  const int nlevels_local = norms.size();
+  int nlevels;
+  MPI_Allreduce(&nlevels_local, &nlevels, 1, MPI_INT, MPI_MAX,
+                MPI_COMM_WORLD);
+  norms.resize(nlevels);
+
+  vector<CCTK_REAL> sums, maxima;
+  for (const auto &level_norms : norms) {
+    sums.push_back(level_norms.volume);
+    for (int n = 0; n < nconstraints; ++n) {
+      sums.push_back(level_norms.sum2[n]);
+      maxima.push_back(level_norms.maxabs[n]);
+    }
+  }
+  static_assert(is_same_v<CCTK_REAL, double>);
+  const int myproc = CCTK_MyProc(cctkGH);
+  MPI_Reduce(myproc == 0 ? MPI_IN_PLACE : sums.data(), sums.data(),
+             sums.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(myproc == 0 ? MPI_IN_PLACE : maxima.data(), maxima.data(),
+             maxima.size(), MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+  if (myproc == 0) {
+
+    // Output constraint norms
+    const string path_name = out_dir;
+    static bool did_create_directory = false;
+    if (!did_create_directory) {
+      const int mode = 0755;
+      const int ierr = CCTK_CreateDirectory(mode, path_name.c_str());
+      assert(ierr >= 0);
+      did_create_directory = true;
+    }
+
+    const string sep = "\t";
+    const string eol = "\n";
+    const string quote = "\"";
+    const string file_name = "constraint_norms.tsv";
+    const string output_name = path_name + "/" + file_name;
+    static bool did_create_file = false;
+    const ios_base::openmode mode =
+        (did_create_file ? ios_base::app : ios_base::out) | ios_base::ate;
+    ofstream file(output_name, mode);
+    if (!did_create_file) {
+      file << "iteration" << sep << "time" << sep << "level";
+      for (int n = 0; n < nconstraints; ++n) {
+        file << sep << quote << "L2(" << constraint_names[n] << ")" << quote;
+        file << sep << quote << "Linf(" << constraint_names[n] << ")" << quote;
+      }
+      file << eol;
+      did_create_file = true;
+    }
+
+    file << setprecision(numeric_limits<double>::digits10 + 1) << scientific;
+    for (int level = 0; level < nlevels; ++level) {
+      const CCTK_REAL *const level_sums = &sums.at(level * (1 + nconstraints));
+      const CCTK_REAL *const level_maxima = &maxima.at(level * nconstraints);
+      const CCTK_REAL volume = level_sums[0];
+      if (volume == 0)
+        continue;
+      file << cctk_iteration << sep << cctk_time << sep << level;
+      for (int n = 0; n < nconstraints; ++n) {
+        file << sep << sqrt(level_sums[1 + n] / volume);
+        file << sep << level_maxima[n];
+      }
+      file << eol;
+    }
+
+    file.close();
+
+  } // if (myproc == 0)
+}
+
+} // namespace Z4c
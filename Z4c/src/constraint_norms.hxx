@@ -0,0 +1,65 @@
+#ifndef CONSTRAINT_NORMS_HXX
+#define CONSTRAINT_NORMS_HXX
+
+#include "z4c_vars.hxx"
+
+#include <loop_device.hxx>
+#include <simd.hxx>
+
+#include <cctk.h>
+
+#include <array>
+#include <cmath>
+
+namespace Z4c {
+using namespace Arith;
+using namespace Loop;
+
+// The monitored constraints: |ZtC|, HC, |MtC|, allC
+constexpr int nconstraints = 4;
+
+// Whether the constraint norms are output in the current iteration
+bool do_constraint_norms(const cGH *restrict const cctkGH);
+
+// Accumulate the L2 and Linf norms of the constraints over the points of
+// one box, in SIMD vectors
+class constraint_norms_box_t {
+  typedef simd<CCTK_REAL> vreal;
+  typedef simdl<CCTK_REAL> vbool;
+
+  std::array<vreal, nconstraints> vsum2, vmaxabs;
+  CCTK_REAL npoints;
+
+public:
+  constraint_norms_box_t() : npoints(0) {
+    for (int n = 0; n < nconstraints; ++n) {
+      vsum2[n] = 0;
+      vmaxabs[n] = 0;
+    }
+  }
+
+  // Add the points of the SIMD vector starting at `p`
+  inline ARITH_INLINE void add(const vbool &mask, const PointDesc &p,
+                               const z4c_vars<vreal> &vars) {
+    using std::sqrt;
+    const std::array<vreal, nconstraints> cs{
+        sqrt(sum<3>([&](int x) ARITH_INLINE { return pow2(vars.ZtC(x)); })),
+        vars.HC,
+        sqrt(sum<3>([&](int x) ARITH_INLINE { return pow2(vars.MtC(x)); })),
+        vars.allC};
+    for (int n = 0; n < nconstraints; ++n) {
+      const vreal c = if_else(mask, fabs(cs[n]), vreal(0));
+      vsum2[n] += pow2(c);
+      vmaxabs[n] = fmax(vmaxabs[n], c);
+    }
+    npoints += std::min(int(std::tuple_size_v<vreal>), p.imax - p.i);
+  }
+
+  // Add the norms of this box to those of its refinement level; they
+  // are output by `Z4c_ConstraintNorms_Output`
+  void finish(const cGH *restrict const cctkGH) const;
+};
+
+} // namespace Z4c
+
+#endif // #ifndef CONSTRAINT_NORMS_HXX
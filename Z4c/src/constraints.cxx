@@ -8,12 +8,16 @@
 #endif
 #endif
 
+#include "constraint_norms.hxx"
+#include "deriv_cache.hxx"
 #include "derivs.hxx"
+#include "excision.hxx"
 #include "physics.hxx"
 #include "z4c_vars.hxx"
 
 #include <loop_device.hxx>
 #include <simd.hxx>
+#include <timers.hxx>
 
 #include <cctk.h>
 #include <cctk_Arguments.h>
@@ -28,6 +32,7 @@
 namespace Z4c {
 using namespace Arith;
 using namespace Loop;
+using namespace SpacetimeUtils;
 using namespace std;
 
 extern "C" void Z4c_Constraints(CCTK_ARGUMENTS) {
@@ -85,69 +90,6 @@ extern "C" void Z4c_Constraints(CCTK_ARGUMENTS) {
 
   //
 
-  const int ntmps = 154;
-  GF3D5vector<CCTK_REAL> tmps(layout0, ntmps);
-  int itmp = 0;
-
-  const auto make_gf = [&]() { return GF3D5<CCTK_REAL>(tmps(itmp++)); };
-  const auto make_vec = [&](const auto &f) {
-    return vec<result_of_t<decltype(f)()>, 3>([&](int) { return f(); });
-  };
-  const auto make_mat = [&](const auto &f) {
-    return smat<result_of_t<decltype(f)()>, 3>([&](int, int) { return f(); });
-  };
-  const auto make_vec_gf = [&]() { return make_vec(make_gf); };
-  const auto make_mat_gf = [&]() { return make_mat(make_gf); };
-  const auto make_vec_vec_gf = [&]() { return make_vec(make_vec_gf); };
-  const auto make_vec_mat_gf = [&]() { return make_vec(make_mat_gf); };
-  const auto make_mat_vec_gf = [&]() { return make_mat(make_vec_gf); };
-  const auto make_mat_mat_gf = [&]() { return make_mat(make_mat_gf); };
-
-  const GF3D5<CCTK_REAL> gf_chi0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dchi0(make_vec_gf());
-  const smat<GF3D5<CCTK_REAL>, 3> gf_ddchi0(make_mat_gf());
-  calc_derivs2(cctkGH, gf_chi1, gf_chi0, gf_dchi0, gf_ddchi0, layout0);
-
-  const smat<GF3D5<CCTK_REAL>, 3> gf_gammat0(make_mat_gf());
-  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dgammat0(make_mat_vec_gf());
-  const smat<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddgammat0(make_mat_mat_gf());
-  calc_derivs2(cctkGH, gf_gammat1, gf_gammat0, gf_dgammat0, gf_ddgammat0,
-               layout0);
-
-  const GF3D5<CCTK_REAL> gf_Kh0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dKh0(make_vec_gf());
-  calc_derivs(cctkGH, gf_Kh1, gf_Kh0, gf_dKh0, layout0);
-
-  const smat<GF3D5<CCTK_REAL>, 3> gf_At0(make_mat_gf());
-  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dAt0(make_mat_vec_gf());
-  calc_derivs(cctkGH, gf_At1, gf_At0, gf_dAt0, layout0);
-
-  const vec<GF3D5<CCTK_REAL>, 3> gf_Gamt0(make_vec_gf());
-  const vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dGamt0(make_vec_vec_gf());
-  calc_derivs(cctkGH, gf_Gamt1, gf_Gamt0, gf_dGamt0, layout0);
-
-  const GF3D5<CCTK_REAL> gf_Theta0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dTheta0(make_vec_gf());
-  calc_derivs(cctkGH, gf_Theta1, gf_Theta0, gf_dTheta0, layout0);
-
-  const GF3D5<CCTK_REAL> gf_alphaG0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dalphaG0(make_vec_gf());
-  const smat<GF3D5<CCTK_REAL>, 3> gf_ddalphaG0(make_mat_gf());
-  calc_derivs2(cctkGH, gf_alphaG1, gf_alphaG0, gf_dalphaG0, gf_ddalphaG0,
-               layout0);
-
-  const vec<GF3D5<CCTK_REAL>, 3> gf_betaG0(make_vec_gf());
-  const vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dbetaG0(make_vec_vec_gf());
-  const vec<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddbetaG0(make_vec_mat_gf());
-  calc_derivs2(cctkGH, gf_betaG1, gf_betaG0, gf_dbetaG0, gf_ddbetaG0, layout0);
-
-  if (itmp != ntmps)
-    CCTK_VERROR("Wrong number of temporary variables: ntmps=%d itmp=%d", ntmps,
-                itmp);
-  itmp = -1;
-
-  //
-
   const GF3D2<const CCTK_REAL> gf_eTtt1(layout1, eTtt);
 
   const vec<GF3D2<const CCTK_REAL>, 3> gf_eTti1{
@@ -184,12 +126,37 @@ extern "C" void Z4c_Constraints(CCTK_ARGUMENTS) {
   constexpr size_t vsize = tuple_size_v<vreal>;
 
   const Loop::GridDescBaseDevice grid(cctkGH);
-#ifdef __CUDACC__
-  const nvtxRangeId_t range = nvtxRangeStartA("Z4c_Constraints::constraints");
-#endif
-  grid.loop_int_device<0, 0, 0, vsize>(
-      grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
-        const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+
+  // The constraints are not evaluated in the excised region; they are
+  // set to zero there
+  const excision_t excision = get_excision();
+  if (excision.box_inside(cctkGH, imin, imax)) {
+    grid.loop_int_device<0, 0, 0, vsize>(
+        grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+          const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+          const GF3D2index index1(layout1, p.I);
+          gf_ZtC1.store(mask, index1, zero<vec<vreal, 3> >()());
+          gf_HC1.store(mask, index1, zero<vreal>()());
+          gf_MtC1.store(mask, index1, zero<vec<vreal, 3> >()());
+          gf_allC1.store(mask, index1, zero<vreal>()());
+        });
+    return;
+  }
+
+  const auto storage = get_derivs(cctkGH, layout0, imin, imax, gf_chi1,
+                                  gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1,
+                                  gf_Theta1, gf_alphaG1, gf_betaG1);
+  const z4c_derivs_t derivs = storage->derivs;
+
+  // Read 154 temporaries and 10 components of Tmunu, write 8
+  // constraints
+  static const kernel_t kernel{"Z4c constraints", 0, 172 * 8};
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  // Calculate and store the constraints at the points of the SIMD
+  // vector starting at `p`
+  const auto calc_point =
+      [=] ARITH_DEVICE(const vbool &mask, const PointDesc &p) ARITH_INLINE {
         const GF3D2index index1(layout1, p.I);
         const GF3D5index index0(layout0, p.I);
 
@@ -197,18 +164,18 @@ extern "C" void Z4c_Constraints(CCTK_ARGUMENTS) {
 
         const z4c_vars<vreal> vars(
             set_Theta_zero, kappa1, kappa2, f_mu_L, f_mu_S, eta, //
-            gf_chi0(mask, index0), gf_dchi0(mask, index0),
-            gf_ddchi0(mask, index0), //
-            gf_gammat0(mask, index0), gf_dgammat0(mask, index0),
-            gf_ddgammat0(mask, index0),                        //
-            gf_Kh0(mask, index0), gf_dKh0(mask, index0),       //
-            gf_At0(mask, index0), gf_dAt0(mask, index0),       //
-            gf_Gamt0(mask, index0), gf_dGamt0(mask, index0),   //
-            gf_Theta0(mask, index0), gf_dTheta0(mask, index0), //
-            gf_alphaG0(mask, index0), gf_dalphaG0(mask, index0),
-            gf_ddalphaG0(mask, index0), //
-            gf_betaG0(mask, index0), gf_dbetaG0(mask, index0),
-            gf_ddbetaG0(mask, index0), //
+            derivs.gf_chi0(mask, index0), derivs.gf_dchi0(mask, index0),
+            derivs.gf_ddchi0(mask, index0), //
+            derivs.gf_gammat0(mask, index0), derivs.gf_dgammat0(mask, index0),
+            derivs.gf_ddgammat0(mask, index0), //
+            derivs.gf_Kh0(mask, index0), derivs.gf_dKh0(mask, index0), //
+            derivs.gf_At0(mask, index0), derivs.gf_dAt0(mask, index0), //
+            derivs.gf_Gamt0(mask, index0), derivs.gf_dGamt0(mask, index0), //
+            derivs.gf_Theta0(mask, index0), derivs.gf_dTheta0(mask, index0), //
+            derivs.gf_alphaG0(mask, index0), derivs.gf_dalphaG0(mask, index0),
+            derivs.gf_ddalphaG0(mask, index0), //
+            derivs.gf_betaG0(mask, index0), derivs.gf_dbetaG0(mask, index0),
+            derivs.gf_ddbetaG0(mask, index0), //
             gf_eTtt1(mask, index1), gf_eTti1(mask, index1),
             gf_eTij1(mask, index1));
 
@@ -217,7 +184,53 @@ extern "C" void Z4c_Constraints(CCTK_ARGUMENTS) {
         gf_HC1.store(mask, index1, vars.HC);
         gf_MtC1.store(mask, index1, vars.MtC);
         gf_allC1.store(mask, index1, vars.allC);
-      });
+
+        return vars;
+      };
+
+  const auto zero_point =
+      [=] ARITH_DEVICE(const vbool &mask, const PointDesc &p) ARITH_INLINE {
+        const GF3D2index index1(layout1, p.I);
+        gf_ZtC1.store(mask, index1, zero<vec<vreal, 3> >()());
+        gf_HC1.store(mask, index1, zero<vreal>()());
+        gf_MtC1.store(mask, index1, zero<vec<vreal, 3> >()());
+        gf_allC1.store(mask, index1, zero<vreal>()());
+      };
+
+#ifdef __CUDACC__
+  const nvtxRangeId_t range = nvtxRangeStartA("Z4c_Constraints::constraints");
+#endif
+  if (do_constraint_norms(cctkGH)) {
+#ifdef __CUDACC__
+    CCTK_ERROR("Calculating constraint norms is not supported on GPUs; "
+               "reduce the constraint grid functions instead");
+#else
+    // Reduce the norms in the same loop. (Without grid functions,
+    // `Z4c_ConstraintNorms` calculates the norms instead.)
+    constraint_norms_box_t box_norms;
+    const Loop::GridDescBase host_grid(cctkGH);
+    host_grid.loop_int<0, 0, 0, vsize>(
+        host_grid.nghostzones, [&](const PointDesc &p) {
+          const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+          if (excision.all_inside(p)) {
+            zero_point(mask, p);
+            return;
+          }
+          box_norms.add(mask, p, calc_point(mask, p));
+        });
+    box_norms.finish(cctkGH);
+#endif
+  } else {
+    grid.loop_int_device<0, 0, 0, vsize>(
+        grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+          const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+          if (excision.all_inside(p)) {
+            zero_point(mask, p);
+            return;
+          }
+          calc_point(mask, p);
+        });
+  }
 #ifdef __CUDACC__
   nvtxRangeEnd(range);
 #endif
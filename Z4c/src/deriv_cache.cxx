@@ -0,0 +1,161 @@
+#include <cctk.h>
+
+#ifdef __CUDACC__
+// Disable CCTK_DEBUG since the debug information takes too much
+// parameter space to launch the kernels
+#ifdef CCTK_DEBUG
+#undef CCTK_DEBUG
+#endif
+#endif
+
+#include "deriv_cache.hxx"
+
+#include <cctk.h>
+#include <cctk_Arguments.h>
+#include <cctk_Parameters.h>
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace Z4c {
+using namespace std;
+
+namespace {
+
+// Boxes are identified by their refinement level and by the location
+// of their interior on that level. Each entry also records the
+// iteration and the state counter at which it was calculated. The
+// state counter is advanced by `Z4c_DerivCacheNewState` every time the
+// state variables change (after each RK substep, after regridding, and
+// after setting up initial data), so that it distinguishes the RK
+// substeps of an iteration. Entries for other iterations or states are
+// stale and are removed when they are encountered.
+typedef tuple<int, array<int, dim>, array<int, dim> > deriv_cache_key_t;
+
+struct deriv_cache_entry_t {
+  int iteration;
+  long long state;
+  size_t bytes;
+  shared_ptr<const deriv_storage_t> storage;
+};
+
+mutex deriv_cache_mutex;
+map<deriv_cache_key_t, deriv_cache_entry_t> deriv_cache;
+size_t deriv_cache_bytes = 0;
+long long deriv_cache_state = 0;
+
+deriv_cache_key_t make_key(const cGH *restrict const cctkGH,
+                           const vect<int, dim> &imin,
+                           const vect<int, dim> &imax) {
+  int level = 0;
+  while ((1 << level) < cctkGH->cctk_levfac[0])
+    ++level;
+  array<int, dim> amin, amax;
+  for (int d = 0; d < dim; ++d) {
+    amin[d] = cctkGH->cctk_lbnd[d] + imin[d];
+    amax[d] = cctkGH->cctk_lbnd[d] + imax[d];
+  }
+  return {level, amin, amax};
+}
+
+bool is_current(const cGH *restrict const cctkGH,
+                const deriv_cache_entry_t &entry) {
+  return entry.iteration == cctkGH->cctk_iteration &&
+         entry.state == deriv_cache_state;
+}
+
+// The cache mutex must be held
+void erase_entry(map<deriv_cache_key_t, deriv_cache_entry_t>::iterator it) {
+  deriv_cache_bytes -= it->second.bytes;
+  deriv_cache.erase(it);
+}
+
+} // namespace
+
+shared_ptr<const deriv_storage_t>
+find_cached_derivs(const cGH *restrict const cctkGH,
+                   const vect<int, dim> &imin, const vect<int, dim> &imax) {
+  DECLARE_CCTK_PARAMETERS;
+  if (!cache_derivs)
+    return nullptr;
+  const lock_guard<mutex> guard(deriv_cache_mutex);
+  const auto it = deriv_cache.find(make_key(cctkGH, imin, imax));
+  if (it == deriv_cache.end())
+    return nullptr;
+  if (!is_current(cctkGH, it->second)) {
+    erase_entry(it);
+    return nullptr;
+  }
+  return it->second.storage;
+}
+
+shared_ptr<const deriv_storage_t>
+get_derivs(const cGH *restrict const cctkGH, const GF3D5layout &layout0,
+           const vect<int, dim> &imin, const vect<int, dim> &imax,
+           const GF3D2<const CCTK_REAL> &gf_chi1,
+           const smat<GF3D2<const CCTK_REAL>, 3> &gf_gammat1,
+           const GF3D2<const CCTK_REAL> &gf_Kh1,
+           const smat<GF3D2<const CCTK_REAL>, 3> &gf_At1,
+           const vec<GF3D2<const CCTK_REAL>, 3> &gf_Gamt1,
+           const GF3D2<const CCTK_REAL> &gf_Theta1,
+           const GF3D2<const CCTK_REAL> &gf_alphaG1,
+           const vec<GF3D2<const CCTK_REAL>, 3> &gf_betaG1) {
+  DECLARE_CCTK_PARAMETERS;
+
+  if (const auto cached = find_cached_derivs(cctkGH, imin, imax))
+    return cached;
+
+  const auto storage = make_shared<deriv_storage_t>(layout0);
+  storage->derivs.calc(cctkGH, deriv_order, layout0, imin, imax, gf_chi1,
+                       gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1, gf_Theta1,
+                       gf_alphaG1, gf_betaG1);
+
+  if (cache_derivs) {
+    const size_t bytes =
+        size_t(z4c_derivs_t::ntmps) * layout0.np * sizeof(CCTK_REAL);
+    const lock_guard<mutex> guard(deriv_cache_mutex);
+    // Make room by removing stale entries (e.g. of boxes that
+    // disappeared when regridding)
+    if (deriv_cache_bytes + bytes > deriv_cache_max_memory * 1.0e+9)
+      for (auto it = deriv_cache.begin(); it != deriv_cache.end();)
+        if (is_current(cctkGH, it->second))
+          ++it;
+        else
+          erase_entry(it++);
+    // Do not cache if this would exceed the memory limit; the
+    // derivatives will then be recalculated when needed again
+    if (deriv_cache_bytes + bytes <= deriv_cache_max_memory * 1.0e+9) {
+      const deriv_cache_key_t key = make_key(cctkGH, imin, imax);
+      const auto it = deriv_cache.find(key);
+      if (it != deriv_cache.end())
+        erase_entry(it);
+      deriv_cache.emplace(key, deriv_cache_entry_t{cctkGH->cctk_iteration,
+                                                   deriv_cache_state, bytes,
+                                                   storage});
+      deriv_cache_bytes += bytes;
+    }
+  }
+
+  return storage;
+}
+
+void invalidate_cached_derivs(const cGH *restrict const cctkGH,
+                              const vect<int, dim> &imin,
+                              const vect<int, dim> &imax) {
+  const lock_guard<mutex> guard(deriv_cache_mutex);
+  const auto it = deriv_cache.find(make_key(cctkGH, imin, imax));
+  if (it != deriv_cache.end())
+    erase_entry(it);
+}
+
+extern "C" void Z4c_DerivCacheNewState(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_DerivCacheNewState;
+  const lock_guard<mutex> guard(deriv_cache_mutex);
+  ++deriv_cache_state;
+}
+
+} // namespace Z4c
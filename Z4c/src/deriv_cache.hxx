@@ -0,0 +1,203 @@
+#ifndef DERIV_CACHE_HXX
+#define DERIV_CACHE_HXX
+
+#include "derivs.hxx"
+
+#include <loop_device.hxx>
+#include <mat.hxx>
+#include <scratch.hxx>
+#include <timers.hxx>
+#include <vec.hxx>
+#include <vect.hxx>
+
+#include <cctk.h>
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace Z4c {
+using namespace Arith;
+using namespace Loop;
+using namespace SpacetimeUtils;
+
+// First and second derivatives of the Z4c state variables, stored in
+// `ntmps` temporaries without ghost zones
+struct z4c_derivs_t {
+  static constexpr int ntmps = 154;
+
+  GF3D5<CCTK_REAL> gf_chi0;
+  vec<GF3D5<CCTK_REAL>, 3> gf_dchi0;
+  smat<GF3D5<CCTK_REAL>, 3> gf_ddchi0;
+
+  smat<GF3D5<CCTK_REAL>, 3> gf_gammat0;
+  smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dgammat0;
+  smat<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddgammat0;
+
+  GF3D5<CCTK_REAL> gf_Kh0;
+  vec<GF3D5<CCTK_REAL>, 3> gf_dKh0;
+
+  smat<GF3D5<CCTK_REAL>, 3> gf_At0;
+  smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dAt0;
+
+  vec<GF3D5<CCTK_REAL>, 3> gf_Gamt0;
+  vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dGamt0;
+
+  GF3D5<CCTK_REAL> gf_Theta0;
+  vec<GF3D5<CCTK_REAL>, 3> gf_dTheta0;
+
+  GF3D5<CCTK_REAL> gf_alphaG0;
+  vec<GF3D5<CCTK_REAL>, 3> gf_dalphaG0;
+  smat<GF3D5<CCTK_REAL>, 3> gf_ddalphaG0;
+
+  vec<GF3D5<CCTK_REAL>, 3> gf_betaG0;
+  vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dbetaG0;
+  vec<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddbetaG0;
+
+private:
+  template <typename F, typename R = std::result_of_t<F()> >
+  static auto make_vec(const F &f) {
+    return vec<R, 3>([&](int) { return f(); });
+  }
+  template <typename F, typename R = std::result_of_t<F()> >
+  static auto make_mat(const F &f) {
+    return smat<R, 3>([&](int, int) { return f(); });
+  }
+
+  // `make_gf` returns a new temporary every time it is called
+  template <typename F>
+  z4c_derivs_t(const F &make_gf)
+      : gf_chi0(make_gf()), gf_dchi0(make_vec(make_gf)),
+        gf_ddchi0(make_mat(make_gf)),
+        //
+        gf_gammat0(make_mat(make_gf)),
+        gf_dgammat0(make_mat([&]() { return make_vec(make_gf); })),
+        gf_ddgammat0(make_mat([&]() { return make_mat(make_gf); })),
+        //
+        gf_Kh0(make_gf()), gf_dKh0(make_vec(make_gf)),
+        //
+        gf_At0(make_mat(make_gf)),
+        gf_dAt0(make_mat([&]() { return make_vec(make_gf); })),
+        //
+        gf_Gamt0(make_vec(make_gf)),
+        gf_dGamt0(make_vec([&]() { return make_vec(make_gf); })),
+        //
+        gf_Theta0(make_gf()), gf_dTheta0(make_vec(make_gf)),
+        //
+        gf_alphaG0(make_gf()), gf_dalphaG0(make_vec(make_gf)),
+        gf_ddalphaG0(make_mat(make_gf)),
+        //
+        gf_betaG0(make_vec(make_gf)),
+        gf_dbetaG0(make_vec([&]() { return make_vec(make_gf); })),
+        gf_ddbetaG0(make_vec([&]() { return make_mat(make_gf); })) {}
+
+public:
+  // Set up the temporaries; `make_gf1(n)` returns temporary number
+  // `n`, with `0 <= n < ntmps`
+  template <typename F> static z4c_derivs_t make(const F &make_gf1) {
+    int itmp = 0;
+    const z4c_derivs_t derivs([&]() { return make_gf1(itmp++); });
+    if (itmp != ntmps)
+      CCTK_VERROR("Wrong number of temporary variables: ntmps=%d itmp=%d",
+                  ntmps, itmp);
+    return derivs;
+  }
+
+  // Calculate the derivatives in the box [imin, imax), which must lie
+  // in the interior, with finite differencing order `deriv_order`
+  template <int deriv_order>
+  void calc(const cGH *restrict const cctkGH, const GF3D5layout &layout0,
+            const vect<int, dim> &imin, const vect<int, dim> &imax,
+            const GF3D2<const CCTK_REAL> &gf_chi1,
+            const smat<GF3D2<const CCTK_REAL>, 3> &gf_gammat1,
+            const GF3D2<const CCTK_REAL> &gf_Kh1,
+            const smat<GF3D2<const CCTK_REAL>, 3> &gf_At1,
+            const vec<GF3D2<const CCTK_REAL>, 3> &gf_Gamt1,
+            const GF3D2<const CCTK_REAL> &gf_Theta1,
+            const GF3D2<const CCTK_REAL> &gf_alphaG1,
+            const vec<GF3D2<const CCTK_REAL>, 3> &gf_betaG1) const {
+    // Read 25 state variables, write 154 temporaries; flop count for
+    // fourth order (see README)
+    static const kernel_t kernel{"Z4c derivatives", 1617, 179 * 8};
+    const kernel_timer_t timer(kernel, prod(imax - imin));
+    calc_derivs2<deriv_order>(cctkGH, gf_chi1, gf_chi0, gf_dchi0, gf_ddchi0,
+                              layout0, imin, imax);
+    calc_derivs2<deriv_order>(cctkGH, gf_gammat1, gf_gammat0, gf_dgammat0,
+                              gf_ddgammat0, layout0, imin, imax);
+    calc_derivs<deriv_order>(cctkGH, gf_Kh1, gf_Kh0, gf_dKh0, layout0, imin,
+                             imax);
+    calc_derivs<deriv_order>(cctkGH, gf_At1, gf_At0, gf_dAt0, layout0, imin,
+                             imax);
+    calc_derivs<deriv_order>(cctkGH, gf_Gamt1, gf_Gamt0, gf_dGamt0, layout0,
+                             imin, imax);
+    calc_derivs<deriv_order>(cctkGH, gf_Theta1, gf_Theta0, gf_dTheta0,
+                             layout0, imin, imax);
+    calc_derivs2<deriv_order>(cctkGH, gf_alphaG1, gf_alphaG0, gf_dalphaG0,
+                              gf_ddalphaG0, layout0, imin, imax);
+    calc_derivs2<deriv_order>(cctkGH, gf_betaG1, gf_betaG0, gf_dbetaG0,
+                              gf_ddbetaG0, layout0, imin, imax);
+  }
+
+  // Same, with the finite differencing order chosen at run time
+  void calc(const cGH *restrict const cctkGH, const int deriv_order,
+            const GF3D5layout &layout0, const vect<int, dim> &imin,
+            const vect<int, dim> &imax, const GF3D2<const CCTK_REAL> &gf_chi1,
+            const smat<GF3D2<const CCTK_REAL>, 3> &gf_gammat1,
+            const GF3D2<const CCTK_REAL> &gf_Kh1,
+            const smat<GF3D2<const CCTK_REAL>, 3> &gf_At1,
+            const vec<GF3D2<const CCTK_REAL>, 3> &gf_Gamt1,
+            const GF3D2<const CCTK_REAL> &gf_Theta1,
+            const GF3D2<const CCTK_REAL> &gf_alphaG1,
+            const vec<GF3D2<const CCTK_REAL>, 3> &gf_betaG1) const {
+    dispatch_deriv_order(deriv_order, [&](const auto order) {
+      calc<decltype(order)::value>(cctkGH, layout0, imin, imax, gf_chi1,
+                                   gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1,
+                                   gf_Theta1, gf_alphaG1, gf_betaG1);
+    });
+  }
+};
+
+// Derivatives for the interior of a box, together with their storage
+struct deriv_storage_t {
+  scratch_t tmps;
+  z4c_derivs_t derivs;
+
+  deriv_storage_t(const GF3D5layout &layout0)
+      : tmps(std::size_t(z4c_derivs_t::ntmps) * layout0.np),
+        derivs(z4c_derivs_t::make([&](const int n) {
+          return GF3D5<CCTK_REAL>(layout0, tmps.data() + n * layout0.np);
+        })) {}
+};
+
+// Obtain the derivatives of the state variables for the interior
+// [imin, imax) of the current box. With `cache_derivs`, these are
+// shared between all routines that see the same state, i.e. in the
+// same iteration and RK substep. When the cache is full or disabled
+// the derivatives are recalculated.
+std::shared_ptr<const deriv_storage_t>
+get_derivs(const cGH *restrict const cctkGH, const GF3D5layout &layout0,
+           const vect<int, dim> &imin, const vect<int, dim> &imax,
+           const GF3D2<const CCTK_REAL> &gf_chi1,
+           const smat<GF3D2<const CCTK_REAL>, 3> &gf_gammat1,
+           const GF3D2<const CCTK_REAL> &gf_Kh1,
+           const smat<GF3D2<const CCTK_REAL>, 3> &gf_At1,
+           const vec<GF3D2<const CCTK_REAL>, 3> &gf_Gamt1,
+           const GF3D2<const CCTK_REAL> &gf_Theta1,
+           const GF3D2<const CCTK_REAL> &gf_alphaG1,
+           const vec<GF3D2<const CCTK_REAL>, 3> &gf_betaG1);
+
+// Look up cached derivatives; returns a null pointer if there are none
+std::shared_ptr<const deriv_storage_t>
+find_cached_derivs(const cGH *restrict const cctkGH,
+                   const vect<int, dim> &imin, const vect<int, dim> &imax);
+
+// Forget the cached derivatives for the interior [imin, imax) of the
+// current box. This must be called whenever the state variables of
+// the box change.
+void invalidate_cached_derivs(const cGH *restrict const cctkGH,
+                              const vect<int, dim> &imin,
+                              const vect<int, dim> &imax);
+
+} // namespace Z4c
+
+#endif // #ifndef DERIV_CACHE_HXX
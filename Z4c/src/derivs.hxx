@@ -25,11 +25,34 @@ using namespace std;
 
 ////////////////////////////////////////////////////////////////////////////////
 
-constexpr int deriv_order = 4;
+// The finite differencing order is a template argument of all stencils.
+// It is chosen at run time via the parameter `deriv_order`;
+// `dispatch_deriv_order` calls `f` with a `std::integral_constant`
+// holding the order, so that each order is instantiated separately and
+// there is no branching inside the loops.
+template <typename F>
+void dispatch_deriv_order(const int deriv_order, const F &f) {
+  switch (deriv_order) {
+  case 2:
+    f(integral_constant<int, 2>());
+    break;
+  case 4:
+    f(integral_constant<int, 4>());
+    break;
+  case 6:
+    f(integral_constant<int, 6>());
+    break;
+  case 8:
+    f(integral_constant<int, 8>());
+    break;
+  default:
+    CCTK_VERROR("Unsupported finite differencing order %d", deriv_order);
+  }
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv1d(const simdl<T> &mask, const T *restrict const var, const ptrdiff_t di,
         const T dx) {
@@ -44,9 +67,19 @@ deriv1d(const simdl<T> &mask, const T *restrict const var, const ptrdiff_t di,
             2 / T(3) *
                 (maskz_loadu(mask, &var[-di]) - maskz_loadu(mask, &var[+di]))) /
            dx;
+  const auto load = [&](const int n) {
+    return maskz_loadu(mask, &var[n * di]) - maskz_loadu(mask, &var[-n * di]);
+  };
+  if constexpr (deriv_order == 6)
+    return (1 / T(60) * load(3) - 3 / T(20) * load(2) + 3 / T(4) * load(1)) /
+           dx;
+  if constexpr (deriv_order == 8)
+    return (-1 / T(280) * load(4) + 4 / T(105) * load(3) - 1 / T(5) * load(2) +
+            4 / T(5) * load(1)) /
+           dx;
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv1d_upwind(const simdl<T> &mask, const T *restrict const var,
                const ptrdiff_t di, const simd<T> &vel, const T dx) {
@@ -127,9 +160,38 @@ deriv1d_upwind(const simdl<T> &mask, const T *restrict const var,
         + 5 / T(6) * maskz_loadu(mask, &var[0]);
     return (vel * symm - fabs(vel) * anti) / dx;
   }
+  // Higher orders are constructed in the same way: `symm` and `anti`
+  // are the average and half the difference of the two one-sided
+  // stencils
+  const auto load_symm = [&](const int n) {
+    return maskz_loadu(mask, &var[-n * di]) - maskz_loadu(mask, &var[n * di]);
+  };
+  const auto load_anti = [&](const int n) {
+    return maskz_loadu(mask, &var[-n * di]) + maskz_loadu(mask, &var[n * di]);
+  };
+  const auto load0 = [&]() { return maskz_loadu(mask, &var[0]); };
+  if constexpr (deriv_order == 6) {
+    const simd<T> symm = 1 / T(120) * load_symm(4) - 1 / T(15) * load_symm(3) +
+                         4 / T(15) * load_symm(2) - 13 / T(15) * load_symm(1);
+    const simd<T> anti = 1 / T(120) * load_anti(4) - 1 / T(15) * load_anti(3) +
+                         7 / T(30) * load_anti(2) - 7 / T(15) * load_anti(1) +
+                         7 / T(12) * load0();
+    return (vel * symm - fabs(vel) * anti) / dx;
+  }
+  if constexpr (deriv_order == 8) {
+    const simd<T> symm =
+        -1 / T(560) * load_symm(5) + 1 / T(56) * load_symm(4) -
+        29 / T(336) * load_symm(3) + 2 / T(7) * load_symm(2) -
+        7 / T(8) * load_symm(1);
+    const simd<T> anti =
+        -1 / T(560) * load_anti(5) + 1 / T(56) * load_anti(4) -
+        9 / T(112) * load_anti(3) + 3 / T(14) * load_anti(2) -
+        3 / T(8) * load_anti(1) + 9 / T(20) * load0();
+    return (vel * symm - fabs(vel) * anti) / dx;
+  }
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv2_1d(const simdl<T> &mask, const T *restrict const var, const ptrdiff_t di,
           const T dx) {
@@ -146,9 +208,21 @@ deriv2_1d(const simdl<T> &mask, const T *restrict const var, const ptrdiff_t di,
                 (maskz_loadu(mask, &var[-di]) + maskz_loadu(mask, &var[+di])) //
             - 5 / T(2) * maskz_loadu(mask, &var[0])) /
            pow2(dx);
+  const auto load = [&](const int n) {
+    return maskz_loadu(mask, &var[n * di]) + maskz_loadu(mask, &var[-n * di]);
+  };
+  const auto load0 = [&]() { return maskz_loadu(mask, &var[0]); };
+  if constexpr (deriv_order == 6)
+    return (1 / T(90) * load(3) - 3 / T(20) * load(2) + 3 / T(2) * load(1) -
+            49 / T(18) * load0()) /
+           pow2(dx);
+  if constexpr (deriv_order == 8)
+    return (-1 / T(560) * load(4) + 8 / T(315) * load(3) - 1 / T(5) * load(2) +
+            8 / T(5) * load(1) - 205 / T(72) * load0()) /
+           pow2(dx);
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv2_2d(const int vavail, const simdl<T> &mask, const T *restrict const var,
           const ptrdiff_t di, const ptrdiff_t dj, const T dx, const T dy) {
@@ -162,7 +236,7 @@ deriv2_2d(const int vavail, const simdl<T> &mask, const T *restrict const var,
       if (i < npoints) {
         const simdl<T> mask1 = mask_for_loop_tail<simdl<T> >(i, npoints);
         arrx[div_floor(i, int(vsize))] =
-            deriv1d(mask1, &var[i - deriv_order / 2], dj, dy);
+            deriv1d<deriv_order>(mask1, &var[i - deriv_order / 2], dj, dy);
       }
     }
 #ifdef CCTK_DEBUG
@@ -170,7 +244,7 @@ deriv2_2d(const int vavail, const simdl<T> &mask, const T *restrict const var,
       ((T *)&arrx[0])[i] = Arith::nan<T>()(); // unused
 #endif
     const T *const varx = (T *)&arrx[0] + deriv_order / 2;
-    return deriv1d(mask, varx, 1, dx);
+    return deriv1d<deriv_order>(mask, varx, 1, dx);
   } else {
     assert(dj != 1);
     array<simd<T>, deriv_order + 1> arrx;
@@ -180,14 +254,15 @@ deriv2_2d(const int vavail, const simdl<T> &mask, const T *restrict const var,
         arrx[deriv_order / 2 + j] = Arith::nan<simd<T> >()(); // unused
 #endif
       } else {
-        arrx[deriv_order / 2 + j] = deriv1d(mask, &var[j * dj], di, dx);
+        arrx[deriv_order / 2 + j] =
+            deriv1d<deriv_order>(mask, &var[j * dj], di, dx);
       }
     const T *const varx = (T *)(&arrx[deriv_order / 2]);
-    return deriv1d(mask, varx, vsize, dy);
+    return deriv1d<deriv_order>(mask, varx, vsize, dy);
   }
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv1d_diss(const simdl<T> &mask, const T *restrict const var,
              const ptrdiff_t di, const T dx) {
@@ -207,21 +282,33 @@ deriv1d_diss(const simdl<T> &mask, const T *restrict const var,
                     maskz_loadu(mask, &var[+di])) //
             - 20 * maskz_loadu(mask, &var[0])) /
            dx;
+  const auto load = [&](const int n) {
+    return maskz_loadu(mask, &var[-n * di]) + maskz_loadu(mask, &var[n * di]);
+  };
+  const auto load0 = [&]() { return maskz_loadu(mask, &var[0]); };
+  if constexpr (deriv_order == 6)
+    return (load(4) - 8 * load(3) + 28 * load(2) - 56 * load(1) +
+            70 * load0()) /
+           dx;
+  if constexpr (deriv_order == 8)
+    return (load(5) - 10 * load(4) + 45 * load(3) - 120 * load(2) +
+            210 * load(1) - 252 * load0()) /
+           dx;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template <int dir, typename T, int D>
+template <int deriv_order, int dir, typename T, int D>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv(const simdl<T> &mask, const GF3D2<const T> &gf_, const vect<int, dim> &I,
       const vec<T, D> &dx) {
   static_assert(dir >= 0 && dir < D, "");
   const auto &DI = vect<int, dim>::unit;
   const ptrdiff_t di = gf_.delta(DI(dir));
-  return deriv1d(mask, &gf_(I), di, dx(dir));
+  return deriv1d<deriv_order>(mask, &gf_(I), di, dx(dir));
 }
 
-template <int dir, typename T, int D>
+template <int deriv_order, int dir, typename T, int D>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv_upwind(const simdl<T> &mask, const GF3D2<const T> &gf_,
              const vect<int, dim> &I, const vec<simd<T>, D> &vel,
@@ -229,10 +316,10 @@ deriv_upwind(const simdl<T> &mask, const GF3D2<const T> &gf_,
   static_assert(dir >= 0 && dir < D, "");
   const auto &DI = vect<int, dim>::unit;
   const ptrdiff_t di = gf_.delta(DI(dir));
-  return deriv1d_upwind(mask, &gf_(I), di, vel(dir), dx(dir));
+  return deriv1d_upwind<deriv_order>(mask, &gf_(I), di, vel(dir), dx(dir));
 }
 
-template <int dir1, int dir2, typename T, int D>
+template <int deriv_order, int dir1, int dir2, typename T, int D>
 inline ARITH_INLINE
     ARITH_DEVICE ARITH_HOST enable_if_t<(dir1 == dir2), simd<T> >
     deriv2(const int vavail, const simdl<T> &mask, const GF3D2<const T> &gf_,
@@ -241,10 +328,10 @@ inline ARITH_INLINE
   static_assert(dir2 >= 0 && dir2 < D, "");
   const auto &DI = vect<int, dim>::unit;
   const ptrdiff_t di = gf_.delta(DI(dir1));
-  return deriv2_1d(mask, &gf_(I), di, dx(dir1));
+  return deriv2_1d<deriv_order>(mask, &gf_(I), di, dx(dir1));
 }
 
-template <int dir1, int dir2, typename T, int D>
+template <int deriv_order, int dir1, int dir2, typename T, int D>
 inline ARITH_INLINE
     ARITH_DEVICE ARITH_HOST enable_if_t<(dir1 != dir2), simd<T> >
     deriv2(const int vavail, const simdl<T> &mask, const GF3D2<const T> &gf_,
@@ -254,52 +341,54 @@ inline ARITH_INLINE
   const auto &DI = vect<int, dim>::unit;
   const ptrdiff_t di = gf_.delta(DI(dir1));
   const ptrdiff_t dj = gf_.delta(DI(dir2));
-  return deriv2_2d(vavail, mask, &gf_(I), di, dj, dx(dir1), dx(dir2));
+  return deriv2_2d<deriv_order>(vavail, mask, &gf_(I), di, dj, dx(dir1),
+                                dx(dir2));
 }
 
-template <int dir, typename T, int D>
+template <int deriv_order, int dir, typename T, int D>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv_diss(const simdl<T> &mask, const GF3D2<const T> &gf_,
            const vect<int, dim> &I, const vec<T, D> &dx) {
   static_assert(dir >= 0 && dir < D, "");
   const auto &DI = vect<int, dim>::unit;
   const ptrdiff_t di = gf_.delta(DI(dir));
-  return deriv1d_diss(mask, &gf_(I), di, dx(dir));
+  return deriv1d_diss<deriv_order>(mask, &gf_(I), di, dx(dir));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST vec<simd<T>, dim>
 deriv(const simdl<T> &mask, const GF3D2<const T> &gf_, const vect<int, dim> &I,
       const vec<T, dim> &dx) {
-  return {deriv<0>(mask, gf_, I, dx), deriv<1>(mask, gf_, I, dx),
-          deriv<2>(mask, gf_, I, dx)};
+  return {deriv<deriv_order, 0>(mask, gf_, I, dx),
+          deriv<deriv_order, 1>(mask, gf_, I, dx),
+          deriv<deriv_order, 2>(mask, gf_, I, dx)};
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 deriv_upwind(const simdl<T> &mask, const GF3D2<const T> &gf_,
              const vect<int, dim> &I, const vec<simd<T>, dim> &vel,
              const vec<T, dim> &dx) {
-  return deriv_upwind<0>(mask, gf_, I, vel, dx) +
-         deriv_upwind<1>(mask, gf_, I, vel, dx) +
-         deriv_upwind<2>(mask, gf_, I, vel, dx);
+  return deriv_upwind<deriv_order, 0>(mask, gf_, I, vel, dx) +
+         deriv_upwind<deriv_order, 1>(mask, gf_, I, vel, dx) +
+         deriv_upwind<deriv_order, 2>(mask, gf_, I, vel, dx);
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST smat<simd<T>, dim>
 deriv2(const int vavail, const simdl<T> &mask, const GF3D2<const T> &gf_,
        const vect<int, dim> &I, const vec<T, dim> &dx) {
-  return {deriv2<0, 0>(vavail, mask, gf_, I, dx),
-          deriv2<0, 1>(vavail, mask, gf_, I, dx),
-          deriv2<0, 2>(vavail, mask, gf_, I, dx),
-          deriv2<1, 1>(vavail, mask, gf_, I, dx),
-          deriv2<1, 2>(vavail, mask, gf_, I, dx),
-          deriv2<2, 2>(vavail, mask, gf_, I, dx)};
+  return {deriv2<deriv_order, 0, 0>(vavail, mask, gf_, I, dx),
+          deriv2<deriv_order, 0, 1>(vavail, mask, gf_, I, dx),
+          deriv2<deriv_order, 0, 2>(vavail, mask, gf_, I, dx),
+          deriv2<deriv_order, 1, 1>(vavail, mask, gf_, I, dx),
+          deriv2<deriv_order, 1, 2>(vavail, mask, gf_, I, dx),
+          deriv2<deriv_order, 2, 2>(vavail, mask, gf_, I, dx)};
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
 diss(const simdl<T> &mask, const GF3D2<const T> &gf_, const vect<int, dim> &I,
      const vec<T, dim> &dx) {
@@ -307,18 +396,56 @@ diss(const simdl<T> &mask, const GF3D2<const T> &gf_, const vect<int, dim> &I,
   constexpr int diss_order = deriv_order + 2;
   constexpr int sign = diss_order % 4 == 0 ? -1 : +1;
   return sign / T(pown(2, deriv_order + 2)) *
-         (deriv_diss<0>(mask, gf_, I, dx)   //
-          + deriv_diss<1>(mask, gf_, I, dx) //
-          + deriv_diss<2>(mask, gf_, I, dx));
+         (deriv_diss<deriv_order, 0>(mask, gf_, I, dx)   //
+          + deriv_diss<deriv_order, 1>(mask, gf_, I, dx) //
+          + deriv_diss<deriv_order, 2>(mask, gf_, I, dx));
+}
+
+// Upwinded advection and dissipation terms. These are evaluated in the
+// same loop as the RHS so that the RHS is written only once.
+
+template <int deriv_order, typename T>
+inline ARITH_INLINE ARITH_DEVICE ARITH_HOST simd<T>
+upwind_diss(const simdl<T> &mask, const GF3D2<const T> &gf_,
+            const vect<int, dim> &I, const vec<simd<T>, dim> &betaG,
+            const vec<T, dim> &dx, const T epsdiss) {
+  if (epsdiss == 0)
+    return deriv_upwind<deriv_order>(mask, gf_, I, betaG, dx);
+  return deriv_upwind<deriv_order>(mask, gf_, I, betaG, dx) +
+         epsdiss * diss<deriv_order>(mask, gf_, I, dx);
+}
+
+template <int deriv_order, typename T>
+inline ARITH_INLINE ARITH_DEVICE ARITH_HOST vec<simd<T>, dim>
+upwind_diss(const simdl<T> &mask, const vec<GF3D2<const T>, dim> &gf_,
+            const vect<int, dim> &I, const vec<simd<T>, dim> &betaG,
+            const vec<T, dim> &dx, const T epsdiss) {
+  return vec<simd<T>, dim>([&](int a) ARITH_INLINE {
+    return upwind_diss<deriv_order>(mask, gf_(a), I, betaG, dx, epsdiss);
+  });
+}
+
+template <int deriv_order, typename T>
+inline ARITH_INLINE ARITH_DEVICE ARITH_HOST smat<simd<T>, dim>
+upwind_diss(const simdl<T> &mask, const smat<GF3D2<const T>, dim> &gf_,
+            const vect<int, dim> &I, const vec<simd<T>, dim> &betaG,
+            const vec<T, dim> &dx, const T epsdiss) {
+  return smat<simd<T>, dim>([&](int a, int b) ARITH_INLINE {
+    return upwind_diss<deriv_order>(mask, gf_(a, b), I, betaG, dx, epsdiss);
+  });
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename T>
+// Calculate derivatives in the box [imin, imax), which must lie within
+// the interior. This is either the whole interior or a single tile.
+
+template <int deriv_order, typename T>
 CCTK_ATTRIBUTE_NOINLINE void
 calc_derivs(const cGH *restrict const cctkGH, const GF3D2<const T> &gf1,
             const GF3D5<T> &gf0, const vec<GF3D5<T>, dim> &dgf0,
-            const GF3D5layout &layout0) {
+            const GF3D5layout &layout0, const vect<int, dim> &imin,
+            const vect<int, dim> &imax) {
   DECLARE_CCTK_ARGUMENTS;
 
   typedef simd<CCTK_REAL> vreal;
@@ -328,22 +455,25 @@ calc_derivs(const cGH *restrict const cctkGH, const GF3D2<const T> &gf1,
   const vec<CCTK_REAL, dim> dx([&](int a) { return CCTK_DELTA_SPACE(a); });
 
   const Loop::GridDescBaseDevice grid(cctkGH);
-  grid.loop_int_device<0, 0, 0, vsize>(
-      grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+  const vect<int, dim> inormal{0, 0, 0};
+  grid.loop_box_device<0, 0, 0, vsize>(
+      [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
         const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
         const GF3D5index index0(layout0, p.I);
         const auto val = gf1(mask, p.I);
         gf0.store(mask, index0, val);
-        const auto dval = deriv(mask, gf1, p.I, dx);
+        const auto dval = deriv<deriv_order>(mask, gf1, p.I, dx);
         dgf0.store(mask, index0, dval);
-      });
+      },
+      imin, imax, inormal);
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 CCTK_ATTRIBUTE_NOINLINE void
 calc_derivs2(const cGH *restrict const cctkGH, const GF3D2<const T> &gf1,
              const GF3D5<T> &gf0, const vec<GF3D5<T>, dim> &dgf0,
-             const smat<GF3D5<T>, dim> &ddgf0, const GF3D5layout &layout0) {
+             const smat<GF3D5<T>, dim> &ddgf0, const GF3D5layout &layout0,
+             const vect<int, dim> &imin, const vect<int, dim> &imax) {
   DECLARE_CCTK_ARGUMENTS;
 
   typedef simd<CCTK_REAL> vreal;
@@ -353,101 +483,74 @@ calc_derivs2(const cGH *restrict const cctkGH, const GF3D2<const T> &gf1,
   const vec<CCTK_REAL, dim> dx([&](int a) { return CCTK_DELTA_SPACE(a); });
 
   const Loop::GridDescBaseDevice grid(cctkGH);
-  grid.loop_int_device<0, 0, 0, vsize>(
-      grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+  const vect<int, dim> inormal{0, 0, 0};
+  grid.loop_box_device<0, 0, 0, vsize>(
+      [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
         const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
         const int vavail = p.imax - p.i;
         const GF3D5index index0(layout0, p.I);
         const auto val = gf1(mask, p.I);
         gf0.store(mask, index0, val);
-        const auto dval = deriv(mask, gf1, p.I, dx);
+        const auto dval = deriv<deriv_order>(mask, gf1, p.I, dx);
         dgf0.store(mask, index0, dval);
-        const auto ddval = deriv2(vavail, mask, gf1, p.I, dx);
+        const auto ddval = deriv2<deriv_order>(vavail, mask, gf1, p.I, dx);
         ddgf0.store(mask, index0, ddval);
-      });
+      },
+      imin, imax, inormal);
 }
 
-template <typename T>
+template <int deriv_order, typename T>
 CCTK_ATTRIBUTE_NOINLINE void
 calc_derivs(const cGH *restrict const cctkGH,
             const vec<GF3D2<const T>, dim> &gf0_, const vec<GF3D5<T>, dim> &gf_,
-            const vec<vec<GF3D5<T>, dim>, dim> &dgf_,
-            const GF3D5layout &layout) {
+            const vec<vec<GF3D5<T>, dim>, dim> &dgf_, const GF3D5layout &layout,
+            const vect<int, dim> &imin, const vect<int, dim> &imax) {
   for (int a = 0; a < 3; ++a)
-    calc_derivs(cctkGH, gf0_(a), gf_(a), dgf_(a), layout);
+    calc_derivs<deriv_order>(cctkGH, gf0_(a), gf_(a), dgf_(a), layout, imin,
+                             imax);
 }
 
-template <typename T>
-CCTK_ATTRIBUTE_NOINLINE void calc_derivs2(
-    const cGH *restrict const cctkGH, const vec<GF3D2<const T>, dim> &gf0_,
-    const vec<GF3D5<T>, dim> &gf_, const vec<vec<GF3D5<T>, dim>, dim> &dgf_,
-    const vec<smat<GF3D5<T>, dim>, dim> &ddgf_, const GF3D5layout &layout) {
+template <int deriv_order, typename T>
+CCTK_ATTRIBUTE_NOINLINE void
+calc_derivs2(const cGH *restrict const cctkGH,
+             const vec<GF3D2<const T>, dim> &gf0_,
+             const vec<GF3D5<T>, dim> &gf_,
+             const vec<vec<GF3D5<T>, dim>, dim> &dgf_,
+             const vec<smat<GF3D5<T>, dim>, dim> &ddgf_,
+             const GF3D5layout &layout, const vect<int, dim> &imin,
+             const vect<int, dim> &imax) {
   for (int a = 0; a < 3; ++a)
-    calc_derivs2(cctkGH, gf0_(a), gf_(a), dgf_(a), ddgf_(a), layout);
+    calc_derivs2<deriv_order>(cctkGH, gf0_(a), gf_(a), dgf_(a), ddgf_(a),
+                              layout, imin, imax);
 }
 
-template <typename T>
-CCTK_ATTRIBUTE_NOINLINE void calc_derivs(
-    const cGH *restrict const cctkGH, const smat<GF3D2<const T>, dim> &gf0_,
-    const smat<GF3D5<T>, dim> &gf_, const smat<vec<GF3D5<T>, dim>, dim> &dgf_,
-    const GF3D5layout &layout) {
+template <int deriv_order, typename T>
+CCTK_ATTRIBUTE_NOINLINE void
+calc_derivs(const cGH *restrict const cctkGH,
+            const smat<GF3D2<const T>, dim> &gf0_,
+            const smat<GF3D5<T>, dim> &gf_,
+            const smat<vec<GF3D5<T>, dim>, dim> &dgf_,
+            const GF3D5layout &layout, const vect<int, dim> &imin,
+            const vect<int, dim> &imax) {
   for (int a = 0; a < 3; ++a)
     for (int b = a; b < 3; ++b)
-      calc_derivs(cctkGH, gf0_(a, b), gf_(a, b), dgf_(a, b), layout);
+      calc_derivs<deriv_order>(cctkGH, gf0_(a, b), gf_(a, b), dgf_(a, b),
+                               layout, imin, imax);
 }
 
-template <typename T>
-CCTK_ATTRIBUTE_NOINLINE void calc_derivs2(
-    const cGH *restrict const cctkGH, const smat<GF3D2<const T>, dim> &gf0_,
-    const smat<GF3D5<T>, dim> &gf_, const smat<vec<GF3D5<T>, dim>, dim> &dgf_,
-    const smat<smat<GF3D5<T>, dim>, dim> &ddgf_, const GF3D5layout &layout) {
+template <int deriv_order, typename T>
+CCTK_ATTRIBUTE_NOINLINE void
+calc_derivs2(const cGH *restrict const cctkGH,
+             const smat<GF3D2<const T>, dim> &gf0_,
+             const smat<GF3D5<T>, dim> &gf_,
+             const smat<vec<GF3D5<T>, dim>, dim> &dgf_,
+             const smat<smat<GF3D5<T>, dim>, dim> &ddgf_,
+             const GF3D5layout &layout, const vect<int, dim> &imin,
+             const vect<int, dim> &imax) {
   for (int a = 0; a < 3; ++a)
     for (int b = a; b < 3; ++b)
-      calc_derivs2(cctkGH, gf0_(a, b), gf_(a, b), dgf_(a, b), ddgf_(a, b),
-                   layout);
-}
-
-template <typename T>
-CCTK_ATTRIBUTE_NOINLINE void
-apply_upwind_diss(const cGH *restrict const cctkGH, const GF3D2<const T> &gf_,
-                  const vec<GF3D2<const T>, dim> &gf_betaG_,
-                  const GF3D2<T> &gf_rhs_) {
-  DECLARE_CCTK_ARGUMENTS;
-  DECLARE_CCTK_PARAMETERS;
-
-  const vec<CCTK_REAL, dim> dx([&](int a) { return CCTK_DELTA_SPACE(a); });
-
-  typedef simd<CCTK_REAL> vreal;
-  typedef simdl<CCTK_REAL> vbool;
-  constexpr size_t vsize = tuple_size_v<vreal>;
-
-  if (epsdiss == 0) {
-
-    const Loop::GridDescBaseDevice grid(cctkGH);
-    grid.loop_int_device<0, 0, 0, vsize>(
-        grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
-          const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
-          const vec<vreal, dim> betaG = gf_betaG_(mask, p.I);
-          const vreal rhs_old = gf_rhs_(mask, p.I);
-          const vreal rhs_new =
-              rhs_old + deriv_upwind(mask, gf_, p.I, betaG, dx);
-          gf_rhs_.store(mask, p.I, rhs_new);
-        });
-
-  } else {
-
-    const Loop::GridDescBaseDevice grid(cctkGH);
-    grid.loop_int_device<0, 0, 0, vsize>(
-        grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
-          const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
-          const vec<vreal, dim> betaG = gf_betaG_(mask, p.I);
-          const vreal rhs_old = gf_rhs_(mask, p.I);
-          const vreal rhs_new = rhs_old +
-                                deriv_upwind(mask, gf_, p.I, betaG, dx) +
-                                epsdiss * diss(mask, gf_, p.I, dx);
-          gf_rhs_.store(mask, p.I, rhs_new);
-        });
-  }
+      calc_derivs2<deriv_order>(cctkGH, gf0_(a, b), gf_(a, b), dgf_(a, b),
+                                ddgf_(a, b), layout, imin, imax);
 }
 
 } // namespace Z4c
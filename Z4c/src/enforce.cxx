@@ -1,8 +1,10 @@
+#include "deriv_cache.hxx"
 #include "physics.hxx"
 
 #include <loop_device.hxx>
 #include <mat.hxx>
 #include <simd.hxx>
+#include <timers.hxx>
 #include <vec.hxx>
 
 #include <cctk.h>
@@ -19,6 +21,7 @@
 namespace Z4c {
 using namespace Arith;
 using namespace Loop;
+using namespace SpacetimeUtils;
 using namespace std;
 
 extern "C" void Z4c_Enforce(CCTK_ARGUMENTS) {
@@ -46,6 +49,15 @@ extern "C" void Z4c_Enforce(CCTK_ARGUMENTS) {
 
   const auto delta3 = one<smat<vreal, 3> >()();
 
+  // Read and write 14 state variables
+  static const kernel_t kernel{"Z4c enforce", 0, 28 * 8};
+  vect<int, dim> imin, imax;
+  grid.box_int<0, 0, 0>(grid.nghostzones, imin, imax);
+  const kernel_timer_t timer(kernel, prod(imax - imin));
+
+  // The state is about to change, so cached derivatives become stale
+  invalidate_cached_derivs(cctkGH, imin, imax);
+
 #ifdef __CUDACC__
   const nvtxRangeId_t range = nvtxRangeStartA("Z4c_Enforce::enforce");
 #endif
@@ -0,0 +1,129 @@
+#include "excision.hxx"
+
+#include <cctk.h>
+#include <cctk_Arguments.h>
+#include <cctk_Parameters.h>
+
+#include <cmath>
+
+namespace Z4c {
+using namespace std;
+
+namespace {
+excision_t current_excision{0, {}, {}};
+
+// The sphere excised for each horizon, fixed when the horizon is first
+// found
+struct fixed_sphere_t {
+  bool active;
+  CCTK_REAL centre[dim];
+  CCTK_REAL radius;
+};
+fixed_sphere_t fixed_spheres[excision_t::max_spheres]{};
+} // namespace
+
+bool excision_t::box_inside(const cGH *restrict const cctkGH,
+                            const vect<int, dim> &imin,
+                            const vect<int, dim> &imax) const {
+  if (nspheres == 0)
+    return false;
+  // A sphere is convex, so it contains the box if it contains all of
+  // its corners
+  const GridDescBase grid(cctkGH);
+  const auto coord = [&](const int d, const int i) {
+    return grid.x0[d] + (grid.lbnd[d] + i) * grid.dx[d];
+  };
+  for (int s = 0; s < nspheres; ++s) {
+    bool contains = true;
+    for (int k : {imin[2], imax[2] - 1})
+      for (int j : {imin[1], imax[1] - 1})
+        for (int i : {imin[0], imax[0] - 1})
+          contains &= inside(s, coord(0, i), coord(1, j), coord(2, k));
+    if (contains)
+      return true;
+  }
+  return false;
+}
+
+excision_t get_excision() { return current_excision; }
+
+extern "C" void Z4c_SetupExcision(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_SetupExcision;
+  DECLARE_CCTK_PARAMETERS;
+
+  current_excision.nspheres = 0;
+  if (!excise_horizon)
+    return;
+
+  const auto get_var = [&](const char *const varname) {
+    const int vi = CCTK_VarIndex(varname);
+    if (vi < 0)
+      CCTK_VERROR("Excision requires the variable \"%s\"; activate the thorn "
+                  "AHFinderX",
+                  varname);
+    const void *const ptr = CCTK_VarDataPtrI(cctkGH, 0, vi);
+    if (!ptr)
+      CCTK_VERROR("Variable \"%s\" has no storage", varname);
+    return ptr;
+  };
+  const CCTK_INT *const found =
+      static_cast<const CCTK_INT *>(get_var("AHFinder::ah_found"));
+  const char *const varnames[] = {"AHFinder::ah_pos_x", "AHFinder::ah_pos_y",
+                                  "AHFinder::ah_pos_z", "AHFinder::ah_radius"};
+  const CCTK_REAL *values[4];
+  for (int n = 0; n < 4; ++n)
+    values[n] = static_cast<const CCTK_REAL *>(get_var(varnames[n]));
+
+  int num_horizons;
+  const int ierr =
+      CCTK_GrouplshGN(cctkGH, 1, &num_horizons, "AHFinder::found");
+  if (ierr)
+    CCTK_ERROR("Cannot determine the number of horizons");
+  if (num_horizons > excision_t::max_spheres)
+    CCTK_VERROR("Excision supports at most %d horizons",
+                excision_t::max_spheres);
+
+  // Each sphere is fixed when its horizon is first found, i.e. when the
+  // most recent search found it; before that, AHFinderX holds only the
+  // initial guess. The spheres do not follow the horizons: the frozen
+  // data are not extrapolated, and points leaving a moving sphere would
+  // resume their evolution from outdated values. Excision is therefore
+  // restricted to horizons at rest, and every later find checks that
+  // the sphere still lies inside its horizon. A sphere is kept while
+  // its horizon is not found.
+  for (int h = 0; h < num_horizons; ++h) {
+    if (!found[h])
+      continue;
+    fixed_sphere_t &sphere = fixed_spheres[h];
+    if (!sphere.active) {
+      sphere.active = true;
+      for (int d = 0; d < dim; ++d)
+        sphere.centre[d] = values[d][h];
+      sphere.radius = excision_radius_factor * values[3][h];
+      continue;
+    }
+    CCTK_REAL dist2 = 0;
+    for (int d = 0; d < dim; ++d)
+      dist2 += pow2(values[d][h] - sphere.centre[d]);
+    if (!(sqrt(dist2) + sphere.radius <= values[3][h]))
+      CCTK_VERROR("The excised sphere at (%g,%g,%g) with radius %g is no "
+                  "longer inside horizon %d at (%g,%g,%g) with radius %g. "
+                  "Excision supports only horizons at rest.",
+                  double(sphere.centre[0]), double(sphere.centre[1]),
+                  double(sphere.centre[2]), double(sphere.radius), h,
+                  double(values[0][h]), double(values[1][h]),
+                  double(values[2][h]), double(values[3][h]));
+  }
+
+  for (int h = 0; h < num_horizons; ++h) {
+    const fixed_sphere_t &sphere = fixed_spheres[h];
+    if (!sphere.active)
+      continue;
+    const int s = current_excision.nspheres++;
+    for (int d = 0; d < dim; ++d)
+      current_excision.centre[s][d] = sphere.centre[d];
+    current_excision.radius[s] = sphere.radius;
+  }
+}
+
+} // namespace Z4c
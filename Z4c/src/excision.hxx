@@ -0,0 +1,59 @@
+#ifndef EXCISION_HXX
+#define EXCISION_HXX
+
+#include <loop_device.hxx>
+#include <simd.hxx>
+#include <vect.hxx>
+
+#include <cctk.h>
+
+#include <cmath>
+
+namespace Z4c {
+using namespace Arith;
+using namespace Loop;
+
+// Spheres deep inside the apparent horizons, one per horizon. The
+// state variables are held frozen there, i.e. their RHS is set to zero,
+// and neither the RHS nor the constraints are evaluated.
+struct excision_t {
+  // AHFinderX finds at most this many horizons
+  static constexpr int max_spheres = 10;
+  int nspheres;
+  CCTK_REAL centre[max_spheres][dim];
+  CCTK_REAL radius[max_spheres];
+
+  // Whether a point lies inside sphere s
+  template <typename T>
+  inline ARITH_INLINE ARITH_DEVICE ARITH_HOST auto
+  inside(const int s, const T &x, const T &y, const T &z) const {
+    return pow2(x - centre[s][0]) + pow2(y - centre[s][1]) +
+               pow2(z - centre[s][2]) <
+           pow2(radius[s]);
+  }
+
+  // Whether all points of the SIMD vector starting at `p` are excised.
+  // Points are only skipped in whole vectors, and only if the whole
+  // vector lies in one sphere.
+  inline ARITH_INLINE ARITH_DEVICE ARITH_HOST bool
+  all_inside(const PointDesc &p) const {
+    typedef simd<CCTK_REAL> vreal;
+    for (int s = 0; s < nspheres; ++s)
+      if (all(inside(s, p.X[0] + iota<vreal>() * p.DX[0], vreal(p.X[1]),
+                     vreal(p.X[2]))))
+        return true;
+    return false;
+  }
+
+  // Whether all points of the box [imin, imax) lie in one sphere
+  bool box_inside(const cGH *restrict const cctkGH, const vect<int, dim> &imin,
+                  const vect<int, dim> &imax) const;
+};
+
+// The excised region for the current RHS or analysis evaluation, as
+// set up by `Z4c_SetupExcision`
+excision_t get_excision();
+
+} // namespace Z4c
+
+#endif // #ifndef EXCISION_HXX
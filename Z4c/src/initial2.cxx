@@ -6,6 +6,7 @@
 
 #include <cctk.h>
 #include <cctk_Arguments.h>
+#include <cctk_Parameters.h>
 
 #ifdef __CUDACC__
 #include <nvToolsExt.h>
@@ -16,7 +17,7 @@ using namespace Arith;
 using namespace Loop;
 using namespace std;
 
-extern "C" void Z4c_Initial2(CCTK_ARGUMENTS) {
+template <int order> void Z4c_Initial2_order(CCTK_ARGUMENTS) {
   DECLARE_CCTK_ARGUMENTS_Z4c_Initial2;
 
   const vec<CCTK_REAL, 3> dx{
@@ -63,7 +64,7 @@ extern "C" void Z4c_Initial2(CCTK_ARGUMENTS) {
             calc_inv(delta3 + gammat, vreal(1)) - delta3;
 
         const smat<vec<vreal, 3>, 3> dgammat([&](int a, int b) {
-          return deriv(mask, gf_gammat1(a, b), p.I, dx);
+          return deriv<order>(mask, gf_gammat1(a, b), p.I, dx);
         });
 
         const vec<smat<vreal, 3>, 3> Gammatl = calc_gammal(dgammat);
@@ -83,4 +84,12 @@ extern "C" void Z4c_Initial2(CCTK_ARGUMENTS) {
 #endif
 }
 
+extern "C" void Z4c_Initial2(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_PARAMETERS;
+
+  dispatch_deriv_order(deriv_order, [&](const auto order) {
+    Z4c_Initial2_order<decltype(order)::value>(cctkGH);
+  });
+}
+
 } // namespace Z4c
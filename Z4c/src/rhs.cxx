@@ -8,13 +8,17 @@
 #endif
 #endif
 
+#include "deriv_cache.hxx"
 #include "derivs.hxx"
+#include "excision.hxx"
 #include "physics.hxx"
 #include "z4c_vars.hxx"
 
 #include <loop_device.hxx>
 #include <mat.hxx>
+#include <scratch.hxx>
 #include <simd.hxx>
+#include <timers.hxx>
 #include <vec.hxx>
 
 #include <cctk.h>
@@ -25,20 +29,54 @@
 #include <nvToolsExt.h>
 #endif
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
 
 namespace Z4c {
 using namespace Arith;
 using namespace Loop;
+using namespace SpacetimeUtils;
 using namespace std;
 
-extern "C" void Z4c_RHS(CCTK_ARGUMENTS) {
+// Store the RHS `F`. With `accumulate`, the RHS variables instead hold
+// the register of a low-storage (2N) Runge-Kutta method, and `F` is
+// added to it as `rhs = a * rhs + dt * F`.
+struct rhs_store_t {
+  bool accumulate;
+  CCTK_REAL a, dt;
+
+  template <typename GF, typename T>
+  inline ARITH_INLINE ARITH_DEVICE ARITH_HOST void
+  operator()(const GF &gf_rhs1, const simdl<CCTK_REAL> &mask,
+             const GF3D2index &index1, const T &F) const {
+    if (accumulate)
+      gf_rhs1.store(mask, index1, a * gf_rhs1(mask, index1) + dt * F);
+    else
+      gf_rhs1.store(mask, index1, F);
+  }
+};
+
+// Defined in test.cxx
+void test_rhs_tiling(const cGH *restrict const cctkGH,
+                     const function<void(bool tiled)> &calc_rhs);
+void test_rhs_accumulation(
+    const cGH *restrict const cctkGH,
+    const function<void(bool accumulate, CCTK_REAL a, CCTK_REAL dt)>
+        &calc_rhs);
+
+// Calculate the RHS, either tile by tile or for the whole box at once.
+// Derivatives that Z4c_ADM2 cached for the current state are used
+// instead of either; the RHS never adds to the cache.
+template <int order>
+void Z4c_RHS_order(CCTK_ARGUMENTS, const bool tiled, const bool use_cache,
+                   const rhs_store_t &store_rhs) {
   DECLARE_CCTK_ARGUMENTS_Z4c_RHS;
   DECLARE_CCTK_PARAMETERS;
 
   for (int d = 0; d < 3; ++d)
-    if (cctk_nghostzones[d] < deriv_order / 2 + 1)
-      CCTK_VERROR("Need at least %d ghost zones", deriv_order / 2 + 1);
+    if (cctk_nghostzones[d] < order / 2 + 1)
+      CCTK_VERROR("Need at least %d ghost zones", order / 2 + 1);
 
   //
 
@@ -87,75 +125,6 @@ extern "C" void Z4c_RHS(CCTK_ARGUMENTS) {
 
   //
 
-  // Ideas:
-  //
-  // - Outline certain functions, e.g. `det` or `raise_index`. Ensure
-  //   they are called with floating-point arguments, not tensor
-  //   indices.
-
-  const int ntmps = 154;
-  GF3D5vector<CCTK_REAL> tmps(layout0, ntmps);
-  int itmp = 0;
-
-  const auto make_gf = [&]() { return GF3D5<CCTK_REAL>(tmps(itmp++)); };
-  const auto make_vec = [&](const auto &f) {
-    return vec<result_of_t<decltype(f)()>, 3>([&](int) { return f(); });
-  };
-  const auto make_mat = [&](const auto &f) {
-    return smat<result_of_t<decltype(f)()>, 3>([&](int, int) { return f(); });
-  };
-  const auto make_vec_gf = [&]() { return make_vec(make_gf); };
-  const auto make_mat_gf = [&]() { return make_mat(make_gf); };
-  const auto make_vec_vec_gf = [&]() { return make_vec(make_vec_gf); };
-  const auto make_vec_mat_gf = [&]() { return make_vec(make_mat_gf); };
-  const auto make_mat_vec_gf = [&]() { return make_mat(make_vec_gf); };
-  const auto make_mat_mat_gf = [&]() { return make_mat(make_mat_gf); };
-
-  const GF3D5<CCTK_REAL> gf_chi0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dchi0(make_vec_gf());
-  const smat<GF3D5<CCTK_REAL>, 3> gf_ddchi0(make_mat_gf());
-  calc_derivs2(cctkGH, gf_chi1, gf_chi0, gf_dchi0, gf_ddchi0, layout0);
-
-  const smat<GF3D5<CCTK_REAL>, 3> gf_gammat0(make_mat_gf());
-  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dgammat0(make_mat_vec_gf());
-  const smat<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddgammat0(make_mat_mat_gf());
-  calc_derivs2(cctkGH, gf_gammat1, gf_gammat0, gf_dgammat0, gf_ddgammat0,
-               layout0);
-
-  const GF3D5<CCTK_REAL> gf_Kh0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dKh0(make_vec_gf());
-  calc_derivs(cctkGH, gf_Kh1, gf_Kh0, gf_dKh0, layout0);
-
-  const smat<GF3D5<CCTK_REAL>, 3> gf_At0(make_mat_gf());
-  const smat<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dAt0(make_mat_vec_gf());
-  calc_derivs(cctkGH, gf_At1, gf_At0, gf_dAt0, layout0);
-
-  const vec<GF3D5<CCTK_REAL>, 3> gf_Gamt0(make_vec_gf());
-  const vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dGamt0(make_vec_vec_gf());
-  calc_derivs(cctkGH, gf_Gamt1, gf_Gamt0, gf_dGamt0, layout0);
-
-  const GF3D5<CCTK_REAL> gf_Theta0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dTheta0(make_vec_gf());
-  calc_derivs(cctkGH, gf_Theta1, gf_Theta0, gf_dTheta0, layout0);
-
-  const GF3D5<CCTK_REAL> gf_alphaG0(make_gf());
-  const vec<GF3D5<CCTK_REAL>, 3> gf_dalphaG0(make_vec_gf());
-  const smat<GF3D5<CCTK_REAL>, 3> gf_ddalphaG0(make_mat_gf());
-  calc_derivs2(cctkGH, gf_alphaG1, gf_alphaG0, gf_dalphaG0, gf_ddalphaG0,
-               layout0);
-
-  const vec<GF3D5<CCTK_REAL>, 3> gf_betaG0(make_vec_gf());
-  const vec<vec<GF3D5<CCTK_REAL>, 3>, 3> gf_dbetaG0(make_vec_vec_gf());
-  const vec<smat<GF3D5<CCTK_REAL>, 3>, 3> gf_ddbetaG0(make_vec_mat_gf());
-  calc_derivs2(cctkGH, gf_betaG1, gf_betaG0, gf_dbetaG0, gf_ddbetaG0, layout0);
-
-  if (itmp != ntmps)
-    CCTK_VERROR("Wrong number of temporary variables: ntmps=%d itmp=%d", ntmps,
-                itmp);
-  itmp = -1;
-
-  //
-
   const GF3D2<const CCTK_REAL> gf_eTtt1(layout1, eTtt);
 
   const vec<GF3D2<const CCTK_REAL>, 3> gf_eTti1{
@@ -212,147 +181,222 @@ extern "C" void Z4c_RHS(CCTK_ARGUMENTS) {
 
   const Loop::GridDescBaseDevice grid(cctkGH);
 
-#if 1
+  const vec<CCTK_REAL, dim> dx([&](int a) { return CCTK_DELTA_SPACE(a); });
 
-#ifdef __CUDACC__
-  const nvtxRangeId_t range = nvtxRangeStartA("Z4c_RHS::rhs");
-#endif
-  noinline([&]() __attribute__((__flatten__, __hot__)) {
-    grid.loop_int_device<0, 0, 0, vsize>(
-        grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
-          const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
-          const GF3D2index index1(layout1, p.I);
-          const GF3D5index index0(layout0, p.I);
-
-          // Load and calculate
-          const z4c_vars<vreal> vars(
-              set_Theta_zero, kappa1, kappa2, f_mu_L, f_mu_S, eta, //
-              gf_chi0(mask, index0), gf_dchi0(mask, index0),
-              gf_ddchi0(mask, index0), //
-              gf_gammat0(mask, index0), gf_dgammat0(mask, index0),
-              gf_ddgammat0(mask, index0),                        //
-              gf_Kh0(mask, index0), gf_dKh0(mask, index0),       //
-              gf_At0(mask, index0), gf_dAt0(mask, index0),       //
-              gf_Gamt0(mask, index0), gf_dGamt0(mask, index0),   //
-              gf_Theta0(mask, index0), gf_dTheta0(mask, index0), //
-              gf_alphaG0(mask, index0), gf_dalphaG0(mask, index0),
-              gf_ddalphaG0(mask, index0), //
-              gf_betaG0(mask, index0), gf_dbetaG0(mask, index0),
-              gf_ddbetaG0(mask, index0), //
-              gf_eTtt1(mask, index1), gf_eTti1(mask, index1),
-              gf_eTij1(mask, index1));
-
-          gf_chi_rhs1.store(mask, index1, vars.chi_rhs);
-          gf_gammat_rhs1.store(mask, index1, vars.gammat_rhs);
-          gf_Kh_rhs1.store(mask, index1, vars.Kh_rhs);
-          gf_At_rhs1.store(mask, index1, vars.At_rhs);
-          gf_Gamt_rhs1.store(mask, index1, vars.Gamt_rhs);
-          gf_Theta_rhs1.store(mask, index1, vars.Theta_rhs);
-          gf_alphaG_rhs1.store(mask, index1, vars.alphaG_rhs);
-          gf_betaG_rhs1.store(mask, index1, vars.betaG_rhs);
-        });
-  });
-#ifdef __CUDACC__
-  nvtxRangeEnd(range);
-#endif
+  const excision_t excision = get_excision();
 
-#else
+  // Ideas:
+  //
+  // - Outline certain functions, e.g. `det` or `raise_index`. Ensure
+  //   they are called with floating-point arguments, not tensor
+  //   indices.
 
-  noinline([&]() __attribute__((__flatten__, __hot__)) {
-    grid.loop_int_device<0, 0, 0, vsize>(
-        grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
-          const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
-          const GF3D2index index1(layout1, p.I);
-          const GF3D5index index0(layout0, p.I);
-
-          // Load and calculate
-          const z4c_vars<vreal> vars(
-              kappa1, kappa2, f_mu_L, f_mu_S, eta, //
-              gf_chi0(mask, index0), gf_dchi0(mask, index0),
-              gf_ddchi0(mask, index0), //
-              gf_gammat0(mask, index0), gf_dgammat0(mask, index0),
-              gf_ddgammat0(mask, index0),                        //
-              gf_Kh0(mask, index0), gf_dKh0(mask, index0),       //
-              gf_At0(mask, index0), gf_dAt0(mask, index0),       //
-              gf_Gamt0(mask, index0), gf_dGamt0(mask, index0),   //
-              gf_Theta0(mask, index0), gf_dTheta0(mask, index0), //
-              gf_alphaG0(mask, index0), gf_dalphaG0(mask, index0),
-              gf_ddalphaG0(mask, index0), //
-              gf_betaG0(mask, index0), gf_dbetaG0(mask, index0),
-              gf_ddbetaG0(mask, index0), //
-              gf_eTtt1(mask, index1), gf_eTti1(mask, index1),
-              gf_eTij1(mask, index1));
-
-          // Store Kh_rhs, At_rhs, Gamt_rhs, Theta_rhs
-          gf_Kh_rhs1.store(mask, index1, vars.Kh_rhs);
-          gf_At_rhs1.store(mask, index1, vars.At_rhs);
-          gf_Gamt_rhs1.store(mask, index1, vars.Gamt_rhs);
-          gf_Theta_rhs1.store(mask, index1, vars.Theta_rhs);
-        });
-  });
+  // Calculate the RHS in the box [bmin, bmax), which must lie in the
+  // interior, from the derivatives `derivs` with layout `layout0`
+  const auto calc_rhs = [&](const GF3D5layout &layout0,
+                            const vect<int, dim> &bmin,
+                            const vect<int, dim> &bmax,
+                            const z4c_derivs_t &derivs) {
+    // Read 154 temporaries, 25 state variables, and 10 components of
+    // Tmunu, write 25 RHS variables; the flop count includes upwinding
+    // and dissipation, which are fused into this loop (see README)
+    static const kernel_t kernel{"Z4c RHS", 1865 + 1980, 214 * 8};
+    const kernel_timer_t timer(kernel, prod(bmax - bmin));
+    const vect<int, dim> inormal{0, 0, 0};
+
+    noinline([&]() __attribute__((__flatten__, __hot__)) {
+      grid.loop_box_device<0, 0, 0, vsize>(
+          [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+            const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
+            const GF3D2index index1(layout1, p.I);
+            const GF3D5index index0(layout0, p.I);
+
+            // Hold excised points frozen
+            if (excision.all_inside(p)) {
+              store_rhs(gf_chi_rhs1, mask, index1, zero<vreal>()());
+              store_rhs(gf_gammat_rhs1, mask, index1,
+                        zero<smat<vreal, 3> >()());
+              store_rhs(gf_Kh_rhs1, mask, index1, zero<vreal>()());
+              store_rhs(gf_At_rhs1, mask, index1, zero<smat<vreal, 3> >()());
+              store_rhs(gf_Gamt_rhs1, mask, index1, zero<vec<vreal, 3> >()());
+              store_rhs(gf_Theta_rhs1, mask, index1, zero<vreal>()());
+              store_rhs(gf_alphaG_rhs1, mask, index1, zero<vreal>()());
+              store_rhs(gf_betaG_rhs1, mask, index1, zero<vec<vreal, 3> >()());
+              return;
+            }
+
+            // Load and calculate
+            const z4c_vars<vreal> vars(
+                set_Theta_zero, kappa1, kappa2, f_mu_L, f_mu_S, eta, //
+                derivs.gf_chi0(mask, index0), derivs.gf_dchi0(mask, index0),
+                derivs.gf_ddchi0(mask, index0), //
+                derivs.gf_gammat0(mask, index0),
+                derivs.gf_dgammat0(mask, index0),
+                derivs.gf_ddgammat0(mask, index0), //
+                derivs.gf_Kh0(mask, index0), derivs.gf_dKh0(mask, index0), //
+                derivs.gf_At0(mask, index0), derivs.gf_dAt0(mask, index0), //
+                derivs.gf_Gamt0(mask, index0),
+                derivs.gf_dGamt0(mask, index0), //
+                derivs.gf_Theta0(mask, index0),
+                derivs.gf_dTheta0(mask, index0), //
+                derivs.gf_alphaG0(mask, index0),
+                derivs.gf_dalphaG0(mask, index0),
+                derivs.gf_ddalphaG0(mask, index0), //
+                derivs.gf_betaG0(mask, index0), derivs.gf_dbetaG0(mask, index0),
+                derivs.gf_ddbetaG0(mask, index0), //
+                gf_eTtt1(mask, index1), gf_eTti1(mask, index1),
+                gf_eTij1(mask, index1));
+
+            // Upwind and dissipation terms
+            const auto ud = [&](const auto &gf1) ARITH_INLINE {
+              return upwind_diss<order>(mask, gf1, p.I, vars.betaG, dx,
+                                        epsdiss);
+            };
+
+            store_rhs(gf_chi_rhs1, mask, index1, vars.chi_rhs + ud(gf_chi1));
+            store_rhs(gf_gammat_rhs1, mask, index1,
+                      vars.gammat_rhs + ud(gf_gammat1));
+            store_rhs(gf_Kh_rhs1, mask, index1, vars.Kh_rhs + ud(gf_Kh1));
+            store_rhs(gf_At_rhs1, mask, index1, vars.At_rhs + ud(gf_At1));
+            store_rhs(gf_Gamt_rhs1, mask, index1, vars.Gamt_rhs + ud(gf_Gamt1));
+            store_rhs(gf_Theta_rhs1, mask, index1,
+                      set_Theta_zero ? vars.Theta_rhs
+                                     : vars.Theta_rhs + ud(gf_Theta1));
+            store_rhs(gf_alphaG_rhs1, mask, index1,
+                      vars.alphaG_rhs + ud(gf_alphaG1));
+            store_rhs(gf_betaG_rhs1, mask, index1,
+                      vars.betaG_rhs + ud(gf_betaG1));
+          },
+          bmin, bmax, inormal);
+    });
+  };
 
-  noinline([&]() __attribute__((__flatten__, __hot__)) {
-    grid.loop_int_device<0, 0, 0, vsize>(
-        grid.nghostzones, [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
+  // Hold the state frozen in the box [bmin, bmax), which lies completely
+  // inside the excised region
+  const auto freeze_rhs = [&](const vect<int, dim> &bmin,
+                              const vect<int, dim> &bmax) {
+    const vect<int, dim> inormal{0, 0, 0};
+    grid.loop_box_device<0, 0, 0, vsize>(
+        [=] ARITH_DEVICE(const PointDesc &p) ARITH_INLINE {
           const vbool mask = mask_for_loop_tail<vbool>(p.i, p.imax);
           const GF3D2index index1(layout1, p.I);
-          const GF3D5index index0(layout0, p.I);
-
-          // Load and calculate
-          const z4c_vars<vreal> vars(
-              kappa1, kappa2, f_mu_L, f_mu_S, eta, //
-              gf_chi0(mask, index0), gf_dchi0(mask, index0),
-              gf_ddchi0(mask, index0), //
-              gf_gammat0(mask, index0), gf_dgammat0(mask, index0),
-              gf_ddgammat0(mask, index0),                        //
-              gf_Kh0(mask, index0), gf_dKh0(mask, index0),       //
-              gf_At0(mask, index0), gf_dAt0(mask, index0),       //
-              gf_Gamt0(mask, index0), gf_dGamt0(mask, index0),   //
-              gf_Theta0(mask, index0), gf_dTheta0(mask, index0), //
-              gf_alphaG0(mask, index0), gf_dalphaG0(mask, index0),
-              gf_ddalphaG0(mask, index0), //
-              gf_betaG0(mask, index0), gf_dbetaG0(mask, index0),
-              gf_ddbetaG0(mask, index0), //
-              gf_eTtt1(mask, index1), gf_eTti1(mask, index1),
-              gf_eTij1(mask, index1));
-
-          // Store chi_rhs, gammat_rhs, alphaG_rhs, betaG_rhs
-          gf_chi_rhs1.store(mask, index1, vars.chi_rhs);
-          gf_gammat_rhs1.store(mask, index1, vars.gammat_rhs);
-          gf_alphaG_rhs1.store(mask, index1, vars.alphaG_rhs);
-          gf_betaG_rhs1.store(mask, index1, vars.betaG_rhs);
-        });
-  });
+          store_rhs(gf_chi_rhs1, mask, index1, zero<vreal>()());
+          store_rhs(gf_gammat_rhs1, mask, index1, zero<smat<vreal, 3> >()());
+          store_rhs(gf_Kh_rhs1, mask, index1, zero<vreal>()());
+          store_rhs(gf_At_rhs1, mask, index1, zero<smat<vreal, 3> >()());
+          store_rhs(gf_Gamt_rhs1, mask, index1, zero<vec<vreal, 3> >()());
+          store_rhs(gf_Theta_rhs1, mask, index1, zero<vreal>()());
+          store_rhs(gf_alphaG_rhs1, mask, index1, zero<vreal>()());
+          store_rhs(gf_betaG_rhs1, mask, index1, zero<vec<vreal, 3> >()());
+        },
+        bmin, bmax, inormal);
+  };
 
+#ifdef __CUDACC__
+  const nvtxRangeId_t range = nvtxRangeStartA("Z4c_RHS::rhs");
 #endif
 
-  // Upwind and dissipation terms
-
-  // TODO: Consider fusing the loops to reduce memory bandwidth
-
-  apply_upwind_diss(cctkGH, gf_chi1, gf_betaG1, gf_chi_rhs1);
-
-  for (int a = 0; a < 3; ++a)
-    for (int b = a; b < 3; ++b)
-      apply_upwind_diss(cctkGH, gf_gammat1(a, b), gf_betaG1,
-                        gf_gammat_rhs1(a, b));
-
-  apply_upwind_diss(cctkGH, gf_Kh1, gf_betaG1, gf_Kh_rhs1);
-
-  for (int a = 0; a < 3; ++a)
-    for (int b = a; b < 3; ++b)
-      apply_upwind_diss(cctkGH, gf_At1(a, b), gf_betaG1, gf_At_rhs1(a, b));
-
-  for (int a = 0; a < 3; ++a)
-    apply_upwind_diss(cctkGH, gf_Gamt1(a), gf_betaG1, gf_Gamt_rhs1(a));
+  // Skip boxes that are completely excised, including their derivatives
+  if (excision.box_inside(cctkGH, imin, imax)) {
+    freeze_rhs(imin, imax);
+#ifdef __CUDACC__
+    nvtxRangeEnd(range);
+#endif
+    return;
+  }
+
+  const auto cached_derivs =
+      use_cache ? find_cached_derivs(cctkGH, imin, imax) : nullptr;
+
+#ifndef __CUDACC__
+  if (tiled && !cached_derivs) {
+
+    // Cut the interior into tiles that fit into the cache. The
+    // derivatives for each tile are stored in a small scratch buffer
+    // that is consumed right away.
+    const vect<int, dim> tile_size{rhs_tile_size_x, rhs_tile_size_y,
+                                   rhs_tile_size_z};
+    ptrdiff_t max_tile_np = 1;
+    for (int d = 0; d < dim; ++d)
+      max_tile_np *= min(tile_size[d], imax[d] - imin[d]);
+
+    // All tiles of this box share one scratch buffer
+    const int ntmps = z4c_derivs_t::ntmps;
+    const scratch_t scratch(ntmps * max_tile_np);
+
+    for (int k0 = imin[2]; k0 < imax[2]; k0 += tile_size[2]) {
+      for (int j0 = imin[1]; j0 < imax[1]; j0 += tile_size[1]) {
+        for (int i0 = imin[0]; i0 < imax[0]; i0 += tile_size[0]) {
+          const vect<int, dim> tmin{i0, j0, k0};
+          vect<int, dim> tmax;
+          for (int d = 0; d < dim; ++d)
+            tmax[d] = min(tmin[d] + tile_size[d], imax[d]);
+          if (excision.box_inside(cctkGH, tmin, tmax)) {
+            freeze_rhs(tmin, tmax);
+            continue;
+          }
+          const GF3D5layout tile_layout0(tmin, tmax);
+          const z4c_derivs_t tile_derivs =
+              z4c_derivs_t::make([&](const int n) {
+                return GF3D5<CCTK_REAL>(
+                    tile_layout0, scratch.data() + n * tile_layout0.np);
+              });
+          tile_derivs.calc<order>(cctkGH, tile_layout0, tmin, tmax, gf_chi1,
+                                  gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1,
+                                  gf_Theta1, gf_alphaG1, gf_betaG1);
+          calc_rhs(tile_layout0, tmin, tmax, tile_derivs);
+        }
+      }
+    }
+
+  } else
+#endif
+  {
+
+    if (cached_derivs) {
+      calc_rhs(layout0, imin, imax, cached_derivs->derivs);
+    } else {
+      // Do not cache these derivatives: the state changes right after
+      // the RHS, so that nothing could read them again
+      const deriv_storage_t storage(layout0);
+      storage.derivs.calc<order>(cctkGH, layout0, imin, imax, gf_chi1,
+                                 gf_gammat1, gf_Kh1, gf_At1, gf_Gamt1,
+                                 gf_Theta1, gf_alphaG1, gf_betaG1);
+      calc_rhs(layout0, imin, imax, storage.derivs);
+    }
+  }
 
-  if (!set_Theta_zero)
-    apply_upwind_diss(cctkGH, gf_Theta1, gf_betaG1, gf_Theta_rhs1);
+#ifdef __CUDACC__
+  nvtxRangeEnd(range);
+#endif
+}
 
-  apply_upwind_diss(cctkGH, gf_alphaG1, gf_betaG1, gf_alphaG_rhs1);
+extern "C" void Z4c_RHS(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_RHS;
+  DECLARE_CCTK_PARAMETERS;
 
-  for (int a = 0; a < 3; ++a)
-    apply_upwind_diss(cctkGH, gf_betaG1(a), gf_betaG1, gf_betaG_rhs1(a));
+  const rhs_store_t store_rhs{bool(rhs_accumulate),
+                              rhs_accumulate ? *rhs_accumulate_a : 0,
+                              rhs_accumulate ? *rhs_accumulate_dt : 0};
+
+  // Instantiate the RHS separately for each finite differencing order
+  dispatch_deriv_order(deriv_order, [&](const auto order) {
+    if (test_rhs_accumulate)
+      test_rhs_accumulation(cctkGH, [&](const bool accumulate,
+                                        const CCTK_REAL a,
+                                        const CCTK_REAL dt) {
+        Z4c_RHS_order<decltype(order)::value>(cctkGH, rhs_tiled, false,
+                                              {accumulate, a, dt});
+      });
+    if (test_rhs_tiled)
+      test_rhs_tiling(cctkGH, [&](const bool tiled) {
+        Z4c_RHS_order<decltype(order)::value>(cctkGH, tiled, false,
+                                              store_rhs);
+      });
+    else
+      Z4c_RHS_order<decltype(order)::value>(cctkGH, rhs_tiled, true,
+                                            store_rhs);
+  });
 }
 
 } // namespace Z4c
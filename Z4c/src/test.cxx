@@ -4,92 +4,36 @@
 #include <defs.hxx>
 #include <simd.hxx>
 
+#include <loop_device.hxx>
+
 #include <cctk.h>
+#include <cctk_Arguments.h>
+#include <cctk_Parameters.h>
 
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <functional>
 #include <iostream>
 #include <random>
+#include <vector>
 
 namespace Z4c {
 using namespace std;
 
 // TODO: Use GoogleTest instead of assert
 
-extern "C" void Z4c_Test(CCTK_ARGUMENTS) {
-  DECLARE_CCTK_ARGUMENTS;
-
+template <int deriv_order> void test_derivs() {
 #ifndef __CUDACC__
-
-  // Test tensors
-
-  mt19937 engine(42);
-  uniform_int_distribution<int> dist(-10, 10);
-  const auto rand10{[&]() { return double(dist(engine)); }};
-  const auto randmat10{[&]() {
-    array<array<double, 3>, 3> arr;
-    for (int a = 0; a < 3; ++a)
-      for (int b = 0; b < 3; ++b)
-        arr[a][b] = rand10();
-    return smat<double, 3>(
-        [&](int a, int b) { return arr[min(a, b)][max(a, b)]; });
-  }};
-
-  const smat<double, 3> Z([&](int a, int b) { return double(0); });
-  const smat<double, 3> I([&](int a, int b) { return double(a == b); });
-  assert(I != Z);
-
-  for (int n = 0; n < 100; ++n) {
-    const smat<double, 3> A = randmat10();
-    const smat<double, 3> B = randmat10();
-    const smat<double, 3> C = randmat10();
-    const double a = rand10();
-    const double b = rand10();
-
-    assert((A + B) + C == A + (B + C));
-    assert(Z + A == A);
-    assert(A + Z == A);
-    assert(A + (-A) == Z);
-    assert((-A) + A == Z);
-    assert(A - B == A + (-B));
-    assert(A + B == B + A);
-
-    assert(1 * A == A);
-    assert(0 * A == Z);
-    assert(-1 * A == -A);
-    // assert(mul(a * A, B) == a * mul(A, B));
-    assert((a * b) * A == a * (b * A));
-    assert(a * (A + B) == a * A + a * B);
-    assert((a + b) * A == a * A + b * A);
-
-    // assert(mul(mul(A, B), C) == mul(A, mul(B, C)));
-    // DNUP  assert(mul(I, A) == A);
-    // DNUP  assert(mul(A, I) == A);
-    // DNUP  assert(mul(Z, A) == Z);
-    // DNUP  assert(mul(A, Z) == Z);
-
-    assert(calc_det(Z) == 0);
-    assert(calc_det(I) == 1);
-    assert(calc_det(a * A) == pown(a, 3) * calc_det(A));
-
-    assert(calc_inv(Z, 1.0) == Z);
-    assert(calc_inv(I, 1.0) == I);
-
-    // DNUP assert(mul(A.inv(1), A) == A.det() * Iup);
-    // DNUP assert(mul(A, A.inv(1)) == A.det() * Iup);
-
-    assert(calc_inv(a * A, 1.0) == pow2(a) * calc_inv(A, 1.0));
-  }
-
-  // Test derivatives
-
   static_assert(deriv_order % 2 == 0, "");
   constexpr int required_ghosts = deriv_order / 2 + 1;
   constexpr int fences = 3;
   constexpr int vsize = tuple_size_v<simd<double> >;
-  const double eps = 1.0e-12;
+  // Round-off errors grow with the magnitude of the test polynomials
+  const auto tol = [&](const int order) {
+    return 1.0e-12 * pown(double(vsize + deriv_order), order);
+  };
 
   // deriv
   for (int npoints = 1; npoints <= vsize; ++npoints) {
@@ -104,14 +48,14 @@ extern "C" void Z4c_Test(CCTK_ARGUMENTS) {
       const simd<double> expected =
           order == 0 ? 0 : order * pown(iota<simd<double> >(), order - 1);
       const simdl<double> mask = mask_for_loop_tail<simdl<double> >(0, npoints);
-      const simd<double> found = deriv1d(mask, var, 1, 1.0);
-      if (!(all(fabs(found - expected) <= eps || !mask)))
+      const simd<double> found = deriv1d<deriv_order>(mask, var, 1, 1.0);
+      if (!(all(fabs(found - expected) <= tol(order) || !mask)))
         cout << "deriv:\n"
              << "  npoints: " << npoints << "\n"
              << "  order: " << order << "\n"
              << "  expected: " << expected << "\n"
              << "  found: " << found << "\n";
-      assert(all(fabs(found - expected) <= eps || !mask));
+      assert(all(fabs(found - expected) <= tol(order) || !mask));
     }
   }
 
@@ -132,15 +76,16 @@ extern "C" void Z4c_Test(CCTK_ARGUMENTS) {
             (order == 0 ? 0 : order * pown(iota<simd<double> >(), order - 1));
         const simdl<double> mask =
             mask_for_loop_tail<simdl<double> >(0, npoints);
-        const simd<double> found = deriv1d_upwind(mask, var, 1, vel, 1.0);
-        if (!(all(fabs(found - expected) <= eps || !mask)))
+        const simd<double> found =
+            deriv1d_upwind<deriv_order>(mask, var, 1, vel, 1.0);
+        if (!(all(fabs(found - expected) <= tol(order) || !mask)))
           cout << "deriv_upwind:\n"
                << "  npoints: " << npoints << "\n"
                << "  order: " << order << "\n"
                << "  sign: " << sign << "\n"
                << "  expected: " << expected << "\n"
                << "  found: " << found << "\n";
-        assert(all(fabs(found - expected) <= eps || !mask));
+        assert(all(fabs(found - expected) <= tol(order) || !mask));
       }
     }
   }
@@ -160,14 +105,14 @@ extern "C" void Z4c_Test(CCTK_ARGUMENTS) {
               ? 0
               : order * (order - 1) * pown(iota<simd<double> >(), order - 2);
       const simdl<double> mask = mask_for_loop_tail<simdl<double> >(0, npoints);
-      const simd<double> found = deriv2_1d(mask, var, 1, 1.0);
-      if (!(all(fabs(found - expected) <= eps || !mask)))
+      const simd<double> found = deriv2_1d<deriv_order>(mask, var, 1, 1.0);
+      if (!(all(fabs(found - expected) <= tol(order) || !mask)))
         cout << "deriv_upwind:\n"
              << "  npoints: " << npoints << "\n"
              << "  order: " << order << "\n"
              << "  expected: " << expected << "\n"
              << "  found: " << found << "\n";
-      assert(all(fabs(found - expected) <= eps || !mask));
+      assert(all(fabs(found - expected) <= tol(order) || !mask));
     }
   }
 
@@ -196,15 +141,15 @@ extern "C" void Z4c_Test(CCTK_ARGUMENTS) {
         const simdl<double> mask =
             mask_for_loop_tail<simdl<double> >(0, npoints);
         const simd<double> found =
-            deriv2_2d(npoints, mask, var, di, dj, 1.0, 1.0);
-        if (!(all(fabs(found - expected) <= eps || !mask)))
+            deriv2_2d<deriv_order>(npoints, mask, var, di, dj, 1.0, 1.0);
+        if (!(all(fabs(found - expected) <= tol(orderi + orderj) || !mask)))
           cout << "deriv2_mixed:\n"
                << "  npoints: " << npoints << "\n"
                << "  orderi: " << orderi << "\n"
                << "  orderj: " << orderj << "\n"
                << "  expected: " << expected << "\n"
                << "  found: " << found << "\n";
-        assert(all(fabs(found - expected) <= eps || !mask));
+        assert(all(fabs(found - expected) <= tol(orderi + orderj) || !mask));
       }
     }
   }
@@ -224,18 +169,291 @@ extern "C" void Z4c_Test(CCTK_ARGUMENTS) {
               ? 0
               : factorial(order) * pown(iota<simd<double> >(), 0);
       const simdl<double> mask = mask_for_loop_tail<simdl<double> >(0, npoints);
-      const simd<double> found = deriv1d_diss(mask, var, 1, 1.0);
-      if (!(all(fabs(found - expected) <= eps || !mask)))
+      const simd<double> found = deriv1d_diss<deriv_order>(mask, var, 1, 1.0);
+      if (!(all(fabs(found - expected) <= tol(order) || !mask)))
         cout << "deriv_diss:\n"
              << "  npoints: " << npoints << "\n"
              << "  order: " << order << "\n"
              << "  expected: " << expected << "\n"
              << "  found: " << found << "\n";
-      assert(all(fabs(found - expected) <= eps || !mask));
+      assert(all(fabs(found - expected) <= tol(order) || !mask));
     }
   }
 
+  // Convergence for a smooth function: the errors of the derivatives
+  // decrease as h^deriv_order. The dissipation operator is divided by h
+  // only once, so it decreases as h^(deriv_order+1).
+  {
+    const auto error = [&](const double h, const auto &stencil,
+                           const auto &exact) {
+      array<double, 2 * required_ghosts + vsize> arr;
+      double *const var = &arr[required_ghosts];
+      for (int i = -required_ghosts; i < vsize + required_ghosts; ++i)
+        var[i] = exp(i * h);
+      array<double, vsize> exact_arr;
+      for (int i = 0; i < vsize; ++i)
+        exact_arr[i] = exact(i * h);
+      const simdl<double> mask = mask_for_loop_tail<simdl<double> >(0, vsize);
+      return fabs(stencil(mask, var, h) -
+                  maskz_loadu(mask, exact_arr.data()));
+    };
+    const auto check = [&](const char *const name, const int order,
+                           const auto &stencil, const auto &exact) {
+      const double h = 0.25;
+      const simd<double> error_h = error(h, stencil, exact);
+      const simd<double> error_h2 = error(h / 2, stencil, exact);
+      // Allow for higher order error terms
+      const double ratio = pown(2.0, order);
+      const bool converges = all(error_h >= 0.8 * ratio * error_h2) &&
+                             all(error_h <= 1.25 * ratio * error_h2);
+      if (!converges)
+        cout << "convergence of " << name << ":\n"
+             << "  deriv_order: " << deriv_order << "\n"
+             << "  error(h): " << error_h << "\n"
+             << "  error(h/2): " << error_h2 << "\n";
+      assert(converges);
+    };
+    const auto dexp = [](const double x) { return exp(x); };
+    const auto zero = [](const double x) { return 0.0; };
+    check("deriv", deriv_order,
+          [](const auto &mask, const double *var, const double h) {
+            return deriv1d<deriv_order>(mask, var, 1, h);
+          },
+          dexp);
+    for (int sign = 0; sign <= 1; ++sign) {
+      const simd<double> vel = sign ? -1 : +1;
+      check(
+          "deriv_upwind", deriv_order,
+          [&](const auto &mask, const double *var, const double h) {
+            return deriv1d_upwind<deriv_order>(mask, var, 1, vel, h);
+          },
+          [&](const double x) { return (sign ? -1 : +1) * exp(x); });
+    }
+    check("deriv2", deriv_order,
+          [](const auto &mask, const double *var, const double h) {
+            return deriv2_1d<deriv_order>(mask, var, 1, h);
+          },
+          dexp);
+    check("deriv_diss", deriv_order + 1,
+          [](const auto &mask, const double *var, const double h) {
+            return deriv1d_diss<deriv_order>(mask, var, 1, h);
+          },
+          zero);
+  }
 #endif // #ifndef __CUDACC__
 }
 
+extern "C" void Z4c_Test(CCTK_ARGUMENTS) {
+  DECLARE_CCTK_ARGUMENTS;
+
+#ifndef __CUDACC__
+
+  // Test tensors
+
+  mt19937 engine(42);
+  uniform_int_distribution<int> dist(-10, 10);
+  const auto rand10{[&]() { return double(dist(engine)); }};
+  const auto randmat10{[&]() {
+    array<array<double, 3>, 3> arr;
+    for (int a = 0; a < 3; ++a)
+      for (int b = 0; b < 3; ++b)
+        arr[a][b] = rand10();
+    return smat<double, 3>(
+        [&](int a, int b) { return arr[min(a, b)][max(a, b)]; });
+  }};
+
+  const smat<double, 3> Z([&](int a, int b) { return double(0); });
+  const smat<double, 3> I([&](int a, int b) { return double(a == b); });
+  assert(I != Z);
+
+  for (int n = 0; n < 100; ++n) {
+    const smat<double, 3> A = randmat10();
+    const smat<double, 3> B = randmat10();
+    const smat<double, 3> C = randmat10();
+    const double a = rand10();
+    const double b = rand10();
+
+    assert((A + B) + C == A + (B + C));
+    assert(Z + A == A);
+    assert(A + Z == A);
+    assert(A + (-A) == Z);
+    assert((-A) + A == Z);
+    assert(A - B == A + (-B));
+    assert(A + B == B + A);
+
+    assert(1 * A == A);
+    assert(0 * A == Z);
+    assert(-1 * A == -A);
+    // assert(mul(a * A, B) == a * mul(A, B));
+    assert((a * b) * A == a * (b * A));
+    assert(a * (A + B) == a * A + a * B);
+    assert((a + b) * A == a * A + b * A);
+
+    // assert(mul(mul(A, B), C) == mul(A, mul(B, C)));
+    // DNUP  assert(mul(I, A) == A);
+    // DNUP  assert(mul(A, I) == A);
+    // DNUP  assert(mul(Z, A) == Z);
+    // DNUP  assert(mul(A, Z) == Z);
+
+    assert(calc_det(Z) == 0);
+    assert(calc_det(I) == 1);
+    assert(calc_det(a * A) == pown(a, 3) * calc_det(A));
+
+    assert(calc_inv(Z, 1.0) == Z);
+    assert(calc_inv(I, 1.0) == I);
+
+    // DNUP assert(mul(A.inv(1), A) == A.det() * Iup);
+    // DNUP assert(mul(A, A.inv(1)) == A.det() * Iup);
+
+    assert(calc_inv(a * A, 1.0) == pow2(a) * calc_inv(A, 1.0));
+  }
+
+  // Test derivatives
+
+  test_derivs<2>();
+  test_derivs<4>();
+  test_derivs<6>();
+  test_derivs<8>();
+
+#endif // #ifndef __CUDACC__
+}
+
+// Compare the tiled and the untiled RHS for the current box.
+// `calc_rhs(tiled)` calculates the RHS either way. This is called from
+// `Z4c_RHS`. The RHS variables are restored before each calculation
+// since they might be accumulated into. The tiled result is kept.
+void test_rhs_tiling(const cGH *restrict const cctkGH,
+                     const function<void(bool tiled)> &calc_rhs) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_RHS;
+
+  constexpr int nvars = 22;
+  const array<CCTK_REAL *, nvars> vars{
+      chi_rhs,      gammatxx_rhs, gammatxy_rhs, gammatxz_rhs, gammatyy_rhs,
+      gammatyz_rhs, gammatzz_rhs, Kh_rhs,       Atxx_rhs,     Atxy_rhs,
+      Atxz_rhs,     Atyy_rhs,     Atyz_rhs,     Atzz_rhs,     Gamtx_rhs,
+      Gamty_rhs,    Gamtz_rhs,    Theta_rhs,    alphaG_rhs,   betaGx_rhs,
+      betaGy_rhs,   betaGz_rhs};
+
+  const ptrdiff_t np = ptrdiff_t(cctk_ash[0]) * cctk_ash[1] * cctk_ash[2];
+  const auto copy_vars = [&](vector<CCTK_REAL> &buf) {
+    buf.resize(nvars * np);
+    for (int n = 0; n < nvars; ++n)
+      copy(vars[n], vars[n] + np, buf.data() + n * np);
+  };
+  const auto restore_vars = [&](const vector<CCTK_REAL> &buf) {
+    for (int n = 0; n < nvars; ++n)
+      copy(buf.data() + n * np, buf.data() + (n + 1) * np, vars[n]);
+  };
+
+  vector<CCTK_REAL> saved, untiled;
+  copy_vars(saved);
+  calc_rhs(false);
+  copy_vars(untiled);
+  restore_vars(saved);
+  calc_rhs(true);
+
+  // Only the interior is calculated
+  const array<int, Loop::dim> nghostzones{
+      cctk_nghostzones[0], cctk_nghostzones[1], cctk_nghostzones[2]};
+  vect<int, Loop::dim> imin, imax;
+  Loop::GridDescBase(cctkGH).box_int<0, 0, 0>(nghostzones, imin, imax);
+  const Loop::GF3D2layout layout1(cctkGH, {0, 0, 0});
+
+  for (int n = 0; n < nvars; ++n) {
+    CCTK_REAL maxabs = 0, maxdiff = 0;
+    for (int k = imin[2]; k < imax[2]; ++k) {
+      for (int j = imin[1]; j < imax[1]; ++j) {
+        for (int i = imin[0]; i < imax[0]; ++i) {
+          const ptrdiff_t ind = layout1.linear(i, j, k);
+          const CCTK_REAL x = untiled[n * np + ind];
+          const CCTK_REAL y = vars[n][ind];
+          const CCTK_REAL diff = fabs(x - y);
+          maxabs = fmax(maxabs, fmax(fabs(x), fabs(y)));
+          // Keep nans
+          if (isnan(diff) || diff > maxdiff)
+            maxdiff = diff;
+        }
+      }
+    }
+    if (!(maxdiff <= 1.0e-12 * maxabs))
+      CCTK_VERROR("Tiled and untiled RHS differ for RHS variable %d: "
+                  "max |difference| = %g, max |RHS| = %g",
+                  n, double(maxdiff), double(maxabs));
+  }
+}
+
+void test_rhs_accumulation(
+    const cGH *restrict const cctkGH,
+    const function<void(bool accumulate, CCTK_REAL a, CCTK_REAL dt)>
+        &calc_rhs) {
+  DECLARE_CCTK_ARGUMENTS_Z4c_RHS;
+
+  constexpr int nvars = 22;
+  const array<CCTK_REAL *, nvars> vars{
+      chi_rhs,      gammatxx_rhs, gammatxy_rhs, gammatxz_rhs, gammatyy_rhs,
+      gammatyz_rhs, gammatzz_rhs, Kh_rhs,       Atxx_rhs,     Atxy_rhs,
+      Atxz_rhs,     Atyy_rhs,     Atyz_rhs,     Atzz_rhs,     Gamtx_rhs,
+      Gamty_rhs,    Gamtz_rhs,    Theta_rhs,    alphaG_rhs,   betaGx_rhs,
+      betaGy_rhs,   betaGz_rhs};
+
+  const ptrdiff_t np = ptrdiff_t(cctk_ash[0]) * cctk_ash[1] * cctk_ash[2];
+  const auto copy_vars = [&](vector<CCTK_REAL> &buf) {
+    buf.resize(nvars * np);
+    for (int n = 0; n < nvars; ++n)
+      copy(vars[n], vars[n] + np, buf.data() + n * np);
+  };
+  const auto restore_vars = [&](const vector<CCTK_REAL> &buf) {
+    for (int n = 0; n < nvars; ++n)
+      copy(buf.data() + n * np, buf.data() + (n + 1) * np, vars[n]);
+  };
+
+  constexpr CCTK_REAL a = 0.5, dt = 2;
+
+  vector<CCTK_REAL> saved, rhs, old;
+  copy_vars(saved);
+  calc_rhs(false, 0, 0);
+  copy_vars(rhs);
+
+  // Prefill the RHS variables with values unrelated to the RHS
+  mt19937 engine(42);
+  uniform_real_distribution<CCTK_REAL> dist(-1.0, 1.0);
+  for (int n = 0; n < nvars; ++n)
+    for (ptrdiff_t ind = 0; ind < np; ++ind)
+      vars[n][ind] = dist(engine);
+  copy_vars(old);
+  calc_rhs(true, a, dt);
+
+  // Only the interior is calculated
+  const array<int, Loop::dim> nghostzones{
+      cctk_nghostzones[0], cctk_nghostzones[1], cctk_nghostzones[2]};
+  vect<int, Loop::dim> imin, imax;
+  Loop::GridDescBase(cctkGH).box_int<0, 0, 0>(nghostzones, imin, imax);
+  const Loop::GF3D2layout layout1(cctkGH, {0, 0, 0});
+
+  for (int n = 0; n < nvars; ++n) {
+    CCTK_REAL maxabs = 0, maxdiff = 0;
+    for (int k = imin[2]; k < imax[2]; ++k) {
+      for (int j = imin[1]; j < imax[1]; ++j) {
+        for (int i = imin[0]; i < imax[0]; ++i) {
+          const ptrdiff_t ind = layout1.linear(i, j, k);
+          const CCTK_REAL x = a * old[n * np + ind] + dt * rhs[n * np + ind];
+          const CCTK_REAL y = vars[n][ind];
+          const CCTK_REAL diff = fabs(x - y);
+          maxabs = fmax(maxabs, fmax(fabs(x), fabs(y)));
+          // Keep nans
+          if (isnan(diff) || diff > maxdiff)
+            maxdiff = diff;
+        }
+      }
+    }
+    if (!(maxdiff <= 1.0e-12 * maxabs))
+      CCTK_VERROR("Accumulated RHS differs from a * rhs_old + dt * RHS for RHS "
+                  "variable %d: max |difference| = %g, max |RHS| = %g",
+                  n, double(maxdiff), double(maxabs));
+  }
+
+  // Leave the RHS variables as they were for the actual calculation
+  restore_vars(saved);
+}
+
 } // namespace Z4c